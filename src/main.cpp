@@ -24,6 +24,10 @@
 #include <QtWidgets/QApplication>
 #include <QFontDatabase>
 #include "ui/rcon_window.hpp"
+#include "network/reactor.hpp"
+#include "network/resolver.hpp"
+#include "network/shared_socket.hpp"
+#include "settings.hpp"
 
 int main(int argc, char** argv)
 {
@@ -34,6 +38,15 @@ int main(int argc, char** argv)
 
     QFontDatabase::addApplicationFont(":/fonts/Xolonium-Regular.otf");
 
+    network::Reactor::instance().set_thread_count(settings().network_threads);
+    network::Resolver::instance().set_cache_duration(
+        std::chrono::seconds(settings().network_dns_cache));
+    network::SharedSocket::instance().set_port(settings().network_shared_port);
+    network::SharedSocket::instance().set_workers(settings().network_shared_workers);
+    network::SharedSocket::instance().receive_batch_size(settings().network_receive_batch);
+    network::SharedSocket::instance().receive_buffer_size(
+        settings().network_receive_buffer * 1024, settings().network_receive_buffer_max * 1024);
+
     RconWindow window;
     window.show();
     return app.exec();
@@ -0,0 +1,177 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef XONOTIC_DISCOVERY_MODEL_HPP
+#define XONOTIC_DISCOVERY_MODEL_HPP
+
+#include <vector>
+
+#include <QAbstractTableModel>
+
+#include "xonotic/server_discovery.hpp"
+#include "xonotic/color_parser.hpp"
+
+/**
+ * \brief Model for the servers found by xonotic::ServerDiscovery
+ *
+ * Qt::UserRole returns values suitable for sorting.
+ */
+class DiscoveryModel : public QAbstractTableModel
+{
+public:
+    enum ColumnNames {
+        Name    = 0,
+        Address = 1,
+        Map     = 2,
+        Players = 3,
+        Ping    = 4,
+    };
+
+    /**
+     * \brief Server as shown in the table
+     */
+    struct Entry
+    {
+        network::Server address;
+        QString         name;       ///< Host name without color codes
+        QString         map;
+        int             players = 0;
+        int             max_players = 0;
+        int             ping = 0;   ///< Milliseconds
+    };
+
+    int rowCount(const QModelIndex & = {}) const override
+    {
+        return servers.size();
+    }
+
+    int columnCount(const QModelIndex & = {}) const override
+    {
+        return 5;
+    }
+
+    QVariant data(const QModelIndex & index, int role = Qt::DisplayRole) const override
+    {
+        if ( index.row() < 0 || index.row() >= int(servers.size()) )
+            return {};
+
+        const auto& server = servers[index.row()];
+        if ( role == Qt::DisplayRole || role == Qt::ToolTipRole )
+        {
+            switch(index.column())
+            {
+                case Name:    return server.name;
+                case Address: return QString::fromStdString(server.address.name());
+                case Map:     return server.map;
+                case Players: return QString("%1/%2").arg(server.players).arg(server.max_players);
+                case Ping:    return server.ping;
+            }
+        }
+        else if ( role == Qt::UserRole )
+        {
+            switch(index.column())
+            {
+                case Name:    return server.name.toLower();
+                case Address: return QString::fromStdString(server.address.name());
+                case Map:     return server.map;
+                case Players: return server.players;
+                case Ping:    return server.ping;
+            }
+        }
+        else if ( role == Qt::TextAlignmentRole && index.column() >= Players )
+        {
+            return Qt::AlignCenter;
+        }
+
+        return {};
+    }
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override
+    {
+        if ( orientation != Qt::Horizontal || role != Qt::DisplayRole )
+            return {};
+
+        switch(section)
+        {
+            case Name:    return QObject::tr("Name");
+            case Address: return QObject::tr("Address");
+            case Map:     return QObject::tr("Map");
+            case Players: return QObject::tr("Players");
+            case Ping:    return QObject::tr("Ping");
+        }
+        return {};
+    }
+
+    /**
+     * \brief Adds a server or updates it if it's already listed
+     */
+    void add_server(const xonotic::DiscoveredServer& discovered)
+    {
+        Entry entry;
+        entry.address = discovered.address;
+        entry.name = color_parser.convert_fragment(
+            QString::fromStdString(discovered.info.value("hostname", discovered.address.name())));
+        entry.map = QString::fromStdString(discovered.info.value("mapname"));
+        entry.players = discovered.info.number("clients");
+        entry.max_players = discovered.info.number("sv_maxclients");
+        entry.ping = std::chrono::duration_cast<std::chrono::milliseconds>(discovered.rtt).count();
+
+        for ( std::size_t i = 0; i < servers.size(); i++ )
+        {
+            if ( servers[i].address == entry.address )
+            {
+                servers[i] = std::move(entry);
+                emit dataChanged(index(i, 0), index(i, columnCount()-1));
+                return;
+            }
+        }
+
+        beginInsertRows(QModelIndex(), servers.size(), servers.size());
+        servers.push_back(std::move(entry));
+        endInsertRows();
+    }
+
+    /**
+     * \brief Server at the given row
+     */
+    const Entry& server(int row) const
+    {
+        return servers[row];
+    }
+
+    /**
+     * \brief Removes all the servers
+     */
+    void clear()
+    {
+        beginResetModel();
+        servers.clear();
+        endResetModel();
+    }
+
+private:
+    std::vector<Entry> servers;
+    xonotic::ColorParserPlainText color_parser;
+};
+
+#endif // XONOTIC_DISCOVERY_MODEL_HPP
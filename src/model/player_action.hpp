@@ -80,6 +80,17 @@ public:
         ;
     }
 
+    /**
+     * \brief Whether \p player has the fields the command uses
+     *
+     * Players only known from getstatus lack the entity number and the IP.
+     */
+    bool available(const xonotic::Player& player) const
+    {
+        return !( command_.contains("$player.entity") && player.no.isEmpty() ) &&
+               !( command_.contains("$player.ip") && player.ip.isEmpty() );
+    }
+
     /**
      * \brief Name/path of the icon for the action
      */
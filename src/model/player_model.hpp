@@ -24,6 +24,7 @@
 #ifndef XONOTIC_PLAYER_MODEL_HPP
 #define XONOTIC_PLAYER_MODEL_HPP
 
+#include <algorithm>
 #include <vector>
 
 #include <QAbstractTableModel>
@@ -84,6 +85,47 @@ public slots:
         emit players_changed(players_);
     }
 
+    /**
+     * \brief Updates the players from a list lacking some of the fields
+     *
+     * Fields left empty in \p player_list are kept from the current
+     * player with the same name. Players sharing a name are paired in
+     * order, each current player is used once. If the number of players
+     * with a name has changed there's no telling who left, so those keep
+     * only the fields in \p player_list.
+     */
+    void update_players(const std::vector<xonotic::Player>& player_list)
+    {
+        std::vector<xonotic::Player> merged = player_list;
+        std::vector<bool> used(players_.size(), false);
+        auto count = [](const std::vector<xonotic::Player>& list, const QString& name) {
+            return std::count_if(list.begin(), list.end(),
+                [&name](const xonotic::Player& player) { return player.name == name; });
+        };
+
+        for ( auto& player : merged )
+        {
+            bool same_players = count(players_, player.name) == count(merged, player.name);
+            for ( std::size_t i = 0; i < players_.size(); i++ )
+            {
+                const auto& old = players_[i];
+                if ( used[i] || old.name != player.name )
+                    continue;
+                used[i] = true;
+                if ( !same_players )
+                    break;
+                if ( player.ip.isEmpty() )    player.ip = old.ip;
+                if ( player.pl.isEmpty() )    player.pl = old.pl;
+                if ( player.ping.isEmpty() )  player.ping = old.ping;
+                if ( player.time.isEmpty() )  player.time = old.time;
+                if ( player.frags.isEmpty() ) player.frags = old.frags;
+                if ( player.no.isEmpty() )    player.no = old.no;
+                break;
+            }
+        }
+        set_players(merged);
+    }
+
     /**
      * \brief Removes all stored players
      */
@@ -0,0 +1,231 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef NETWORK_CAPTURE_HPP
+#define NETWORK_CAPTURE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+#include "string_view.hpp"
+#include "time.hpp"
+
+namespace network {
+
+/**
+ * \brief Binary capture files of received datagrams
+ *
+ * A capture starts with the 8 byte magic "RGCAP\0\0\1", followed by
+ * one record per datagram:
+ *  * Microseconds since the arrival of the previous datagram
+ *    (since the epoch for the first one), as a zigzag-encoded varint
+ *  * Size of the datagram as a varint
+ *  * Contents of the datagram
+ */
+namespace capture {
+
+static const char magic[8] = {'R', 'G', 'C', 'A', 'P', 0, 0, 1};
+
+/**
+ * \brief Largest datagram accepted when reading, to detect corrupted files
+ */
+static const uint64_t max_datagram_size = 65536;
+
+/**
+ * \brief Microseconds since the epoch
+ */
+inline int64_t to_microseconds(WallTime time)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+}
+
+inline WallTime from_microseconds(int64_t microseconds)
+{
+    return WallTime(std::chrono::duration_cast<WallClock::duration>(
+        std::chrono::microseconds(microseconds)));
+}
+
+inline void write_varint(std::ostream& stream, uint64_t value)
+{
+    char bytes[10];
+    std::size_t size = 0;
+    do
+    {
+        bytes[size] = value & 0x7f;
+        value >>= 7;
+        if ( value )
+            bytes[size] |= 0x80;
+        size++;
+    }
+    while ( value );
+    stream.write(bytes, size);
+}
+
+inline bool read_varint(std::istream& stream, uint64_t& value)
+{
+    value = 0;
+    for ( int shift = 0; shift < 64; shift += 7 )
+    {
+        int byte = stream.get();
+        if ( byte == std::char_traits<char>::eof() )
+            return false;
+        value |= uint64_t(byte & 0x7f) << shift;
+        if ( !(byte & 0x80) )
+            return true;
+    }
+    return false;
+}
+
+} // namespace capture
+
+/**
+ * \brief Writes received datagrams to a capture file
+ *
+ * Thread safe, is_open() is cheap enough to be checked for every datagram.
+ */
+class CaptureWriter
+{
+public:
+    ~CaptureWriter()
+    {
+        close();
+    }
+
+    /**
+     * \brief Starts a new capture in \p path, closing the current one
+     * \returns \b false if the file can't be written
+     */
+    bool open(const std::string& path)
+    {
+        Lock lock(mutex);
+        file.close();
+        file.clear();
+        file.open(path, std::ios::binary | std::ios::trunc);
+        file.write(capture::magic, sizeof(capture::magic));
+        previous = 0;
+        opened = file.good();
+        if ( !opened )
+            file.close();
+        return opened;
+    }
+
+    /**
+     * \brief Finishes the capture
+     */
+    void close()
+    {
+        Lock lock(mutex);
+        opened = false;
+        file.close();
+    }
+
+    bool is_open() const
+    {
+        return opened;
+    }
+
+    /**
+     * \brief Appends a datagram
+     */
+    void write(StringView datagram, WallTime arrival)
+    {
+        Lock lock(mutex);
+        if ( !opened )
+            return;
+        int64_t time = capture::to_microseconds(arrival);
+        int64_t delta = time - previous;
+        previous = time;
+        capture::write_varint(file, (uint64_t(delta) << 1) ^ uint64_t(delta >> 63));
+        capture::write_varint(file, datagram.size());
+        file.write(datagram.data(), datagram.size());
+    }
+
+    /**
+     * \brief Writes what has been buffered to the file
+     *
+     * So a capture survives the process being killed, up to the last flush.
+     */
+    void flush()
+    {
+        Lock lock(mutex);
+        if ( opened )
+            file.flush();
+    }
+
+private:
+    using Lock = std::unique_lock<std::mutex>;
+
+    std::mutex          mutex;
+    std::ofstream       file;
+    std::atomic<bool>   opened{false};
+    int64_t             previous = 0;   ///< Arrival of the last datagram in microseconds
+};
+
+/**
+ * \brief Reads the datagrams from a capture file
+ */
+class CaptureReader
+{
+public:
+    /**
+     * \brief Opens \p path
+     * \returns \b false if the file can't be read or isn't a capture
+     */
+    bool open(const std::string& path)
+    {
+        file.close();
+        file.clear();
+        file.open(path, std::ios::binary);
+        char header[sizeof(capture::magic)];
+        previous = 0;
+        return file.read(header, sizeof(header)) &&
+            std::memcmp(header, capture::magic, sizeof(header)) == 0;
+    }
+
+    /**
+     * \brief Reads the next datagram
+     * \returns \b false at the end of the capture
+     */
+    bool next(std::string& datagram, WallTime& arrival)
+    {
+        uint64_t delta, size;
+        if ( !capture::read_varint(file, delta) || !capture::read_varint(file, size) ||
+             size > capture::max_datagram_size )
+            return false;
+        previous += int64_t(delta >> 1) ^ -int64_t(delta & 1);
+        arrival = capture::from_microseconds(previous);
+        datagram.resize(size);
+        return size == 0 || file.read(&datagram[0], size);
+    }
+
+private:
+    std::ifstream   file;
+    int64_t         previous = 0;   ///< Arrival of the last datagram in microseconds
+};
+
+} // namespace network
+#endif // NETWORK_CAPTURE_HPP
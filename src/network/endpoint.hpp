@@ -0,0 +1,76 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef NETWORK_ENDPOINT_HPP
+#define NETWORK_ENDPOINT_HPP
+
+#include <functional>
+
+#include <boost/asio.hpp>
+
+namespace network {
+
+using UdpEndpoint = boost::asio::ip::udp::endpoint;
+
+/**
+ * \brief Hashes UDP endpoints without formatting them
+ */
+struct EndpointHash
+{
+    std::size_t operator()(const UdpEndpoint& endpoint) const
+    {
+        auto address = endpoint.address();
+        std::size_t hash = endpoint.port();
+        if ( address.is_v4() )
+            return std::hash<uint64_t>()(uint64_t(address.to_v4().to_ulong()) << 16 | hash);
+        for ( auto byte : address.to_v6().to_bytes() )
+            hash = hash * 31 + byte;
+        return hash;
+    }
+};
+
+/**
+ * \brief Converts IPv4 endpoints to IPv4-mapped IPv6, for dual stack sockets
+ */
+inline UdpEndpoint map_to_v6(const UdpEndpoint& endpoint)
+{
+    if ( endpoint.address().is_v4() )
+        return UdpEndpoint(boost::asio::ip::make_address_v6(
+            boost::asio::ip::v4_mapped, endpoint.address().to_v4()), endpoint.port());
+    return endpoint;
+}
+
+/**
+ * \brief Converts IPv4-mapped endpoints back to IPv4
+ */
+inline UdpEndpoint unmap_v4(const UdpEndpoint& endpoint)
+{
+    auto address = endpoint.address();
+    if ( address.is_v6() && address.to_v6().is_v4_mapped() )
+        return UdpEndpoint(boost::asio::ip::make_address_v4(
+            boost::asio::ip::v4_mapped, address.to_v6()), endpoint.port());
+    return endpoint;
+}
+
+} // namespace network
+#endif // NETWORK_ENDPOINT_HPP
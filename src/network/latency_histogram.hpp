@@ -0,0 +1,152 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef NETWORK_LATENCY_HISTOGRAM_HPP
+#define NETWORK_LATENCY_HISTOGRAM_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+#include "time.hpp"
+
+namespace network {
+
+/**
+ * \brief Histogram of durations with logarithmic buckets
+ *
+ * Bucket bounds follow a 1-2-5 sequence from 100us to 10s,
+ * the last bucket collects anything longer.
+ * \note Not thread safe, the owner must serialize access
+ */
+class LatencyHistogram
+{
+public:
+    static const std::size_t bucket_count = 17;
+
+    /**
+     * \brief Upper bound (inclusive) of the given bucket
+     */
+    static Clock::duration upper_bound(std::size_t bucket)
+    {
+        if ( bucket + 1 >= bucket_count )
+            return Clock::duration::max();
+        static const int steps[3] = {1, 2, 5};
+        std::chrono::microseconds bound(steps[bucket % 3] * 100);
+        for ( std::size_t i = 0; i < bucket / 3; i++ )
+            bound *= 10;
+        return bound;
+    }
+
+    /**
+     * \brief Adds a sample
+     */
+    void record(Clock::duration latency)
+    {
+        std::size_t bucket = 0;
+        while ( bucket + 1 < bucket_count && latency > upper_bound(bucket) )
+            bucket++;
+        buckets[bucket]++;
+        total++;
+        sum += latency;
+        minimum = std::min(minimum, latency);
+        maximum = std::max(maximum, latency);
+    }
+
+    /**
+     * \brief Adds all the samples from \p other
+     */
+    void merge(const LatencyHistogram& other)
+    {
+        for ( std::size_t i = 0; i < bucket_count; i++ )
+            buckets[i] += other.buckets[i];
+        total += other.total;
+        sum += other.sum;
+        minimum = std::min(minimum, other.minimum);
+        maximum = std::max(maximum, other.maximum);
+    }
+
+    /**
+     * \brief Number of samples
+     */
+    uint64_t count() const
+    {
+        return total;
+    }
+
+    /**
+     * \brief Number of samples in the given bucket
+     */
+    uint64_t bucket(std::size_t index) const
+    {
+        return buckets[index];
+    }
+
+    Clock::duration min() const
+    {
+        return total ? minimum : Clock::duration::zero();
+    }
+
+    Clock::duration max() const
+    {
+        return maximum;
+    }
+
+    Clock::duration mean() const
+    {
+        return total ? sum / Clock::rep(total) : Clock::duration::zero();
+    }
+
+    /**
+     * \brief Estimates the value below which \p fraction of the samples fall
+     *
+     * The result is the upper bound of the bucket containing the sample,
+     * capped to the largest sample.
+     */
+    Clock::duration percentile(double fraction) const
+    {
+        if ( !total )
+            return Clock::duration::zero();
+
+        uint64_t target = std::max<uint64_t>(1, std::ceil(fraction * total));
+        uint64_t seen = 0;
+        for ( std::size_t i = 0; i < bucket_count; i++ )
+        {
+            seen += buckets[i];
+            if ( seen >= target )
+                return std::min(upper_bound(i), maximum);
+        }
+        return maximum;
+    }
+
+private:
+    std::array<uint64_t, bucket_count> buckets{{}};
+    uint64_t        total = 0;
+    Clock::duration sum = Clock::duration::zero();
+    Clock::duration minimum = Clock::duration::max();
+    Clock::duration maximum = Clock::duration::zero();
+};
+
+} // namespace network
+#endif // NETWORK_LATENCY_HISTOGRAM_HPP
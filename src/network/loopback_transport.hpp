@@ -0,0 +1,272 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef NETWORK_LOOPBACK_TRANSPORT_HPP
+#define NETWORK_LOOPBACK_TRANSPORT_HPP
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <mutex>
+
+#include "functional.hpp"
+#include "transport.hpp"
+
+namespace network {
+
+/**
+ * \brief Transport which keeps datagrams in memory
+ *
+ * Written datagrams are passed to on_send and datagrams given to deliver()
+ * are received as if they came from the remote endpoint.
+ * Nothing moves until pump() is called, so a connection to an in-process
+ * peer runs deterministically and without any system call.
+ */
+class LoopbackTransport : public Transport
+{
+public:
+    /**
+     * \brief Called by pump() for each datagram written to the transport
+     */
+    std::function<void(const std::string& datagram)> on_send;
+
+    LoopbackTransport() = default;
+    LoopbackTransport(const LoopbackTransport&) = delete;
+    LoopbackTransport& operator=(const LoopbackTransport&) = delete;
+
+    /**
+     * \brief Connects immediately, on_connect is called before returning
+     */
+    bool connect(const Server& server) override
+    {
+        Lock lock(mutex);
+        if ( is_connected )
+            return false;
+        remote = server;
+        is_connected = true;
+        lock.unlock();
+        callback(on_connect);
+        return true;
+    }
+
+    bool connecting() const override
+    {
+        return false;
+    }
+
+    /**
+     * \brief Disconnects, discarding the datagrams which haven't been pumped
+     */
+    void disconnect() override
+    {
+        Lock lock(mutex);
+        is_connected = false;
+        for ( auto& queue : send_queues )
+            queue.clear();
+        received.clear();
+    }
+
+    bool connected() const override
+    {
+        Lock lock(mutex);
+        return is_connected;
+    }
+
+    bool write(std::string datagram,
+               SendPriority priority = SendPriority::Interactive) override
+    {
+        Lock lock(mutex);
+        if ( !is_connected )
+            return false;
+        if ( datagram.size() > max_size )
+            datagram.resize(max_size);
+        send_queues[int(priority)].push_back({std::move(datagram), Clock::now()});
+        return true;
+    }
+
+    /**
+     * \brief Queues a datagram to be received from the remote endpoint
+     * \returns \b false if not connected
+     */
+    bool deliver(std::string datagram)
+    {
+        Lock lock(mutex);
+        if ( !is_connected )
+            return false;
+        received.push_back({std::move(datagram), WallClock::now()});
+        return true;
+    }
+
+    /**
+     * \brief Moves queued datagrams in both directions until none is left
+     *
+     * Datagrams written or delivered by the callbacks are moved
+     * in the same call.
+     * \returns The number of datagrams which have been moved
+     */
+    std::size_t pump()
+    {
+        std::size_t moved = 0;
+        while ( std::size_t step = pump_sent() + pump_received() )
+            moved += step;
+        return moved;
+    }
+
+    std::string::size_type max_datagram_size() const override
+    {
+        return max_size;
+    }
+
+    /**
+     * \brief Sets the maximum datagram size, longer datagrams are truncated
+     */
+    void max_datagram_size(std::string::size_type size)
+    {
+        Lock lock(mutex);
+        max_size = size;
+    }
+
+    void receive_batch_size(std::size_t size) override
+    {
+        Lock lock(mutex);
+        batch_size = std::max<std::size_t>(size, 1);
+    }
+
+    Server remote_endpoint() const override
+    {
+        Lock lock(mutex);
+        return remote;
+    }
+
+    Server local_endpoint() const override
+    {
+        return {"loopback", 0};
+    }
+
+    ReceiveStatistics receive_statistics() const override
+    {
+        Lock lock(mutex);
+        return receive_stats;
+    }
+
+    SendStatistics send_statistics() const override
+    {
+        Lock lock(mutex);
+        SendStatistics stats = send_stats;
+        for ( const auto& queue : send_queues )
+        {
+            stats.queued += queue.size();
+            if ( !queue.empty() )
+                stats.delay = std::max(stats.delay, Clock::now() - queue.front().queued);
+        }
+        return stats;
+    }
+
+private:
+    using Lock = std::unique_lock<std::mutex>;
+
+    struct QueuedDatagram
+    {
+        std::string     contents;
+        Clock::time_point queued;
+    };
+
+    struct ReceivedDatagram
+    {
+        std::string     contents;
+        WallTime        arrival;
+    };
+
+    /**
+     * \brief Passes the written datagrams to on_send, by priority
+     */
+    std::size_t pump_sent()
+    {
+        std::size_t count = 0;
+        Lock lock(mutex);
+        for ( auto& queue : send_queues )
+        {
+            while ( !queue.empty() )
+            {
+                std::string datagram = std::move(queue.front().contents);
+                queue.pop_front();
+                send_stats.sent++;
+                count++;
+                lock.unlock();
+                callback(on_send, datagram);
+                lock.lock();
+            }
+        }
+        return count;
+    }
+
+    /**
+     * \brief Passes the delivered datagrams to on_async_receive in batches
+     */
+    std::size_t pump_received()
+    {
+        std::size_t count = 0;
+        std::vector<ReceivedDatagram> batch;
+        std::vector<StringView> views;
+        std::vector<WallTime> arrivals;
+        Lock lock(mutex);
+        while ( !received.empty() )
+        {
+            batch.clear();
+            while ( !received.empty() && batch.size() < batch_size )
+            {
+                batch.push_back(std::move(received.front()));
+                received.pop_front();
+            }
+            receive_stats.wakeups++;
+            receive_stats.datagrams += batch.size();
+            count += batch.size();
+            lock.unlock();
+
+            views.clear();
+            arrivals.clear();
+            for ( const auto& datagram : batch )
+            {
+                views.push_back(datagram.contents);
+                arrivals.push_back(datagram.arrival);
+            }
+            callback(on_async_receive, views, arrivals);
+
+            lock.lock();
+        }
+        return count;
+    }
+
+    mutable std::mutex          mutex;
+    bool                        is_connected = false;
+    Server                      remote;
+    std::string::size_type      max_size = 1400;
+    std::size_t                 batch_size = 32;
+    std::array<std::deque<QueuedDatagram>, 2> send_queues;  ///< Written datagrams, by SendPriority
+    std::deque<ReceivedDatagram> received;                  ///< Delivered datagrams
+    ReceiveStatistics           receive_stats;
+    SendStatistics              send_stats;
+};
+
+} // namespace network
+#endif // NETWORK_LOOPBACK_TRANSPORT_HPP
@@ -0,0 +1,191 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef NETWORK_REACTOR_HPP
+#define NETWORK_REACTOR_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+namespace network {
+
+/**
+ * \brief Event loop shared by several connections
+ *
+ * Runs a single io_service on a small pool of threads, sockets register
+ * with it instead of having a thread each.
+ */
+class Reactor
+{
+public:
+    /**
+     * \brief Reactor shared by all the connections in the application
+     */
+    static Reactor& instance()
+    {
+        static Reactor singleton;
+        return singleton;
+    }
+
+    explicit Reactor(unsigned threads = 1)
+        : threads(std::max(threads, 1u))
+    {}
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    ~Reactor()
+    {
+        stop();
+    }
+
+    /**
+     * \brief The io_service sockets should be created from
+     */
+    boost::asio::io_service& io_service()
+    {
+        return service;
+    }
+
+    /**
+     * \brief Number of threads running the event loop
+     */
+    unsigned thread_count() const
+    {
+        return threads;
+    }
+
+    /**
+     * \brief Sets the number of threads running the event loop
+     *
+     * If the reactor is running, the pool is restarted with the new size,
+     * pending operations are preserved.
+     */
+    void set_thread_count(unsigned count)
+    {
+        count = std::max(count, 1u);
+        Lock restart_lock(restart_mutex);
+        Lock lock(mutex);
+        if ( count == threads )
+            return;
+        threads = count;
+        if ( !work )
+            return;
+
+        auto old_pool = release_pool();
+        lock.unlock();
+        join(old_pool);
+        lock.lock();
+        start_pool();
+    }
+
+    /**
+     * \brief Starts the thread pool (if not already running)
+     *
+     * Handlers call this (through Timer::start() and the sockets),
+     * it doesn't wait while the pool is being restarted or stopped.
+     */
+    void start()
+    {
+        if ( running )
+            return;
+        Lock lock(mutex);
+        if ( !work )
+            start_pool();
+    }
+
+    /**
+     * \brief Stops the thread pool and waits for the threads to finish
+     */
+    void stop()
+    {
+        Lock restart_lock(restart_mutex);
+        Lock lock(mutex);
+        if ( !work )
+            return;
+
+        auto old_pool = release_pool();
+        lock.unlock();
+        join(old_pool);
+        // Only now, start() from the old threads must not restart the service under them
+        running = false;
+    }
+
+private:
+    using Lock = std::unique_lock<std::mutex>;
+    using Pool = std::vector<std::thread>;
+
+    void start_pool()
+    {
+        running = true;
+        if ( service.stopped() )
+            service.reset();
+        work.reset(new boost::asio::io_service::work(service));
+        pool.reserve(threads);
+        for ( unsigned i = 0; i < threads; i++ )
+            pool.emplace_back([this]{
+                boost::system::error_code err;
+                service.run(err);
+            });
+    }
+
+    /**
+     * \brief Stops the service and takes the threads out of \c pool
+     *
+     * Called with \c mutex locked, the threads are joined after
+     * unlocking it as their handlers may call start().
+     */
+    Pool release_pool()
+    {
+        work.reset();
+        service.stop();
+        Pool old_pool;
+        old_pool.swap(pool);
+        return old_pool;
+    }
+
+    static void join(Pool& old_pool)
+    {
+        for ( auto& thread : old_pool )
+            if ( thread.get_id() != std::this_thread::get_id() )
+                thread.join();
+            else
+                thread.detach();
+    }
+
+    boost::asio::io_service                         service;    ///< Shared IO service
+    std::unique_ptr<boost::asio::io_service::work>  work;       ///< Keeps the pool alive while idle
+    std::vector<std::thread>                        pool;       ///< Threads running \c service
+    unsigned                                        threads;    ///< Size of the pool
+    std::atomic<bool>                               running{false}; ///< Pool started, or being restarted or stopped
+    std::mutex                                      mutex;      ///< Guards the pool, taken by start()
+    std::mutex                                      restart_mutex; ///< Serializes restarts and stops, never taken by handlers
+};
+
+} // namespace network
+#endif // NETWORK_REACTOR_HPP
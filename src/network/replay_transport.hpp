@@ -0,0 +1,250 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef NETWORK_REPLAY_TRANSPORT_HPP
+#define NETWORK_REPLAY_TRANSPORT_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "capture.hpp"
+#include "functional.hpp"
+#include "transport.hpp"
+
+namespace network {
+
+/**
+ * \brief Transport which receives the datagrams from a capture file
+ *
+ * The datagrams are passed to on_async_receive from a dedicated thread,
+ * keeping the intervals recorded in the capture divided by the speed,
+ * or as fast as possible. Their arrival is the time they are replayed.
+ * Written datagrams are discarded. At the end of the capture it's no
+ * longer connected and reports it through on_status.
+ */
+class ReplayTransport : public Transport
+{
+public:
+    /**
+     * \param path  Capture file, as written by CaptureWriter
+     * \param speed How many times faster than recorded to replay,
+     *              0 to replay as fast as possible
+     */
+    explicit ReplayTransport(std::string path, double speed = 1)
+        : path(std::move(path)), speed(std::max(speed, 0.0))
+    {}
+
+    ReplayTransport(const ReplayTransport&) = delete;
+    ReplayTransport& operator=(const ReplayTransport&) = delete;
+
+    ~ReplayTransport()
+    {
+        disconnect();
+    }
+
+    /**
+     * \brief Starts replaying the capture from the beginning
+     *
+     * \p server is only reported by remote_endpoint().
+     */
+    bool connect(const Server& server) override
+    {
+        Lock lock(mutex);
+        // Can't restart from a callback, the previous replay is still running
+        if ( replaying || thread.get_id() == std::this_thread::get_id() )
+            return false;
+        // The previous replay might still be finishing
+        std::thread previous = std::move(thread);
+        lock.unlock();
+        if ( previous.joinable() )
+            previous.join();
+        lock.lock();
+        if ( replaying )
+            return false;
+
+        remote = server;
+        replaying = true;
+        thread = std::thread([this]{ replay(); });
+        return true;
+    }
+
+    bool connecting() const override
+    {
+        return false;
+    }
+
+    /**
+     * \brief Stops replaying
+     */
+    void disconnect() override
+    {
+        Lock lock(mutex);
+        replaying = false;
+        wake.notify_all();
+        if ( !thread.joinable() )
+            return;
+        // Called from a callback
+        if ( thread.get_id() == std::this_thread::get_id() )
+            return;
+        lock.unlock();
+        thread.join();
+    }
+
+    bool connected() const override
+    {
+        Lock lock(mutex);
+        return replaying;
+    }
+
+    bool write(std::string datagram, SendPriority priority = SendPriority::Interactive) override
+    {
+        Lock lock(mutex);
+        if ( !replaying )
+            return false;
+        send_stats.sent++;
+        return true;
+    }
+
+    std::string::size_type max_datagram_size() const override
+    {
+        return 1400;
+    }
+
+    void receive_batch_size(std::size_t size) override
+    {
+        Lock lock(mutex);
+        batch_size = std::max<std::size_t>(size, 1);
+    }
+
+    Server remote_endpoint() const override
+    {
+        Lock lock(mutex);
+        return remote;
+    }
+
+    Server local_endpoint() const override
+    {
+        return {"replay", 0};
+    }
+
+    ReceiveStatistics receive_statistics() const override
+    {
+        Lock lock(mutex);
+        return receive_stats;
+    }
+
+    SendStatistics send_statistics() const override
+    {
+        Lock lock(mutex);
+        return send_stats;
+    }
+
+private:
+    using Lock = std::unique_lock<std::mutex>;
+
+    void replay()
+    {
+        CaptureReader reader;
+        if ( !reader.open(path) )
+        {
+            Lock lock(mutex);
+            replaying = false;
+            lock.unlock();
+            callback(on_error, "Cannot read the capture " + path);
+            callback(on_failure);
+            return;
+        }
+
+        callback(on_connect);
+
+        std::vector<std::string> batch;
+        std::vector<StringView> views;
+        std::vector<WallTime> arrivals;
+        std::string datagram;
+        WallTime recorded;
+        WallTime first_recorded;
+        Clock::time_point start = Clock::now();
+        bool pending = reader.next(datagram, recorded);
+        if ( pending )
+            first_recorded = recorded;
+
+        Lock lock(mutex);
+        while ( replaying && pending )
+        {
+            if ( speed > 0 )
+            {
+                auto offset = std::chrono::duration_cast<Clock::duration>(
+                    (recorded - first_recorded) / speed);
+                wake.wait_until(lock, start + offset, [this]{ return !replaying; });
+                if ( !replaying )
+                    break;
+            }
+
+            // Datagrams which are due are received together, as from a socket
+            batch.clear();
+            auto now = Clock::now();
+            while ( pending && batch.size() < batch_size )
+            {
+                if ( speed > 0 && !batch.empty() &&
+                     start + std::chrono::duration_cast<Clock::duration>(
+                        (recorded - first_recorded) / speed) > now )
+                    break;
+                batch.push_back(std::move(datagram));
+                pending = reader.next(datagram, recorded);
+            }
+            receive_stats.wakeups++;
+            receive_stats.datagrams += batch.size();
+            lock.unlock();
+
+            views.assign(batch.begin(), batch.end());
+            arrivals.assign(batch.size(), WallClock::now());
+            callback(on_async_receive, views, arrivals);
+
+            lock.lock();
+        }
+
+        // Not connected any more, so connect() can replay it again
+        if ( replaying && !pending )
+        {
+            replaying = false;
+            lock.unlock();
+            callback(on_status, "End of the capture " + path);
+        }
+    }
+
+    std::string                 path;
+    double                      speed;
+    mutable std::mutex          mutex;
+    std::condition_variable     wake;       ///< Notified when replaying stops
+    std::thread                 thread;
+    bool                        replaying = false;
+    Server                      remote;
+    std::size_t                 batch_size = 32;
+    ReceiveStatistics           receive_stats;
+    SendStatistics              send_stats;
+};
+
+} // namespace network
+#endif // NETWORK_REPLAY_TRANSPORT_HPP
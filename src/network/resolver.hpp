@@ -0,0 +1,244 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef NETWORK_RESOLVER_HPP
+#define NETWORK_RESOLVER_HPP
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "server.hpp"
+#include "time.hpp"
+
+namespace network {
+
+/**
+ * \brief Asynchronous host name resolver with a shared endpoint cache
+ *
+ * Lookups run on a small set of worker threads which are only alive while
+ * there are lookups to perform, so several hosts are resolved in parallel.
+ * Concurrent requests for the same server share a single lookup.
+ */
+class Resolver
+{
+public:
+    using Endpoint = boost::asio::ip::udp::endpoint;
+    /**
+     * \brief Called with the result of a lookup
+     */
+    using Callback = std::function<void(const boost::system::error_code& error,
+                                        const Endpoint& endpoint)>;
+
+    /**
+     * \brief Resolver shared by all the connections in the application
+     */
+    static Resolver& instance()
+    {
+        static Resolver singleton;
+        return singleton;
+    }
+
+    explicit Resolver(unsigned max_workers = 16)
+        : workers(std::max(max_workers, 1u))
+    {}
+
+    Resolver(const Resolver&) = delete;
+    Resolver& operator=(const Resolver&) = delete;
+
+    ~Resolver()
+    {
+        Lock lock(mutex);
+        jobs.clear();
+        lock.unlock();
+        for ( auto& worker : workers )
+            if ( worker.thread.joinable() )
+                worker.thread.join();
+    }
+
+    /**
+     * \brief Sets for how long results are kept in the cache
+     *
+     * The system resolver doesn't expose the record TTL,
+     * so this is the upper bound on how stale a cached address can be.
+     * \param success   Duration for successful lookups
+     * \param failure   Duration for failed lookups
+     */
+    void set_cache_duration(Clock::duration success,
+                            Clock::duration failure = std::chrono::seconds(5))
+    {
+        Lock lock(mutex);
+        ttl_success = success;
+        ttl_failure = failure;
+    }
+
+    /**
+     * \brief Removes all cached results
+     */
+    void clear_cache()
+    {
+        Lock lock(mutex);
+        for ( auto it = cache.begin(); it != cache.end(); )
+        {
+            if ( it->second.pending )
+                ++it;
+            else
+                it = cache.erase(it);
+        }
+    }
+
+    /**
+     * \brief Resolves \p server
+     *
+     * If the result is cached, \p callback is invoked right away,
+     * otherwise it's invoked from a worker thread once the lookup is done.
+     */
+    void resolve(const Server& server, Callback callback)
+    {
+        std::string key = server.name();
+        Lock lock(mutex);
+
+        Entry& entry = cache[key];
+        if ( !entry.pending && entry.expires > Clock::now() )
+        {
+            auto error = entry.error;
+            auto endpoint = entry.endpoint;
+            lock.unlock();
+            callback(error, endpoint);
+            return;
+        }
+
+        entry.waiting.push_back(std::move(callback));
+        if ( entry.pending )
+            return;
+
+        entry.pending = true;
+        jobs.push_back(server);
+        spawn_worker();
+    }
+
+private:
+    using Lock = std::unique_lock<std::mutex>;
+
+    /**
+     * \brief Cached lookup result
+     */
+    struct Entry
+    {
+        boost::system::error_code   error;
+        Endpoint                    endpoint;
+        Time                        expires;
+        bool                        pending = false;    ///< Whether a lookup is in progress
+        std::vector<Callback>       waiting;            ///< Callbacks for the pending lookup
+    };
+
+    /**
+     * \brief Thread performing lookups while there are jobs
+     */
+    struct Worker
+    {
+        std::thread thread;
+        bool        busy = false;
+    };
+
+    /**
+     * \brief Starts a worker if there are idle slots
+     * \pre \c mutex is locked
+     */
+    void spawn_worker()
+    {
+        for ( auto& worker : workers )
+        {
+            if ( !worker.busy )
+            {
+                // The thread has finished its loop, so this doesn't block
+                if ( worker.thread.joinable() )
+                    worker.thread.join();
+                worker.busy = true;
+                worker.thread = std::thread([this, &worker]{ work(worker); });
+                return;
+            }
+        }
+        // All the workers are busy, they'll pick up the job when done
+    }
+
+    /**
+     * \brief Worker loop, performs lookups until the queue is empty
+     */
+    void work(Worker& worker)
+    {
+        Lock lock(mutex);
+        while ( !jobs.empty() )
+        {
+            Server server = jobs.front();
+            jobs.pop_front();
+            lock.unlock();
+
+            boost::system::error_code error;
+            Endpoint endpoint;
+            boost::asio::io_service service;
+            boost::asio::ip::udp::resolver resolver(service);
+            boost::asio::ip::udp::resolver::query query(
+                server.host, std::to_string(server.port));
+            auto iter = resolver.resolve(query, error);
+            if ( !error )
+            {
+                if ( iter == boost::asio::ip::udp::resolver::iterator() )
+                    error = boost::asio::error::host_not_found;
+                else
+                    endpoint = *iter;
+            }
+
+            lock.lock();
+            Entry& entry = cache[server.name()];
+            entry.error = error;
+            entry.endpoint = endpoint;
+            entry.expires = Clock::now() + (error ? ttl_failure : ttl_success);
+            entry.pending = false;
+            std::vector<Callback> waiting;
+            waiting.swap(entry.waiting);
+            lock.unlock();
+
+            for ( const auto& callback : waiting )
+                callback(error, endpoint);
+
+            lock.lock();
+        }
+        worker.busy = false;
+    }
+
+    std::unordered_map<std::string, Entry>  cache;      ///< Results by server name
+    std::deque<Server>                      jobs;       ///< Lookups to be performed
+    std::vector<Worker>                     workers;    ///< Lookup threads
+    Clock::duration                         ttl_success = std::chrono::minutes(5);
+    Clock::duration                         ttl_failure = std::chrono::seconds(5);
+    std::mutex                              mutex;
+};
+
+} // namespace network
+#endif // NETWORK_RESOLVER_HPP
@@ -0,0 +1,702 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef NETWORK_SHARED_SOCKET_HPP
+#define NETWORK_SHARED_SOCKET_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#ifdef __linux__
+#   include <poll.h>
+#   include <pthread.h>
+#   include <sys/socket.h>
+#endif
+
+#include "endpoint.hpp"
+#include "functional.hpp"
+#include "reactor.hpp"
+#include "socket_options.hpp"
+#include "string_view.hpp"
+
+namespace network {
+
+/**
+ * \brief Unconnected UDP socket serving many connections
+ *
+ * Datagrams are routed to the receiver attached for their source endpoint,
+ * so any number of servers can be reached from a single local port.
+ *
+ * By default the socket is drained by the reactor threads, for heavy log
+ * traffic it can be split into a group of sockets with a worker thread each
+ * (see set_workers()).
+ */
+class SharedSocket
+{
+public:
+    using Endpoint = UdpEndpoint;
+    /**
+     * \brief Receives the datagrams from one endpoint drained in a single wakeup,
+     * the views are only valid for the duration of the call.
+     * \see UdpIo::on_async_receive
+     */
+    using Receiver = std::function<void(const std::vector<StringView>& datagrams,
+                                        const std::vector<WallTime>& arrivals)>;
+
+    /**
+     * \brief Called when a network error arises
+     */
+    std::function<void(const std::string& message)> on_error;
+
+    /**
+     * \brief Socket shared by all the connections in the application
+     */
+    static SharedSocket& instance()
+    {
+        static SharedSocket singleton;
+        return singleton;
+    }
+
+    explicit SharedSocket(Reactor& reactor = Reactor::instance())
+        : reactor(reactor)
+    {}
+
+    SharedSocket(const SharedSocket&) = delete;
+    SharedSocket& operator=(const SharedSocket&) = delete;
+
+    ~SharedSocket()
+    {
+        Lock lock(mutex);
+        receivers.clear();
+        close(lock);
+    }
+
+    /**
+     * \brief Sets the local port, 0 to pick any available port
+     *
+     * Takes effect the next time the socket is opened
+     * with no connection attached.
+     */
+    void set_port(uint16_t port)
+    {
+        Lock lock(mutex);
+        requested_port = port;
+    }
+
+    /**
+     * \brief Sets the number of threads receiving datagrams
+     *
+     * With 0 a single socket is drained by the reactor threads.
+     * Otherwise as many sockets are bound to the port with SO_REUSEPORT,
+     * the kernel spreads the servers among them and each socket is drained
+     * by its own thread, pinned to a core.
+     * Only supported on Linux, elsewhere the reactor is always used.
+     *
+     * Takes effect the next time the socket is opened
+     * with no connection attached.
+     */
+    void set_workers(std::size_t workers)
+    {
+        Lock lock(mutex);
+#ifdef __linux__
+        requested_workers = workers;
+#else
+        (void)workers;
+#endif
+    }
+
+    /**
+     * \brief Local port the socket is bound to, 0 if it isn't open
+     */
+    uint16_t port() const
+    {
+        Lock lock(mutex);
+        return shards.empty() ? 0 : bound_port;
+    }
+
+    /**
+     * \brief Sets the maximum number of datagrams drained per wakeup
+     *
+     * Takes effect the next time the socket is opened.
+     */
+    void receive_batch_size(std::size_t size)
+    {
+        Lock lock(mutex);
+        batch_size = std::max<std::size_t>(size, 1);
+    }
+
+    /**
+     * \brief Sets the receive buffer size of each socket in the group
+     *
+     * The buffer doubles every time the kernel drops datagrams,
+     * up to \p maximum.
+     * Takes effect the next time the socket is opened.
+     * \param initial Size in bytes, 0 for the system default
+     * \param maximum Size in bytes, 0 to never grow
+     */
+    void receive_buffer_size(std::size_t initial, std::size_t maximum)
+    {
+        Lock lock(mutex);
+        buffer_initial = initial;
+        buffer_maximum = maximum;
+    }
+
+    /**
+     * \brief Number of connections using the socket
+     */
+    std::size_t attached() const
+    {
+        Lock lock(mutex);
+        return receivers.size();
+    }
+
+    /**
+     * \brief Number of datagrams received from endpoints with no receiver
+     */
+    uint64_t unrouted() const
+    {
+        return stat_unrouted;
+    }
+
+    /**
+     * \brief Number of datagrams received by each socket in the group
+     */
+    std::vector<uint64_t> shard_datagrams() const
+    {
+        Lock lock(mutex);
+        std::vector<uint64_t> counts;
+        for ( const auto& shard : shards )
+            counts.push_back(shard->datagrams);
+        return counts;
+    }
+
+    /**
+     * \brief Number of datagrams dropped by the kernel since the socket was opened
+     *
+     * The kernel doesn't know which connection they were meant for,
+     * so they can't be attributed to a receiver.
+     */
+    uint64_t kernel_drops() const
+    {
+        Lock lock(mutex);
+        uint64_t count = 0;
+        for ( const auto& shard : shards )
+            count += shard->kernel_drops.total();
+        return count;
+    }
+
+    /**
+     * \brief Routes datagrams coming from \p remote to \p receiver
+     *
+     * Opens the socket if needed.
+     * \returns \b false if the socket can't be opened or
+     *          another receiver is already attached for \p remote
+     */
+    bool attach(const Endpoint& remote, Receiver receiver, boost::system::error_code& error)
+    {
+        Lock lock(mutex);
+        Endpoint key = unmap_v4(remote);
+        if ( receivers.count(key) )
+        {
+            error = boost::asio::error::address_in_use;
+            return false;
+        }
+
+        // Nobody is using the old sockets, so they can be changed
+        bool changed = ( requested_port != 0 && requested_port != bound_port ) ||
+                       requested_workers != workers;
+        if ( !shards.empty() && receivers.empty() && changed )
+            close(lock);
+
+        if ( shards.empty() && !open(error) )
+            return false;
+
+        auto registration = std::make_shared<Registration>();
+        registration->receiver = std::move(receiver);
+        receivers[key] = std::move(registration);
+        return true;
+    }
+
+    /**
+     * \brief Stops routing datagrams from \p remote
+     *
+     * Waits for a running receiver to return, unless called from within it.
+     */
+    void detach(const Endpoint& remote)
+    {
+        Lock lock(mutex);
+        auto it = receivers.find(unmap_v4(remote));
+        if ( it == receivers.end() )
+            return;
+        auto registration = it->second;
+        registration->active = false;
+        receivers.erase(it);
+        if ( registration->thread != std::this_thread::get_id() )
+            idle.wait(lock, [&registration]{ return registration->busy == 0; });
+    }
+
+    /**
+     * \brief Sends a datagram to \p remote
+     */
+    void send_to(const std::string& datagram, const Endpoint& remote,
+                 boost::system::error_code& error)
+    {
+        Lock lock(mutex);
+        if ( shards.empty() )
+        {
+            error = boost::asio::error::not_connected;
+            return;
+        }
+        auto& socket = shards.front()->socket;
+        lock.unlock();
+        socket.send_to(boost::asio::buffer(datagram), ipv6 ? map_to_v6(remote) : remote, 0, error);
+    }
+
+    /**
+     * \brief Local endpoint \p remote sees datagrams coming from
+     *
+     * The address is the one of the interface used to reach \p remote.
+     */
+    Endpoint local_endpoint(const Endpoint& remote) const
+    {
+        boost::system::error_code error;
+        boost::asio::io_service service;
+        boost::asio::ip::udp::socket probe(service);
+        Endpoint target = unmap_v4(remote);
+        // Connecting an UDP socket only selects the route, nothing is sent
+        probe.open(target.protocol(), error);
+        if ( !error )
+            probe.connect(target, error);
+        auto local = probe.local_endpoint(error);
+        Lock lock(mutex);
+        return Endpoint(local.address(), bound_port);
+    }
+
+private:
+    using Lock = std::unique_lock<std::mutex>;
+
+    /**
+     * \brief Receiver attached for an endpoint
+     */
+    struct Registration
+    {
+        Receiver        receiver;
+        bool            active = true;  ///< Cleared by detach()
+        unsigned        busy = 0;       ///< Number of threads running \c receiver
+        std::thread::id thread;         ///< Last thread which has run \c receiver
+    };
+
+    /**
+     * \brief Datagrams for one receiver, collected in a single wakeup
+     */
+    struct Delivery
+    {
+        std::shared_ptr<Registration>   registration;
+        std::vector<StringView>         datagrams;
+        std::vector<WallTime>           arrivals;       ///< Receive time of each datagram
+    };
+
+    /**
+     * \brief Socket of the group and its receive buffers
+     *
+     * The buffers are only used by the thread draining the socket.
+     */
+    struct Shard
+    {
+        explicit Shard(boost::asio::io_service& service) : socket(service) {}
+
+        boost::asio::ip::udp::socket    socket;
+        std::thread                     worker;         ///< Draining thread, unless using the reactor
+        std::thread::id                 handler_thread; ///< Thread calling receivers
+        std::size_t                     slot_count = 0; ///< Number of datagrams fitting in \c receive_buffer
+        std::vector<char>               receive_buffer; ///< One slot per datagram
+        std::vector<Endpoint>           senders;        ///< Source of each datagram in the current wakeup
+        std::vector<std::size_t>        lengths;        ///< Size of each datagram in the current wakeup
+        std::vector<WallTime>           times;          ///< Receive time of each datagram in the current wakeup
+#ifdef __linux__
+        std::vector<sockaddr_storage>   addresses;      ///< recvmmsg() source addresses, one per slot
+        std::vector<mmsghdr>            headers;        ///< recvmmsg() headers, one per slot
+        std::vector<iovec>              iovecs;         ///< recvmmsg() buffers, one per slot
+        std::vector<char>               controls;       ///< recvmmsg() control buffers, one per slot
+#endif
+        ReceiveBufferSizer              buffer_sizer;   ///< Grows the receive buffer when datagrams are dropped
+        DropCounter                     kernel_drops;   ///< See SharedSocket::kernel_drops()
+        std::vector<Delivery>           ready;          ///< Datagrams routed in the current wakeup
+        std::unordered_map<Registration*, std::size_t> ready_index; ///< Position in \c ready
+        std::atomic<uint64_t>           datagrams{0};   ///< Number of datagrams received
+    };
+
+    /**
+     * \brief Opens and binds the sockets, then starts reading
+     * \pre \c mutex is locked and \c shards is empty
+     */
+    bool open(boost::system::error_code& error)
+    {
+        workers = requested_workers;
+        uint16_t port = requested_port;
+        for ( std::size_t i = 0; i < std::max<std::size_t>(workers, 1); i++ )
+        {
+            std::unique_ptr<Shard> shard(new Shard(reactor.io_service()));
+            if ( !open_socket(shard->socket, port, i == 0, error) )
+            {
+                shards.clear();
+                return false;
+            }
+            if ( i == 0 )
+                port = bound_port = shard->socket.local_endpoint(error).port();
+            shard->buffer_sizer.configure(buffer_initial, buffer_maximum);
+            shard->buffer_sizer.apply(shard->socket);
+            enable_drop_counter(shard->socket);
+            enable_timestamps(shard->socket);
+            allocate_slots(*shard);
+            shards.push_back(std::move(shard));
+        }
+
+        if ( workers == 0 )
+        {
+            reactor.start();
+            schedule_read(*shards.front());
+            return true;
+        }
+
+#ifdef __linux__
+        running = true;
+        unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+        for ( std::size_t i = 0; i < shards.size(); i++ )
+        {
+            Shard* shard = shards[i].get();
+            shard->worker = std::thread([this, shard]{ work(*shard); });
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(i % cores, &cpus);
+            pthread_setaffinity_np(shard->worker.native_handle(), sizeof(cpus), &cpus);
+        }
+#endif
+        return true;
+    }
+
+    /**
+     * \brief Opens and binds a socket of the group
+     * \param first Whether it's the first socket, which selects the address family
+     * \pre \c mutex is locked
+     */
+    bool open_socket(boost::asio::ip::udp::socket& socket, uint16_t port, bool first,
+                     boost::system::error_code& error)
+    {
+        boost::system::error_code ignored;
+        // A dual stack socket reaches both IPv4 and IPv6 servers
+        if ( first || ipv6 )
+        {
+            socket.open(boost::asio::ip::udp::v6(), error);
+            if ( !error )
+                socket.set_option(boost::asio::ip::v6_only(false), error);
+            if ( !error && workers )
+                reuse_port(socket, error);
+            if ( !error )
+                socket.bind(Endpoint(boost::asio::ip::udp::v6(), port), error);
+            if ( first )
+                ipv6 = !error;
+            if ( !error || !first )
+                return !error;
+            socket.close(ignored);
+            error.clear();
+        }
+
+        socket.open(boost::asio::ip::udp::v4(), error);
+        if ( !error && workers )
+            reuse_port(socket, error);
+        if ( !error )
+            socket.bind(Endpoint(boost::asio::ip::udp::v4(), port), error);
+        if ( error )
+            socket.close(ignored);
+        return !error;
+    }
+
+    /**
+     * \brief Allows the sockets of the group to share the port
+     */
+    static void reuse_port(boost::asio::ip::udp::socket& socket, boost::system::error_code& error)
+    {
+#ifdef __linux__
+        int enable = 1;
+        if ( ::setsockopt(socket.native_handle(), SOL_SOCKET, SO_REUSEPORT,
+                          &enable, sizeof(enable)) != 0 )
+            error.assign(errno, boost::system::system_category());
+#else
+        (void)socket;
+        (void)error;
+#endif
+    }
+
+    /**
+     * \brief Closes the sockets and waits for the threads reading from them
+     *
+     * Does nothing when called from a receiver.
+     * \pre \c mutex is locked
+     */
+    void close(Lock& lock)
+    {
+        for ( const auto& shard : shards )
+            if ( shard->handler_thread == std::this_thread::get_id() )
+                return;
+
+        std::vector<std::unique_ptr<Shard>> closing;
+        closing.swap(shards);
+        running = false;
+        lock.unlock();
+        for ( const auto& shard : closing )
+            if ( shard->worker.joinable() )
+                shard->worker.join();
+        lock.lock();
+
+        boost::system::error_code ignored;
+        for ( const auto& shard : closing )
+            shard->socket.close(ignored);
+        read_done.wait(lock, [this]{ return !reading; });
+    }
+
+    /**
+     * \brief Preallocates the buffers used by receive_batch()
+     * \pre \c mutex is locked
+     */
+    void allocate_slots(Shard& shard)
+    {
+        shard.slot_count = batch_size;
+        shard.receive_buffer.resize(shard.slot_count * slot_size);
+        shard.senders.resize(shard.slot_count);
+        shard.lengths.resize(shard.slot_count);
+#ifdef __linux__
+        shard.addresses.resize(shard.slot_count);
+        shard.headers.assign(shard.slot_count, mmsghdr());
+        shard.iovecs.resize(shard.slot_count);
+        for ( std::size_t i = 0; i < shard.slot_count; i++ )
+        {
+            shard.iovecs[i].iov_base = &shard.receive_buffer[i * slot_size];
+            shard.iovecs[i].iov_len = slot_size;
+            shard.headers[i].msg_hdr.msg_iov = &shard.iovecs[i];
+            shard.headers[i].msg_hdr.msg_iovlen = 1;
+            shard.headers[i].msg_hdr.msg_name = &shard.addresses[i];
+        }
+#endif
+    }
+
+    /**
+     * \brief Reads as many datagrams as they are available, up to \c slot_count
+     * \returns The number of datagrams read in \c senders, \c lengths and \c times
+     */
+    static std::size_t receive_batch(Shard& shard, boost::system::error_code& error)
+    {
+#ifdef __linux__
+        for ( auto& header : shard.headers )
+            header.msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+        reset_control_buffers(shard.headers, shard.controls);
+        int count = ::recvmmsg(shard.socket.native_handle(), shard.headers.data(),
+                               shard.slot_count, MSG_DONTWAIT, nullptr);
+        if ( count < 0 )
+        {
+            if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+                error.assign(errno, boost::system::system_category());
+            return 0;
+        }
+        for ( int i = 0; i < count; i++ )
+        {
+            std::size_t size = std::min<std::size_t>(shard.headers[i].msg_hdr.msg_namelen,
+                                                     shard.senders[i].capacity());
+            std::memcpy(shard.senders[i].data(), &shard.addresses[i], size);
+            shard.senders[i].resize(size);
+            shard.lengths[i] = shard.headers[i].msg_len;
+        }
+
+        uint32_t counter;
+        if ( read_drop_counter(shard.headers, count, counter) && shard.kernel_drops.update(counter) )
+            shard.buffer_sizer.grow(shard.socket);
+        read_timestamps(shard.headers, count, shard.times, WallClock::now());
+        return count;
+#else
+        // The first receive won't block as the socket is readable
+        std::size_t count = 0;
+        while ( count < shard.slot_count && ( count == 0 || shard.socket.available(error) ) )
+        {
+            shard.lengths[count] = shard.socket.receive_from(boost::asio::mutable_buffers_1(
+                &shard.receive_buffer[count * slot_size], slot_size),
+                shard.senders[count], 0, error);
+            if ( error )
+                break;
+            count++;
+        }
+        shard.times.assign(count, WallClock::now());
+        return count;
+#endif
+    }
+
+    /**
+     * \brief Groups the datagrams read in \p shard by receiver
+     * \pre \c mutex is locked
+     */
+    void route(Shard& shard, std::size_t count)
+    {
+        shard.datagrams += count;
+        for ( std::size_t i = 0; i < count; i++ )
+        {
+            auto it = receivers.find(unmap_v4(shard.senders[i]));
+            if ( it == receivers.end() )
+            {
+                stat_unrouted++;
+                continue;
+            }
+
+            auto index = shard.ready_index.find(it->second.get());
+            if ( index == shard.ready_index.end() )
+            {
+                index = shard.ready_index.emplace(it->second.get(), shard.ready.size()).first;
+                shard.ready.push_back(Delivery{it->second, {}, {}});
+            }
+            Delivery& delivery = shard.ready[index->second];
+            delivery.datagrams.emplace_back(&shard.receive_buffer[i * slot_size], shard.lengths[i]);
+            delivery.arrivals.push_back(shard.times[i]);
+        }
+    }
+
+    /**
+     * \brief Passes the routed datagrams to their receivers
+     * \pre \c mutex is locked, it's unlocked while receivers run
+     */
+    void deliver(Shard& shard, Lock& lock)
+    {
+        shard.handler_thread = std::this_thread::get_id();
+        for ( auto& delivery : shard.ready )
+        {
+            Registration& registration = *delivery.registration;
+            if ( !registration.active )
+                continue;
+            registration.busy++;
+            registration.thread = std::this_thread::get_id();
+            lock.unlock();
+            registration.receiver(delivery.datagrams, delivery.arrivals);
+            lock.lock();
+            registration.busy--;
+        }
+        shard.handler_thread = std::thread::id();
+        shard.ready.clear();
+        shard.ready_index.clear();
+        idle.notify_all();
+    }
+
+    /**
+     * \brief Schedules an asynchronous read from the reactor
+     * \pre \c mutex is locked
+     */
+    void schedule_read(Shard& shard)
+    {
+        reading = true;
+        shard.socket.async_wait(boost::asio::ip::udp::socket::wait_read,
+            [this, &shard](const boost::system::error_code& error)
+            { return on_readable(shard, error); });
+    }
+
+    /**
+     * \brief Reactor read callback
+     */
+    void on_readable(Shard& shard, boost::system::error_code error)
+    {
+        Lock lock(mutex);
+        std::size_t count = 0;
+        if ( !error && shard.socket.is_open() )
+            count = receive_batch(shard, error);
+        route(shard, count);
+
+        if ( error && error != boost::asio::error::operation_aborted )
+        {
+            lock.unlock();
+            callback(on_error, error.message());
+            lock.lock();
+        }
+
+        deliver(shard, lock);
+
+        if ( !error && shard.socket.is_open() )
+        {
+            schedule_read(shard);
+            return;
+        }
+        reading = false;
+        lock.unlock();
+        read_done.notify_all();
+    }
+
+#ifdef __linux__
+    /**
+     * \brief Worker thread loop, drains \p shard until the group is closed
+     */
+    void work(Shard& shard)
+    {
+        Lock lock(mutex);
+        while ( running )
+        {
+            lock.unlock();
+            // Wakes up periodically to notice the group being closed
+            pollfd descriptor{shard.socket.native_handle(), POLLIN, 0};
+            boost::system::error_code error;
+            std::size_t count = 0;
+            if ( ::poll(&descriptor, 1, 100) > 0 )
+                count = receive_batch(shard, error);
+            if ( error )
+                callback(on_error, error.message());
+
+            lock.lock();
+            route(shard, count);
+            deliver(shard, lock);
+        }
+    }
+#endif
+
+    Reactor&                            reactor;                ///< Event loop used when there are no workers
+    std::vector<std::unique_ptr<Shard>> shards;                 ///< Sockets bound to the shared port
+    std::atomic<bool>                   ipv6{false};            ///< Whether the sockets are dual stack
+    uint16_t                            requested_port = 0;     ///< Port to bind to
+    uint16_t                            bound_port = 0;         ///< Port the sockets are bound to
+    std::size_t                         requested_workers = 0;  ///< Workers to start on open()
+    std::size_t                         workers = 0;            ///< Number of running workers
+    std::unordered_map<Endpoint, std::shared_ptr<Registration>, EndpointHash> receivers;
+    std::size_t                         batch_size = 64;        ///< Max datagrams per wakeup
+    const std::size_t                   slot_size = 2048;       ///< Size of a single receive slot
+    std::size_t                         buffer_initial = 0;     ///< Receive buffer size set on open()
+    std::size_t                         buffer_maximum = 0;     ///< Limit for growing the receive buffers
+    std::atomic<uint64_t>               stat_unrouted{0};       ///< See unrouted()
+    mutable std::mutex                  mutex;                  ///< Guards \c shards and \c receivers
+    std::condition_variable             read_done;              ///< Notified when \c reading is cleared
+    std::condition_variable             idle;                   ///< Notified when receivers return
+    bool                                reading = false;        ///< Whether a reactor read is pending
+    bool                                running = false;        ///< Whether workers should keep going
+};
+
+} // namespace network
+#endif // NETWORK_SHARED_SOCKET_HPP
@@ -0,0 +1,301 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef NETWORK_SOCKET_OPTIONS_HPP
+#define NETWORK_SOCKET_OPTIONS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "time.hpp"
+
+#ifdef __linux__
+#   include <sys/socket.h>
+#endif
+
+namespace network {
+
+/**
+ * \brief Space needed in a message control buffer for the drop counter and the timestamp
+ */
+#ifdef __linux__
+    static const std::size_t receive_control_size =
+        CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(timespec));
+#else
+    static const std::size_t receive_control_size = 0;
+#endif
+
+/**
+ * \brief Asks the kernel to attach its drop counter to received datagrams
+ *
+ * Uses SO_RXQ_OVFL, the counter is the number of datagrams dropped
+ * because the socket receive buffer was full.
+ * \returns \b false if not supported
+ */
+inline bool enable_drop_counter(boost::asio::ip::udp::socket& socket)
+{
+#if defined(__linux__) && defined(SO_RXQ_OVFL)
+    int enable = 1;
+    return ::setsockopt(socket.native_handle(), SOL_SOCKET, SO_RXQ_OVFL,
+                        &enable, sizeof(enable)) == 0;
+#else
+    (void)socket;
+    return false;
+#endif
+}
+
+/**
+ * \brief Asks the kernel to attach its receive time to received datagrams
+ *
+ * Uses SO_TIMESTAMPNS, the time is taken when the datagram reaches the
+ * socket so it doesn't include any queueing delay in the application.
+ * \returns \b false if not supported
+ */
+inline bool enable_timestamps(boost::asio::ip::udp::socket& socket)
+{
+#if defined(__linux__) && defined(SO_TIMESTAMPNS)
+    int enable = 1;
+    return ::setsockopt(socket.native_handle(), SOL_SOCKET, SO_TIMESTAMPNS,
+                        &enable, sizeof(enable)) == 0;
+#else
+    (void)socket;
+    return false;
+#endif
+}
+
+#ifdef __linux__
+/**
+ * \brief Reads the kernel receive time from the control data of a received message
+ * \returns \b false if the message doesn't carry it
+ */
+inline bool read_timestamp(msghdr& message, WallTime& time)
+{
+#ifdef SO_TIMESTAMPNS
+    for ( cmsghdr* control = CMSG_FIRSTHDR(&message); control;
+          control = CMSG_NXTHDR(&message, control) )
+    {
+        if ( control->cmsg_level == SOL_SOCKET && control->cmsg_type == SO_TIMESTAMPNS )
+        {
+            timespec stamp;
+            std::memcpy(&stamp, CMSG_DATA(control), sizeof(stamp));
+            time = WallTime(std::chrono::duration_cast<WallClock::duration>(
+                std::chrono::seconds(stamp.tv_sec) + std::chrono::nanoseconds(stamp.tv_nsec)));
+            return true;
+        }
+    }
+#else
+    (void)message;
+    (void)time;
+#endif
+    return false;
+}
+
+/**
+ * \brief Reads the drop counter from the control data of a received message
+ * \returns \b false if the message doesn't carry it
+ */
+inline bool read_drop_counter(msghdr& message, uint32_t& drops)
+{
+#ifdef SO_RXQ_OVFL
+    for ( cmsghdr* control = CMSG_FIRSTHDR(&message); control;
+          control = CMSG_NXTHDR(&message, control) )
+    {
+        if ( control->cmsg_level == SOL_SOCKET && control->cmsg_type == SO_RXQ_OVFL )
+        {
+            std::memcpy(&drops, CMSG_DATA(control), sizeof(drops));
+            return true;
+        }
+    }
+#else
+    (void)message;
+    (void)drops;
+#endif
+    return false;
+}
+
+/**
+ * \brief Points each header to its own control buffer
+ *
+ * Must be called before every recvmmsg() as the kernel overwrites
+ * the control buffer size.
+ */
+inline void reset_control_buffers(std::vector<mmsghdr>& headers, std::vector<char>& controls)
+{
+    controls.resize(headers.size() * receive_control_size);
+    for ( std::size_t i = 0; i < headers.size(); i++ )
+    {
+        headers[i].msg_hdr.msg_control = &controls[i * receive_control_size];
+        headers[i].msg_hdr.msg_controllen = receive_control_size;
+    }
+}
+
+/**
+ * \brief Reads the most recent drop counter from the first \p count messages
+ *
+ * The kernel only attaches the counter once something has been dropped.
+ * \returns \b false if none of the messages carries it
+ */
+inline bool read_drop_counter(std::vector<mmsghdr>& headers, std::size_t count, uint32_t& drops)
+{
+    for ( std::size_t i = count; i > 0; i-- )
+        if ( read_drop_counter(headers[i-1].msg_hdr, drops) )
+            return true;
+    return false;
+}
+
+/**
+ * \brief Reads the receive time of the first \p count messages
+ *
+ * Messages without a timestamp get \p fallback.
+ */
+inline void read_timestamps(std::vector<mmsghdr>& headers, std::size_t count,
+                            std::vector<WallTime>& times, WallTime fallback)
+{
+    times.resize(count);
+    for ( std::size_t i = 0; i < count; i++ )
+        if ( !read_timestamp(headers[i].msg_hdr, times[i]) )
+            times[i] = fallback;
+}
+#endif
+
+/**
+ * \brief Accumulates the drop counter reported by the kernel
+ *
+ * The kernel counter is per socket and wraps around at 32 bits.
+ */
+class DropCounter
+{
+public:
+    /**
+     * \brief Starts counting for a new socket
+     */
+    void reset()
+    {
+        last = 0;
+    }
+
+    /**
+     * \brief Updates the total from the kernel counter
+     * \returns The number of datagrams dropped since the last update
+     */
+    uint32_t update(uint32_t counter)
+    {
+        uint32_t dropped = counter - last;
+        last = counter;
+        count += dropped;
+        return dropped;
+    }
+
+    /**
+     * \brief Datagrams dropped on all the sockets counted so far
+     */
+    uint64_t total() const
+    {
+        return count;
+    }
+
+private:
+    uint32_t last = 0;
+    std::atomic<uint64_t> count{0};
+};
+
+/**
+ * \brief Sets the socket receive buffer size
+ * \returns The size reported by the kernel, which might be different
+ *          (Linux doubles it to account for bookkeeping overhead and
+ *          caps it to net.core.rmem_max)
+ */
+inline std::size_t set_receive_buffer(boost::asio::ip::udp::socket& socket, std::size_t bytes)
+{
+    boost::system::error_code error;
+    if ( bytes )
+        socket.set_option(boost::asio::socket_base::receive_buffer_size(
+            int(std::min<std::size_t>(bytes, INT32_MAX))), error);
+    boost::asio::socket_base::receive_buffer_size size;
+    socket.get_option(size, error);
+    return error ? 0 : size.value();
+}
+
+/**
+ * \brief Grows the receive buffer of a socket after datagrams have been dropped
+ *
+ * The requested size doubles on every call, up to a maximum.
+ */
+class ReceiveBufferSizer
+{
+public:
+    /**
+     * \param initial   Size set when the socket is opened, 0 keeps the system default
+     * \param maximum   Limit for growing, 0 disables growing
+     */
+    void configure(std::size_t initial, std::size_t maximum)
+    {
+        this->initial = initial;
+        this->maximum = maximum;
+    }
+
+    /**
+     * \brief Applies the initial size to a newly opened socket
+     */
+    void apply(boost::asio::ip::udp::socket& socket)
+    {
+        reported = set_receive_buffer(socket, initial);
+        // The kernel reports twice the usable size
+        requested = initial ? initial : reported / 2;
+    }
+
+    /**
+     * \brief Doubles the buffer size, unless it's already at the maximum
+     * \returns \b true if the size has changed
+     */
+    bool grow(boost::asio::ip::udp::socket& socket)
+    {
+        if ( requested >= maximum )
+            return false;
+        requested = std::min(std::max<std::size_t>(requested * 2, 4096), maximum);
+        reported = set_receive_buffer(socket, requested);
+        return true;
+    }
+
+    /**
+     * \brief Buffer size as reported by the kernel
+     */
+    std::size_t size() const
+    {
+        return reported;
+    }
+
+private:
+    std::size_t initial = 0;
+    std::size_t maximum = 0;
+    std::size_t requested = 0;
+    std::size_t reported = 0;
+};
+
+} // namespace network
+#endif // NETWORK_SOCKET_OPTIONS_HPP
@@ -33,5 +33,13 @@ namespace network {
      * \brief Time point for network::Clock
      */
     using Time      = Clock::time_point;
+    /**
+     * \brief Calendar clock, used for kernel timestamps
+     */
+    using WallClock = std::chrono::system_clock;
+    /**
+     * \brief Time point for network::WallClock
+     */
+    using WallTime  = WallClock::time_point;
 } // namespace network
 #endif // NETWORK_TIME_HPP
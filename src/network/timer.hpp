@@ -0,0 +1,140 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef NETWORK_TIMER_HPP
+#define NETWORK_TIMER_HPP
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include "functional.hpp"
+#include "reactor.hpp"
+#include "time.hpp"
+
+namespace network {
+
+/**
+ * \brief Single shot timer dispatched by a Reactor
+ *
+ * on_timeout is invoked from one of the reactor threads.
+ */
+class Timer
+{
+public:
+    /**
+     * \brief Called when the timer expires
+     */
+    std::function<void()> on_timeout;
+
+    explicit Timer(Reactor& reactor = Reactor::instance())
+        : reactor(reactor)
+    {}
+
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+    ~Timer()
+    {
+        cancel();
+    }
+
+    /**
+     * \brief Starts the timer, replacing any previous expiry time
+     */
+    void start(Clock::duration delay)
+    {
+        Lock lock(mutex);
+        generation++;
+        armed = true;
+        timer.expires_from_now(delay);
+        pending++;
+        unsigned long expected = generation;
+        timer.async_wait([this, expected](const boost::system::error_code& error)
+            { on_expired(error, expected); });
+        reactor.start();
+    }
+
+    /**
+     * \brief Starts the timer, unless it's already going to expire before \p delay
+     */
+    void start_before(Clock::duration delay)
+    {
+        Lock lock(mutex);
+        bool earlier = armed && timer.expires_at() <= Clock::now() + delay;
+        lock.unlock();
+        if ( !earlier )
+            start(delay);
+    }
+
+    /**
+     * \brief Stops the timer
+     *
+     * Waits for a running on_timeout to complete, unless called from within it.
+     */
+    void cancel()
+    {
+        Lock lock(mutex);
+        generation++;
+        armed = false;
+        timer.cancel();
+        if ( handler_thread != std::this_thread::get_id() )
+            done.wait(lock, [this]{ return pending == 0; });
+    }
+
+private:
+    using Lock = std::unique_lock<std::mutex>;
+
+    void on_expired(const boost::system::error_code& error, unsigned long expected)
+    {
+        Lock lock(mutex);
+        bool fire = !error && expected == generation;
+        if ( fire )
+        {
+            armed = false;
+            handler_thread = std::this_thread::get_id();
+            lock.unlock();
+            callback(on_timeout);
+            lock.lock();
+            handler_thread = std::thread::id();
+        }
+        pending--;
+        lock.unlock();
+        done.notify_all();
+    }
+
+    Reactor&                    reactor;
+    boost::asio::steady_timer   timer{reactor.io_service()};
+    std::mutex                  mutex;
+    std::condition_variable     done;               ///< Notified when a handler completes
+    unsigned                    pending = 0;        ///< Number of handlers yet to complete
+    unsigned long               generation = 0;     ///< Invalidates handlers of previous starts
+    bool                        armed = false;      ///< Whether on_timeout is going to be called
+    std::thread::id             handler_thread;     ///< Thread running on_timeout
+};
+
+} // namespace network
+#endif // NETWORK_TIMER_HPP
@@ -0,0 +1,120 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef NETWORK_TOKEN_BUCKET_HPP
+#define NETWORK_TOKEN_BUCKET_HPP
+
+#include <algorithm>
+
+#include "time.hpp"
+
+namespace network {
+
+/**
+ * \brief Rate limiter allowing short bursts
+ *
+ * Tokens are added at a fixed rate up to a maximum, each event takes one.
+ * \note Not thread safe, the owner must serialize access
+ */
+class TokenBucket
+{
+public:
+    /**
+     * \param rate  Tokens added per second, 0 disables the limit
+     * \param burst Maximum number of tokens
+     */
+    explicit TokenBucket(double rate = 0, double burst = 1)
+    {
+        configure(rate, burst);
+    }
+
+    /**
+     * \brief Changes rate and burst, keeping the tokens collected so far
+     */
+    void configure(double rate, double burst, Time now = Clock::now())
+    {
+        if ( unlimited() )
+            tokens = burst;
+        else
+            refill(now);
+        this->rate = std::max(rate, 0.0);
+        this->burst = std::max(burst, 1.0);
+        tokens = std::min(tokens, this->burst);
+        last = now;
+    }
+
+    /**
+     * \brief Whether there is no limit
+     */
+    bool unlimited() const
+    {
+        return rate <= 0;
+    }
+
+    /**
+     * \brief Takes a token if one is available
+     */
+    bool consume(Time now = Clock::now())
+    {
+        if ( unlimited() )
+            return true;
+        refill(now);
+        if ( tokens < 1 )
+            return false;
+        tokens -= 1;
+        return true;
+    }
+
+    /**
+     * \brief Time until a token is available
+     */
+    Clock::duration delay(Time now = Clock::now())
+    {
+        if ( unlimited() )
+            return Clock::duration::zero();
+        refill(now);
+        if ( tokens >= 1 )
+            return Clock::duration::zero();
+        return std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>((1 - tokens) / rate));
+    }
+
+private:
+    void refill(Time now)
+    {
+        if ( now > last )
+        {
+            tokens = std::min(burst, tokens +
+                std::chrono::duration<double>(now - last).count() * rate);
+            last = now;
+        }
+    }
+
+    double  rate = 0;
+    double  burst = 1;
+    double  tokens = 1;
+    Time    last;       ///< Time of the last refill
+};
+
+} // namespace network
+#endif // NETWORK_TOKEN_BUCKET_HPP
@@ -0,0 +1,239 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef NETWORK_TRANSPORT_HPP
+#define NETWORK_TRANSPORT_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "server.hpp"
+#include "string_view.hpp"
+#include "time.hpp"
+
+namespace network {
+
+class SharedSocket;
+
+/**
+ * \brief Counters for asynchronous reads
+ */
+struct ReceiveStatistics
+{
+    uint64_t    wakeups = 0;        ///< Number of times the socket has been drained
+    uint64_t    datagrams = 0;      ///< Number of datagrams received
+    uint64_t    kernel_drops = 0;   ///< Datagrams dropped by the kernel as the receive buffer was full
+    std::size_t buffer_size = 0;    ///< Receive buffer size as reported by the kernel
+
+    /**
+     * \brief Average number of datagrams received per wakeup
+     */
+    double average_batch() const
+    {
+        return wakeups ? double(datagrams) / wakeups : 0;
+    }
+};
+
+/**
+ * \brief Order in which queued datagrams are sent
+ */
+enum class SendPriority
+{
+    Interactive,    ///< Requested by the user, sent first
+    Background,     ///< Automatic traffic, sent when no interactive datagram is waiting
+};
+
+/**
+ * \brief What waits for datagrams on a dedicated socket
+ */
+enum class ReadMode
+{
+    Reactor,    ///< The reactor threads, callbacks are invoked from them
+    External,   ///< Another event loop, which calls Transport::read_available()
+};
+
+/**
+ * \brief Counters for the send queue
+ */
+struct SendStatistics
+{
+    uint64_t        sent = 0;       ///< Number of datagrams sent
+    uint64_t        delayed = 0;    ///< Number of datagrams which had to wait for the send rate
+    std::size_t     queued = 0;     ///< Number of datagrams currently waiting
+    Clock::duration delay{0};       ///< Time the oldest queued datagram has been waiting
+};
+
+/**
+ * \brief Datagram connection to a server
+ *
+ * Implemented by UdpIo for actual networking and by LoopbackTransport
+ * to run a connection in memory.
+ * Options which don't apply to a transport are ignored.
+ */
+class Transport
+{
+public:
+    using NativeHandle = boost::asio::ip::udp::socket::native_handle_type;
+
+    /**
+     * \brief Called when a network error arises
+     */
+    std::function<void(const std::string& message)> on_error;
+    /**
+     * \brief Called when an error will make it impossible to continue
+     *  processing the connection.
+     * \note Always called after a call to on_error
+     */
+    std::function<void()> on_failure;
+    /**
+     * \brief Called with a message about the connection which isn't an error
+     *  (eg: a replay reaching the end of the capture)
+     */
+    std::function<void(const std::string& message)> on_status;
+    /**
+     * \brief Called when the connection initiated by connect() is established
+     * \note Might be called from another thread (eg: a resolver thread)
+     */
+    std::function<void()> on_connect;
+    /**
+     * \brief Called after a successful asynchronous read
+     *
+     * Receives all the datagrams drained from the socket in a single wakeup,
+     * the views are only valid for the duration of the call.
+     * \p arrivals holds the time each datagram has been received by the
+     * kernel, or by the transport where kernel timestamps aren't supported.
+     */
+    std::function<void(const std::vector<StringView>& datagrams,
+                       const std::vector<WallTime>& arrivals)> on_async_receive;
+    /**
+     * \brief Called with ReadMode::External once the socket is open
+     *
+     * The event loop must call read_available() whenever \p handle
+     * becomes readable. Transports without a socket never call it.
+     * \note Might be called from a resolver thread
+     */
+    std::function<void(NativeHandle handle)> on_watch;
+    /**
+     * \brief Called with ReadMode::External before the socket is closed
+     *
+     * The event loop must stop watching the handle passed to on_watch.
+     */
+    std::function<void()> on_unwatch;
+
+    virtual ~Transport() {}
+
+    /**
+     * \brief Connects to the given server and starts reading asynchronously
+     *
+     * on_connect is called once the connection is established,
+     * on_error and on_failure if it can't be established.
+     * \returns \b false if already connected or connecting
+     */
+    virtual bool connect(const Server& server) = 0;
+
+    /**
+     * \brief Whether connect() is still in progress
+     */
+    virtual bool connecting() const = 0;
+
+    /**
+     * \brief Disconnects (if connected)
+     */
+    virtual void disconnect() = 0;
+
+    /**
+     * \brief Checks if the connection is established
+     */
+    virtual bool connected() const = 0;
+
+    /**
+     * \brief Queues \p datagram to be sent
+     * \returns \b false if not connected
+     */
+    virtual bool write(std::string datagram,
+                       SendPriority priority = SendPriority::Interactive) = 0;
+
+    /**
+     * \brief Maximum size of a datagram in bytes
+     */
+    virtual std::string::size_type max_datagram_size() const = 0;
+
+    /**
+     * \brief Endpoint datagrams are sent to
+     */
+    virtual Server remote_endpoint() const = 0;
+
+    /**
+     * \brief Local connection endpoint
+     */
+    virtual Server local_endpoint() const = 0;
+
+    /**
+     * \brief Counters for the received datagrams
+     */
+    virtual ReceiveStatistics receive_statistics() const = 0;
+
+    /**
+     * \brief Counters for the sent datagrams
+     */
+    virtual SendStatistics send_statistics() const = 0;
+
+    /**
+     * \brief Sets the maximum number of datagrams passed to on_async_receive at once
+     */
+    virtual void receive_batch_size(std::size_t size) {}
+
+    /**
+     * \brief Sets the socket receive buffer size and the limit it grows to
+     */
+    virtual void receive_buffer_size(std::size_t initial, std::size_t maximum) {}
+
+    /**
+     * \brief Uses \p socket instead of opening a dedicated one
+     */
+    virtual void shared_socket(SharedSocket* socket) {}
+
+    /**
+     * \brief Selects what waits for datagrams
+     */
+    virtual void read_mode(ReadMode mode) {}
+
+    /**
+     * \brief Reads the available datagrams, with ReadMode::External
+     */
+    virtual void read_available() {}
+
+    /**
+     * \brief Limits the rate datagrams are sent at
+     * \param rate  Datagrams per second, 0 to send as fast as possible
+     * \param burst Number of datagrams which can be sent at once
+     */
+    virtual void send_rate(double rate, double burst) {}
+};
+
+} // namespace network
+#endif // NETWORK_TRANSPORT_HPP
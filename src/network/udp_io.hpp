@@ -24,44 +24,69 @@
 #ifndef UDP_IO_HPP
 #define UDP_IO_HPP
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include <boost/asio.hpp>
 
+#ifdef __linux__
+#   include <sys/socket.h>
+#endif
+
 #include "functional.hpp"
+#include "string_view.hpp"
+#include "reactor.hpp"
+#include "resolver.hpp"
 #include "server.hpp"
+#include "shared_socket.hpp"
+#include "socket_options.hpp"
+#include "timer.hpp"
+#include "token_bucket.hpp"
+#include "transport.hpp"
 
 namespace network {
 
 /**
  * \brief Class providing a simple interface for UDP connections
+ *
+ * Reads and writes are asynchronous and dispatched by a shared Reactor,
+ * so callbacks are invoked from one of the reactor threads.
+ * Host names are looked up asynchronously by a shared Resolver.
+ * The connection can have its own socket or use a SharedSocket.
  */
-class UdpIo
+class UdpIo : public Transport
 {
 public:
-    /**
-     * \brief Called when a network error arises
-     */
-    std::function<void(const std::string& message)> on_error;
-    /**
-     * \brief Called when an error will make it impossible to continue
-     *  processing the connection.
-     * \note Always called after a call to on_error
-     */
-    std::function<void()> on_failure;
-    /**
-     * \brief Called after a successful asynchronous read
-     */
-    std::function<void(const std::string& datagram)> on_async_receive;
+    explicit UdpIo(Reactor& reactor = Reactor::instance(),
+                   Resolver& resolver = Resolver::instance())
+        : reactor(reactor), resolver(resolver)
+    {
+        pacing_timer.on_timeout = [this]()
+        {
+            flush_send_queue();
+        };
+    }
 
-    UdpIo() = default;
     UdpIo(const UdpIo&) = delete;
     UdpIo(UdpIo&&) = delete;
     UdpIo& operator=(const UdpIo&) = delete;
     UdpIo& operator=(UdpIo&&) = delete;
 
+    ~UdpIo() override
+    {
+        disconnect();
+    }
+
     /**
      * \brief Maximum size of a datagram in bytes
      */
-    std::string::size_type max_datagram_size() const
+    std::string::size_type max_datagram_size() const override
     {
         return max_bytes;
     }
@@ -71,111 +96,300 @@ public:
      */
     void max_datagram_size(std::string::size_type size)
     {
+        Lock lock(mutex);
         max_bytes = size;
     }
 
     /**
-     * \brief Connects to the given server
-     * \returns \b true on success
+     * \brief Maximum number of datagrams drained from the socket per wakeup
      */
-    bool connect(const Server& server)
+    std::size_t receive_batch_size() const
     {
-        try {
-            boost::asio::ip::udp::resolver::query query(
-                server.host, std::to_string(server.port));
-            boost::asio::ip::udp::endpoint endpoint = *resolver.resolve(query);
-            socket.connect(endpoint);
-            if ( io_service.stopped() )
-                io_service.reset();
-            return true;
-        } catch ( const boost::system::system_error& err ) {
-            callback(on_error,err.what());
-            callback(on_failure);
+        return batch_size;
+    }
+
+    /**
+     * \brief Sets the maximum number of datagrams drained per wakeup
+     *
+     * Takes effect on the next read.
+     */
+    void receive_batch_size(std::size_t size) override
+    {
+        Lock lock(mutex);
+        batch_size = std::max<std::size_t>(size, 1);
+    }
+
+    /**
+     * \brief Sets the receive buffer size of the dedicated socket
+     *
+     * The buffer doubles every time the kernel drops datagrams,
+     * up to \p maximum.
+     * Takes effect on the next connect().
+     * \param initial Size in bytes, 0 for the system default
+     * \param maximum Size in bytes, 0 to never grow
+     */
+    void receive_buffer_size(std::size_t initial, std::size_t maximum) override
+    {
+        Lock lock(mutex);
+        buffer_sizer.configure(initial, maximum);
+    }
+
+    /**
+     * \brief What waits for datagrams on the dedicated socket
+     */
+    ReadMode read_mode() const
+    {
+        Lock lock(mutex);
+        return requested_mode;
+    }
+
+    /**
+     * \brief Selects what waits for datagrams on the dedicated socket
+     *
+     * Takes effect on the next connect(), connections using a SharedSocket
+     * are always read by the shared socket.
+     */
+    void read_mode(ReadMode mode) override
+    {
+        Lock lock(mutex);
+        requested_mode = mode;
+    }
+
+    /**
+     * \brief Reads the available datagrams, with ReadMode::External
+     *
+     * Callbacks are invoked from the calling thread.
+     */
+    void read_available() override
+    {
+        Lock lock(mutex);
+        if ( active_mode != ReadMode::External || !socket.is_open() || reading )
+            return;
+        reading = true;
+        lock.unlock();
+        on_readable(boost::system::error_code());
+    }
+
+    /**
+     * \brief Socket used instead of a dedicated one, null if there is none
+     */
+    SharedSocket* shared_socket() const
+    {
+        Lock lock(mutex);
+        return shared;
+    }
+
+    /**
+     * \brief Uses \p socket instead of opening a dedicated one
+     *
+     * Takes effect on the next connect(), null selects a dedicated socket.
+     */
+    void shared_socket(SharedSocket* socket) override
+    {
+        Lock lock(mutex);
+        shared = socket;
+    }
+
+    /**
+     * \brief Returns a snapshot of the asynchronous read counters
+     */
+    ReceiveStatistics receive_statistics() const override
+    {
+        ReceiveStatistics stats;
+        stats.wakeups = stat_wakeups;
+        stats.datagrams = stat_datagrams;
+        stats.kernel_drops = kernel_drops.total();
+        Lock lock(mutex);
+        if ( !attached )
+            stats.buffer_size = buffer_sizer.size();
+        return stats;
+    }
+
+    /**
+     * \brief Connects to the given server and starts reading asynchronously
+     *
+     * Returns without waiting for the host name to be resolved,
+     * on_connect is called once the connection is established,
+     * on_error and on_failure if it can't be established.
+     * \returns \b false if already connected or connecting
+     */
+    bool connect(const Server& server) override
+    {
+        Lock lock(mutex);
+        if ( is_open() || lookup )
             return false;
-        }
+        auto pending = std::make_shared<Lookup>(this);
+        lookup = pending;
+        lock.unlock();
+
+        resolver.resolve(server,
+            [pending](const boost::system::error_code& error,
+                      const Resolver::Endpoint& endpoint)
+            {
+                std::lock_guard<std::recursive_mutex> guard(pending->mutex);
+                if ( pending->io )
+                    pending->io->on_resolved(error, endpoint);
+            });
+        return true;
+    }
+
+    /**
+     * \brief Whether connect() is waiting for the host name to be resolved
+     */
+    bool connecting() const override
+    {
+        Lock lock(mutex);
+        return bool(lookup);
     }
 
     /**
      * \brief Disconnects (if connected)
+     *
+     * Cancels pending connection attempts and waits for the pending read to
+     * be cancelled, unless called from within one of the callbacks.
      */
-    void disconnect()
+    void disconnect() override
     {
-        if ( connected() )
+        pacing_timer.cancel();
+
+        std::shared_ptr<Lookup> pending;
+        Lock lock(mutex);
+        pending.swap(lookup);
+        // Commands issued right before disconnecting (eg: detaching the log)
+        // must not be lost, bulk traffic can be
+        for ( const auto& datagram : send_queues[int(SendPriority::Interactive)] )
+        {
+            boost::system::error_code error;
+            send_now(datagram.data, error);
+        }
+        for ( auto& queue : send_queues )
+            queue.clear();
+        lock.unlock();
+        if ( pending )
         {
-            boost::system::error_code ec;
-            socket.close(ec);
-            if ( ec )
-                callback(on_error,ec.message());
-            io_service.stop();
+            std::lock_guard<std::recursive_mutex> guard(pending->mutex);
+            pending->io = nullptr;
         }
+
+        lock.lock();
+        if ( attached )
+        {
+            SharedSocket* detaching = attached;
+            attached = nullptr;
+            lock.unlock();
+            detaching->detach(shared_remote);
+            return;
+        }
+
+        if ( watched )
+        {
+            watched = false;
+            lock.unlock();
+            callback(on_unwatch);
+            lock.lock();
+        }
+
+        if ( !socket.is_open() )
+            return;
+
+        boost::system::error_code ec;
+        socket.close(ec);
+
+        if ( handler_thread != std::this_thread::get_id() )
+            read_done.wait(lock, [this]{ return !reading; });
+
+        lock.unlock();
+        if ( ec )
+            callback(on_error,ec.message());
     }
 
     /**
      * \brief Checks if the socket is connected
      */
-    bool connected() const
+    bool connected() const override
     {
-        return socket.is_open();
+        Lock lock(mutex);
+        return is_open();
     }
 
     /**
-     * \brief Synchronous write
+     * \brief Asynchronous write
      *
-     * Writes \c datagram to the udp socket
-     * \returns \b true on success
+     * Queues \c datagram to be sent from a reactor thread as soon as
+     * the send rate allows it. Interactive datagrams are sent before any
+     * background one, datagrams with the same priority are sent in order.
+     * Send errors are reported through on_error.
+     * While connect() is resolving the host name, datagrams are queued and
+     * sent once connected.
+     * \returns \b false if the socket isn't connected nor connecting
      * \todo maybe truncate to \c max_bytes
      */
-    bool write(std::string datagram)
+    bool write(std::string datagram, SendPriority priority = SendPriority::Interactive) override
     {
-        try {
-            socket.send(boost::asio::buffer(datagram));
-            return true;
-        } catch ( const boost::system::system_error& err ) {
-            callback(on_error,err.what());
+        Lock lock(mutex);
+        if ( !is_open() && !lookup )
+        {
+            lock.unlock();
+            callback(on_error, boost::system::error_code(
+                boost::asio::error::not_connected).message());
             return false;
         }
+
+        auto now = Clock::now();
+        auto delay = send_bucket.delay(now);
+        if ( delay > Clock::duration::zero() )
+            stat_delayed++;
+        send_queues[int(priority)].push_back({std::move(datagram), now});
+        bool open = is_open();
+        lock.unlock();
+
+        // Otherwise on_resolved() flushes the queue
+        if ( open )
+            pacing_timer.start_before(delay);
+        return true;
     }
 
     /**
-     * \brief Synchronous read
-     *
-     * Reads a datagram (max \c max_bytes) and returns it as a string
+     * \brief Limits the rate datagrams are sent at
+     * \param rate  Datagrams per second, 0 to send as fast as possible
+     * \param burst Number of datagrams which can be sent at once
+     *               after the connection has been idle
      */
-    std::string read ()
+    void send_rate(double rate, double burst) override
     {
-        try {
-            std::string datagram;
-            datagram.resize(max_bytes);
-            auto len = socket.receive(boost::asio::mutable_buffers_1(&datagram[0], max_bytes));
-            datagram.resize(len);
-            return datagram;
-        } catch ( const boost::system::system_error& err ) {
-            callback(on_error,err.what());
-            return {};
-        }
+        Lock lock(mutex);
+        send_bucket.configure(rate, burst);
+        bool queued = queued_datagrams() > 0;
+        lock.unlock();
+        if ( queued )
+            pacing_timer.start(Clock::duration::zero());
     }
 
     /**
-     * \brief Blocks while connected and handles asynchronous reads
+     * \brief Counters for the sent datagrams
      */
-    void run_input()
+    SendStatistics send_statistics() const override
     {
-        schedule_read();
-        boost::system::error_code err;
-        io_service.run(err);
-        if ( err )
-        {
-            callback(on_error,err.message());
-            callback(on_failure);
-        }
+        SendStatistics stats;
+        Lock lock(mutex);
+        stats.sent = stat_sent;
+        stats.delayed = stat_delayed;
+        stats.queued = queued_datagrams();
+        for ( const auto& queue : send_queues )
+            if ( !queue.empty() )
+                stats.delay = std::max(stats.delay, Clock::now() - queue.front().queued);
+        return stats;
     }
 
     /**
      * \brief Endpoint used to send datagram to
      */
-    network::Server remote_endpoint() const
+    network::Server remote_endpoint() const override
     {
         if ( !connected() ) return {};
+        Lock lock(mutex);
+        if ( attached )
+            return network::Server{shared_remote.address().to_string(), shared_remote.port()};
         boost::system::error_code err;
         auto ep = socket.remote_endpoint(err);
         return err ? network::Server() : network::Server{ep.address().to_string(), ep.port()};
@@ -184,45 +398,325 @@ public:
     /**
      * \brief Local connection endpoint
      */
-    network::Server local_endpoint() const
+    network::Server local_endpoint() const override
     {
         if ( !connected() ) return {};
+        Lock lock(mutex);
+        if ( attached )
+            return network::Server{shared_local.address().to_string(), shared_local.port()};
         boost::system::error_code err;
         auto ep = socket.local_endpoint(err);
         return err ? network::Server() : network::Server{ep.address().to_string(), ep.port()};
     }
 
 private:
-    boost::asio::io_service             io_service;             ///< IO service
-    boost::asio::ip::udp::resolver      resolver{io_service};   ///< Query resolver
-    boost::asio::ip::udp::socket        socket{io_service};     ///< Socket
+    using Lock = std::unique_lock<std::mutex>;
+
+    /**
+     * \brief Links a host name lookup to the object which requested it
+     */
+    struct Lookup
+    {
+        explicit Lookup(UdpIo* io) : io(io) {}
+        std::recursive_mutex    mutex;  ///< Held while handling the result
+        UdpIo*                  io;     ///< Null if the request has been cancelled
+    };
+
+    /**
+     * \brief Datagram waiting for the send rate
+     */
+    struct QueuedDatagram
+    {
+        std::string data;
+        Time        queued;     ///< Time it was passed to write()
+    };
+
+    Reactor&                            reactor;                ///< Event loop dispatching reads
+    Resolver&                           resolver;               ///< Host name resolver
+    boost::asio::ip::udp::socket        socket{reactor.io_service()};   ///< Socket
+    std::shared_ptr<Lookup>             lookup;                 ///< Pending host name lookup
     std::string::size_type              max_bytes = 1024;       ///< Max size of a datagram
-    std::string                         receive_buffer;         ///< Buffer for async reads
+    std::size_t                         batch_size = 1;         ///< Max datagrams per wakeup
+    std::size_t                         slot_count = 0;         ///< Number of datagrams fitting in \c receive_buffer
+    std::size_t                         slot_size = 0;          ///< Size of a single slot in \c receive_buffer
+    std::vector<char>                   receive_buffer;         ///< Buffer for async reads, one slot per datagram
+    std::vector<StringView>             batch;                  ///< Datagrams received in the current wakeup
+    std::vector<WallTime>               batch_times;            ///< Receive time of each datagram in \c batch
+#ifdef __linux__
+    std::vector<mmsghdr>                headers;                ///< recvmmsg() headers, one per slot
+    std::vector<iovec>                  iovecs;                 ///< recvmmsg() buffers, one per slot
+    std::vector<char>                   controls;               ///< recvmmsg() control buffers, one per slot
+#endif
+    ReceiveBufferSizer                  buffer_sizer;           ///< Grows the receive buffer when datagrams are dropped
+    DropCounter                         kernel_drops;           ///< See ReceiveStatistics
+    std::atomic<uint64_t>               stat_wakeups{0};        ///< See ReceiveStatistics
+    std::atomic<uint64_t>               stat_datagrams{0};      ///< See ReceiveStatistics
+    std::array<std::deque<QueuedDatagram>, 2> send_queues;      ///< Datagrams waiting to be sent, by SendPriority
+    TokenBucket                         send_bucket;            ///< Limits the send rate
+    Timer                               pacing_timer{reactor};  ///< Expires when the next queued datagram can be sent
+    ReadMode                            requested_mode = ReadMode::Reactor; ///< Read mode for the next connect()
+    ReadMode                            active_mode = ReadMode::Reactor;    ///< Read mode of the open socket
+    bool                                watched = false;        ///< Whether on_unwatch has to be called
+    SharedSocket*                       shared = nullptr;       ///< Socket to use on the next connect(), if any
+    SharedSocket*                       attached = nullptr;     ///< Shared socket in use by this connection
+    SharedSocket::Endpoint              shared_remote;          ///< Server endpoint when using \c attached
+    SharedSocket::Endpoint              shared_local;           ///< Local endpoint when using \c attached
+    uint64_t                            stat_sent = 0;          ///< See SendStatistics
+    uint64_t                            stat_delayed = 0;       ///< See SendStatistics
+    mutable std::mutex                  mutex;                  ///< Guards \c socket, \c lookup and the send queue
+    std::condition_variable             read_done;              ///< Notified when \c reading is cleared
+    bool                                reading = false;        ///< Whether a read handler is pending
+    std::thread::id                     handler_thread;         ///< Thread running the read handler
+
+    /**
+     * \brief Completes a connection once the host name has been resolved
+     */
+    void on_resolved(boost::system::error_code error,
+                     const Resolver::Endpoint& endpoint)
+    {
+        Lock lock(mutex);
+        lookup.reset();
+        if ( !error && shared )
+        {
+            shared_remote = endpoint;
+            if ( shared->attach(endpoint,
+                    [this](const std::vector<StringView>& datagrams,
+                           const std::vector<WallTime>& arrivals)
+                    { on_shared_receive(datagrams, arrivals); },
+                    error) )
+            {
+                attached = shared;
+                shared_local = shared->local_endpoint(endpoint);
+            }
+        }
+        else if ( !error )
+        {
+            socket.connect(endpoint, error);
+            if ( !error )
+            {
+                buffer_sizer.apply(socket);
+                enable_drop_counter(socket);
+                enable_timestamps(socket);
+                kernel_drops.reset();
+            }
+        }
+
+        if ( error )
+        {
+            // Written while resolving, they can't be sent anywhere
+            for ( auto& queue : send_queues )
+                queue.clear();
+            lock.unlock();
+            callback(on_error,error.message());
+            callback(on_failure);
+            return;
+        }
+        active_mode = attached ? ReadMode::Reactor : requested_mode;
+        watched = active_mode == ReadMode::External;
+        if ( !attached && !watched )
+        {
+            reactor.start();
+            schedule_read();
+        }
+        bool watch = watched;
+        NativeHandle handle = socket.native_handle();
+        bool queued = queued_datagrams() > 0;
+        lock.unlock();
+        if ( watch )
+            callback(on_watch, handle);
+        callback(on_connect);
+        if ( queued )
+            pacing_timer.start(Clock::duration::zero());
+    }
+
+    /**
+     * \brief Whether there is a socket to send and receive from
+     * \pre \c mutex is locked
+     */
+    bool is_open() const
+    {
+        return attached || socket.is_open();
+    }
+
+    /**
+     * \brief Receives the datagrams routed by \c attached
+     */
+    void on_shared_receive(const std::vector<StringView>& datagrams,
+                           const std::vector<WallTime>& arrivals)
+    {
+        stat_wakeups++;
+        stat_datagrams += datagrams.size();
+        callback(on_async_receive, datagrams, arrivals);
+    }
 
     /**
      * \brief Schedules an asyncrhonous read
+     * \pre \c mutex is locked
      */
     void schedule_read()
     {
-        receive_buffer.resize(max_bytes);
-        socket.async_receive(
-            boost::asio::mutable_buffers_1(&receive_buffer[0], max_bytes),
-                [this](const boost::system::error_code& error, std::size_t nbytes)
-                { return on_receive(error,nbytes); });
+        reading = true;
+        socket.async_wait(boost::asio::ip::udp::socket::wait_read,
+            [this](const boost::system::error_code& error)
+            { return on_readable(error); });
+    }
+
+    /**
+     * \brief Preallocates the buffers used by receive_batch()
+     * \pre \c mutex is locked
+     */
+    void allocate_slots()
+    {
+        slot_count = batch_size;
+        slot_size = max_bytes;
+        receive_buffer.resize(slot_count * slot_size);
+        batch.reserve(slot_count);
+#ifdef __linux__
+        headers.assign(slot_count, mmsghdr());
+        iovecs.resize(slot_count);
+        for ( std::size_t i = 0; i < slot_count; i++ )
+        {
+            iovecs[i].iov_base = &receive_buffer[i * slot_size];
+            iovecs[i].iov_len = slot_size;
+            headers[i].msg_hdr.msg_iov = &iovecs[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
+#endif
+    }
+
+    /**
+     * \brief Reads into \c batch as many datagrams as they are available
+     *
+     * Reads up to \c slot_count datagrams without blocking,
+     * their receive times are stored in \c batch_times.
+     * \pre \c mutex is locked
+     */
+    void receive_batch(boost::system::error_code& error)
+    {
+        batch.clear();
+#ifdef __linux__
+        reset_control_buffers(headers, controls);
+        int count = ::recvmmsg(socket.native_handle(), headers.data(),
+                               slot_count, MSG_DONTWAIT, nullptr);
+        if ( count < 0 )
+        {
+            if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+                error.assign(errno, boost::system::system_category());
+            return;
+        }
+        for ( int i = 0; i < count; i++ )
+            batch.emplace_back(&receive_buffer[i * slot_size], headers[i].msg_len);
+        read_timestamps(headers, count, batch_times, WallClock::now());
+
+        uint32_t counter;
+        if ( read_drop_counter(headers, count, counter) && kernel_drops.update(counter) )
+            buffer_sizer.grow(socket);
+#else
+        // The first receive won't block as the socket is readable
+        while ( batch.size() < slot_count &&
+                ( batch.empty() || socket.available(error) ) )
+        {
+            char* slot = &receive_buffer[batch.size() * slot_size];
+            auto len = socket.receive(
+                boost::asio::mutable_buffers_1(slot, slot_size), 0, error);
+            if ( error )
+                break;
+            batch.emplace_back(slot, len);
+        }
+        batch_times.assign(batch.size(), WallClock::now());
+#endif
+    }
+
+    /**
+     * \brief Sends a datagram right away
+     * \pre \c mutex is locked
+     */
+    void send_now(const std::string& datagram, boost::system::error_code& error)
+    {
+        if ( attached )
+            attached->send_to(datagram, shared_remote, error);
+        else
+            socket.send(boost::asio::buffer(datagram), 0, error);
+        if ( !error )
+            stat_sent++;
     }
 
     /**
-     * \brief Async read callback
+     * \brief Number of datagrams waiting to be sent
+     * \pre \c mutex is locked
      */
-    void on_receive(const boost::system::error_code& error, std::size_t nbytes)
+    std::size_t queued_datagrams() const
     {
-        if (error)
+        std::size_t count = 0;
+        for ( const auto& queue : send_queues )
+            count += queue.size();
+        return count;
+    }
+
+    /**
+     * \brief Sends the queued datagrams allowed by the send rate
+     */
+    void flush_send_queue()
+    {
+        Lock lock(mutex);
+        auto now = Clock::now();
+        boost::system::error_code error;
+        for ( auto& queue : send_queues )
         {
+            while ( !queue.empty() && is_open() && send_bucket.consume(now) )
+            {
+                boost::system::error_code send_error;
+                send_now(queue.front().data, send_error);
+                if ( send_error )
+                    error = send_error;
+                queue.pop_front();
+            }
+        }
+        bool queued = queued_datagrams() > 0 && is_open();
+        auto delay = send_bucket.delay(now);
+        lock.unlock();
+
+        if ( queued )
+            pacing_timer.start(delay);
+        if ( error )
             callback(on_error,error.message());
+    }
+
+    /**
+     * \brief Async read callback, also used by read_available()
+     */
+    void on_readable(boost::system::error_code error)
+    {
+        Lock lock(mutex);
+        handler_thread = std::this_thread::get_id();
+        if ( slot_count != batch_size || slot_size != max_bytes )
+            allocate_slots();
+        if ( !error && socket.is_open() )
+            receive_batch(error);
+        lock.unlock();
+
+        if ( error )
+        {
+            if ( error != boost::asio::error::operation_aborted )
+                callback(on_error,error.message());
+        }
+        else if ( !batch.empty() )
+        {
+            stat_wakeups++;
+            stat_datagrams += batch.size();
+            callback(on_async_receive,batch,batch_times);
+        }
+
+        lock.lock();
+        handler_thread = std::thread::id();
+        if ( !error && socket.is_open() && active_mode == ReadMode::Reactor )
+        {
+            schedule_read();
             return;
         }
-        callback(on_async_receive,receive_buffer.substr(0,nbytes));
-        schedule_read();
+        reading = false;
+        lock.unlock();
+        read_done.notify_all();
     }
 
 };
@@ -0,0 +1,126 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef RING_BUFFER_HPP
+#define RING_BUFFER_HPP
+
+#include <atomic>
+#include <vector>
+
+/**
+ * \brief Bounded lock-free queue with a single producer and a single consumer
+ *
+ * Slots are preallocated and reused, so a producer assigning into a slot
+ * can reuse whatever memory the slot already owns.
+ * \tparam T Default constructible slot type
+ */
+template<class T>
+    class SpscRingBuffer
+{
+public:
+    /**
+     * \param capacity Maximum number of elements, rounded up to a power of 2
+     */
+    explicit SpscRingBuffer(std::size_t capacity)
+    {
+        std::size_t size = 2;
+        while ( size < capacity )
+            size *= 2;
+        elements.resize(size);
+        mask = size - 1;
+    }
+
+    SpscRingBuffer(const SpscRingBuffer&) = delete;
+    SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+    /**
+     * \brief Maximum number of elements
+     */
+    std::size_t capacity() const
+    {
+        return elements.size();
+    }
+
+    /**
+     * \brief Number of elements currently in the buffer
+     */
+    std::size_t size() const
+    {
+        return tail.load(std::memory_order_acquire) -
+               head.load(std::memory_order_acquire);
+    }
+
+    /**
+     * \brief Returns the slot to be filled by the producer
+     * \returns \b nullptr if the buffer is full
+     * \note Producer only, the slot is published by commit()
+     */
+    T* reserve()
+    {
+        auto back = tail.load(std::memory_order_relaxed);
+        if ( back - head.load(std::memory_order_acquire) == elements.size() )
+            return nullptr;
+        return &elements[back & mask];
+    }
+
+    /**
+     * \brief Publishes the slot returned by reserve()
+     * \note Producer only
+     */
+    void commit()
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_release);
+    }
+
+    /**
+     * \brief Returns the oldest element
+     * \returns \b nullptr if the buffer is empty
+     * \note Consumer only, the element is released by pop()
+     */
+    T* front()
+    {
+        auto front = head.load(std::memory_order_relaxed);
+        if ( front == tail.load(std::memory_order_acquire) )
+            return nullptr;
+        return &elements[front & mask];
+    }
+
+    /**
+     * \brief Releases the element returned by front()
+     * \note Consumer only
+     */
+    void pop()
+    {
+        head.store(head.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_release);
+    }
+
+private:
+    std::vector<T>              elements;   ///< Preallocated elements
+    std::size_t                 mask = 0;   ///< Maps positions to slot indices
+    std::atomic<std::size_t>    head{0};    ///< Next position to be consumed
+    std::atomic<std::size_t>    tail{0};    ///< Next position to be produced
+};
+
+#endif // RING_BUFFER_HPP
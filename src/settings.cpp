@@ -65,6 +65,7 @@ void Settings::load()
     console_brightness_min = qBound(0,settings.value("brightness_min",console_brightness_min).toInt(),255);
     console_font.fromString(settings.value("font",console_font.toString()).toString());
     console_max_history = settings.value("history",console_max_history).toInt();
+    console_timestamps = settings.value("timestamps",console_timestamps).toBool();
     console_expansion = cvar_expansion_from_string(settings.value("cvar",
                 cvar_expansion_to_string(console_expansion)).toString());
     if ( console_expansion == CvarExpansion::NotExpanded )
@@ -117,6 +118,35 @@ void Settings::load()
         settings.endArray();
     }
     settings.endGroup();
+
+    settings.beginGroup("network");
+    network_threads = qBound(1, settings.value("threads", network_threads).toInt(), 64);
+    network_receive_batch = qBound(1, settings.value("receive_batch", network_receive_batch).toInt(), 1024);
+    network_log_queue = qBound(64, settings.value("log_queue", network_log_queue).toInt(), 1<<20);
+    network_dns_cache = qMax(0, settings.value("dns_cache", network_dns_cache).toInt());
+    network_challenge_timeout = qMax(100, settings.value("challenge_timeout", network_challenge_timeout).toInt());
+    network_challenge_retries = qMax(0, settings.value("challenge_retries", network_challenge_retries).toInt());
+    network_challenge_pipeline = qBound(1, settings.value("challenge_pipeline", network_challenge_pipeline).toInt(), 64);
+    network_challenge_prefetch = qBound(0, settings.value("challenge_prefetch", network_challenge_prefetch).toInt(), 1);
+    network_challenge_lifetime = qMax(1, settings.value("challenge_lifetime", network_challenge_lifetime).toInt());
+    network_coalesce_window = qBound(0, settings.value("coalesce_window", network_coalesce_window).toInt(), 10000);
+    network_send_rate = qMax(0, settings.value("send_rate", network_send_rate).toInt());
+    network_send_burst = qMax(1, settings.value("send_burst", network_send_burst).toInt());
+    network_info_poll = qMax(0, settings.value("info_poll", network_info_poll).toInt());
+    network_shared_socket = settings.value("shared_socket", network_shared_socket).toBool();
+    network_shared_port = qBound(0, settings.value("shared_port", network_shared_port).toInt(), 65535);
+    network_shared_workers = qBound(0, settings.value("shared_workers", network_shared_workers).toInt(), 64);
+    network_receive_buffer = qBound(0, settings.value("receive_buffer", network_receive_buffer).toInt(), 1<<20);
+    network_receive_buffer_max = qBound(0, settings.value("receive_buffer_max", network_receive_buffer_max).toInt(), 1<<20);
+    network_gui_receive = settings.value("gui_receive", network_gui_receive).toBool();
+    settings.endGroup();
+
+    settings.beginGroup("discovery");
+    discovery_master = settings.value("master", discovery_master).toString();
+    discovery_addresses = settings.value("addresses", discovery_addresses).toString();
+    discovery_concurrency = qBound(1, settings.value("concurrency", discovery_concurrency).toInt(), 1024);
+    discovery_timeout = qBound(100, settings.value("timeout", discovery_timeout).toInt(), 60000);
+    settings.endGroup();
 }
 
 void Settings::save()
@@ -142,6 +172,7 @@ void Settings::save()
     settings.setValue("brightness_min",console_brightness_min);
     settings.setValue("font",console_font.toString());
     settings.setValue("history",console_max_history);
+    settings.setValue("timestamps",console_timestamps);
     settings.setValue("cvar",cvar_expansion_to_string(console_expansion));
     settings.setValue("attach_log",console_attach_command);
     settings.setValue("detach_log",console_detach_command);
@@ -173,6 +204,35 @@ void Settings::save()
     }
     settings.endArray();
     settings.endGroup();
+
+    settings.beginGroup("network");
+    settings.setValue("threads", network_threads);
+    settings.setValue("receive_batch", network_receive_batch);
+    settings.setValue("log_queue", network_log_queue);
+    settings.setValue("dns_cache", network_dns_cache);
+    settings.setValue("challenge_timeout", network_challenge_timeout);
+    settings.setValue("challenge_retries", network_challenge_retries);
+    settings.setValue("challenge_pipeline", network_challenge_pipeline);
+    settings.setValue("challenge_prefetch", network_challenge_prefetch);
+    settings.setValue("challenge_lifetime", network_challenge_lifetime);
+    settings.setValue("coalesce_window", network_coalesce_window);
+    settings.setValue("send_rate", network_send_rate);
+    settings.setValue("send_burst", network_send_burst);
+    settings.setValue("info_poll", network_info_poll);
+    settings.setValue("shared_socket", network_shared_socket);
+    settings.setValue("shared_port", network_shared_port);
+    settings.setValue("shared_workers", network_shared_workers);
+    settings.setValue("receive_buffer", network_receive_buffer);
+    settings.setValue("receive_buffer_max", network_receive_buffer_max);
+    settings.setValue("gui_receive", network_gui_receive);
+    settings.endGroup();
+
+    settings.beginGroup("discovery");
+    settings.setValue("master", discovery_master);
+    settings.setValue("addresses", discovery_addresses);
+    settings.setValue("concurrency", discovery_concurrency);
+    settings.setValue("timeout", discovery_timeout);
+    settings.endGroup();
 }
 
 QStringList Settings::get_history(const std::string& server) const
@@ -105,6 +105,7 @@ public:
     int    console_brightness_min{80};          ///< Minimum brightness for console colors
     QFont  console_font{"monospace", 10};       ///< Console text font
     int    console_max_history=128;             ///< Number of items in the console history
+    bool   console_timestamps{false};           ///< Whether the console shows when log lines have been received
     CvarExpansion console_expansion = CvarExpansion::ExpandOrWarn;
     QString console_attach_command = "qc_cmd_sv addtolist log_dest_udp $ip";
     QString console_detach_command = "qc_cmd_sv removefromlist log_dest_udp $ip";
@@ -131,6 +132,54 @@ public:
     /// Command used to change the map
     QString                     cmd_chmap = "chmap $map";
 
+    /// Number of threads handling network input for all the connections
+    int                         network_threads = 2;
+    /// Maximum number of datagrams read from a socket in one go
+    int                         network_receive_batch = 32;
+    /// Maximum number of log lines waiting to be shown in the console
+    int                         network_log_queue = 8192;
+    /// Number of seconds host name lookups are cached for
+    int                         network_dns_cache = 300;
+    /// Milliseconds to wait for a challenge before requesting it again
+    int                         network_challenge_timeout = 5000;
+    /// Number of times a challenge is requested again before giving up
+    int                         network_challenge_retries = 2;
+    /// Maximum number of challenges in flight for a connection
+    int                         network_challenge_pipeline = 1;
+    /// Whether a challenge is requested in advance for a connection (0 or 1)
+    int                         network_challenge_prefetch = 1;
+    /// Seconds after which a challenge requested in advance is discarded
+    int                         network_challenge_lifetime = 5;
+    /// Milliseconds rcon commands are held to be joined in fewer datagrams (0 to disable)
+    int                         network_coalesce_window = 0;
+    /// Maximum datagrams per second sent to a server (0 for no limit)
+    int                         network_send_rate = 0;
+    /// Datagrams which can be sent at once to an idle server
+    int                         network_send_burst = 10;
+    /// Seconds between connectionless status queries (0 to disable)
+    int                         network_info_poll = 0;
+    /// Whether all connections share a single socket
+    bool                        network_shared_socket = false;
+    /// Local port of the shared socket (0 for any)
+    int                         network_shared_port = 0;
+    /// Threads receiving on the shared socket (0 to use the reactor)
+    int                         network_shared_workers = 0;
+    /// Socket receive buffer in KiB (0 for the system default)
+    int                         network_receive_buffer = 0;
+    /// Limit in KiB the receive buffer grows to when datagrams are dropped
+    int                         network_receive_buffer_max = 4096;
+    /// Whether dedicated sockets are read from the GUI event loop
+    bool                        network_gui_receive = false;
+
+    /// Master server used to discover public servers
+    QString                     discovery_master = "dpmaster.deathmask.net:27950";
+    /// Address ranges queried to discover local servers, one per line
+    QString                     discovery_addresses = "192.168.1.1-254:26000";
+    /// Maximum number of discovery queries waiting for a response
+    int                         discovery_concurrency = 64;
+    /// Milliseconds to wait for a server to respond to a discovery query
+    int                         discovery_timeout = 2000;
+
 private:
     Settings();
 
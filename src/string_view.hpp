@@ -0,0 +1,123 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef STRING_VIEW_HPP
+#define STRING_VIEW_HPP
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+/**
+ * \brief Non-owning reference to a sequence of characters
+ *
+ * The referenced memory must outlive the view.
+ */
+class StringView
+{
+public:
+    using size_type = std::string::size_type;
+    using const_iterator = const char*;
+    static const size_type npos = std::string::npos;
+
+    StringView() = default;
+
+    StringView(const char* data, size_type size)
+        : data_(data), size_(size)
+    {}
+
+    StringView(const char* c_str)
+        : data_(c_str), size_(std::strlen(c_str))
+    {}
+
+    StringView(const std::string& string)
+        : data_(string.data()), size_(string.size())
+    {}
+
+    const char* data() const { return data_; }
+    size_type size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    const_iterator begin() const { return data_; }
+    const_iterator end() const { return data_ + size_; }
+
+    char operator[](size_type index) const { return data_[index]; }
+    char front() const { return data_[0]; }
+    char back() const { return data_[size_-1]; }
+
+    /**
+     * \brief Returns a view on a portion of this one
+     */
+    StringView substr(size_type pos, size_type count = npos) const
+    {
+        pos = std::min(pos, size_);
+        return StringView(data_ + pos, std::min(count, size_ - pos));
+    }
+
+    /**
+     * \brief Finds the first occurrence of \p c starting from \p pos
+     */
+    size_type find(char c, size_type pos = 0) const
+    {
+        if ( pos >= size_ )
+            return npos;
+        auto found = static_cast<const char*>(std::memchr(data_ + pos, c, size_ - pos));
+        return found ? found - data_ : npos;
+    }
+
+    /**
+     * \brief Whether the view begins with \p prefix
+     */
+    bool starts_with(StringView prefix) const
+    {
+        return prefix.size_ <= size_ &&
+            std::memcmp(data_, prefix.data_, prefix.size_) == 0;
+    }
+
+    void remove_prefix(size_type count) { data_ += count; size_ -= count; }
+    void remove_suffix(size_type count) { size_ -= count; }
+
+    /**
+     * \brief Copies the referenced characters into a string
+     */
+    std::string str() const
+    {
+        return std::string(data_, size_);
+    }
+
+    friend bool operator==(StringView a, StringView b)
+    {
+        return a.size_ == b.size_ && std::memcmp(a.data_, b.data_, a.size_) == 0;
+    }
+
+    friend bool operator!=(StringView a, StringView b)
+    {
+        return !(a == b);
+    }
+
+private:
+    const char* data_ = "";
+    size_type   size_ = 0;
+};
+
+#endif // STRING_VIEW_HPP
@@ -0,0 +1,111 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <cstdlib>
+#include <iostream>
+
+#include "benchmark.hpp"
+#include "xonotic/hmac_md4.hpp"
+
+struct HmacBenchOptions
+{
+    std::size_t messages = 200000;
+    std::size_t length = 64;        ///< Bytes in each message
+    unsigned    repeat = 5;
+};
+
+static void usage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+        "  --messages N     Messages signed in each run (200000)\n"
+        "  --length N       Bytes in each message (64)\n"
+        "  --repeat N       Runs, the fastest is reported (5)\n";
+}
+
+static bool parse_options(int argc, char** argv, HmacBenchOptions& options)
+{
+    for ( int i = 1; i < argc; i++ )
+    {
+        std::string option = argv[i];
+        if ( i + 1 >= argc || option.compare(0, 2, "--") != 0 )
+            return false;
+        std::size_t value = std::strtoul(argv[++i], nullptr, 10);
+
+        if ( option == "--messages" )
+            options.messages = value;
+        else if ( option == "--length" )
+            options.length = value;
+        else if ( option == "--repeat" )
+            options.repeat = value;
+        else
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    HmacBenchOptions options;
+    if ( !parse_options(argc, argv, options) )
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Shaped like challenged commands: challenge, space and command
+    std::vector<std::string> messages;
+    for ( std::size_t i = 0; i < options.messages; i++ )
+    {
+        std::string message = "abcdefghij" + std::to_string(i % 10) + " kick # " + std::to_string(i);
+        message.resize(std::max(options.length, message.size()), 'x');
+        messages.push_back(message);
+    }
+    const std::string password = "rcon password";
+
+    // As every command used to be signed: the key is padded and hashed each time
+    std::string rekeyed_last;
+    double rekeyed = best_of(options.repeat, [&]() {
+        for ( const auto& message : messages )
+            rekeyed_last = xonotic::HmacMd4Signer(password).sign(message);
+    });
+
+    xonotic::HmacMd4Signer signer(password);
+    std::string precomputed_last;
+    double precomputed = best_of(options.repeat, [&]() {
+        for ( const auto& message : messages )
+            precomputed_last = signer.sign(message);
+    });
+
+    std::vector<std::string> keys;
+    double batch = best_of(options.repeat, [&]() {
+        keys = signer.sign_batch(messages);
+    });
+
+    std::cout << messages.size() << " messages of " << messages.back().size() << " bytes\n";
+    report("re-keyed per message (before)", messages.size(), rekeyed, "signatures");
+    report("precomputed key (after)", messages.size(), precomputed, "signatures");
+    report("precomputed key, batch", messages.size(), batch, "signatures");
+
+    bool same = rekeyed_last == precomputed_last && !keys.empty() && keys.back() == precomputed_last;
+    return same ? 0 : 1;
+}
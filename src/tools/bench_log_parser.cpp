@@ -0,0 +1,143 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <cstdlib>
+#include <iostream>
+
+#include "benchmark.hpp"
+#include "regex_log_parser.hpp"
+#include "xonotic/fake_server.hpp"
+#include "xonotic/log_parser.hpp"
+
+/**
+ * \brief Generated log lines, as received between status updates
+ */
+static std::vector<std::string> log_lines(std::size_t lines)
+{
+    std::vector<std::string> sample;
+    sample.reserve(lines);
+    for ( std::size_t i = 0; i < lines; i++ )
+        sample.push_back(xonotic::fake_log_line(i));
+    return sample;
+}
+
+/**
+ * \brief Output of status and cvarlist on a fake server, repeated to \p lines lines
+ */
+static std::vector<std::string> status_lines(std::size_t lines, std::size_t players)
+{
+    xonotic::FakeServer server;
+    server.populate(players, 200);
+    server.set_cvar("log_dest_udp", "bench");
+
+    std::string text;
+    server.on_send = [&text](const std::string&, const std::string& datagram) {
+        text.append(datagram, 5, std::string::npos);
+    };
+    server.execute("status; cvarlist fake_cvar_1");
+    server.flush_log();
+
+    std::vector<std::string> output;
+    for ( std::string::size_type pos = 0, end; (end = text.find('\n', pos)) != std::string::npos; pos = end + 1 )
+        output.push_back(text.substr(pos, end - pos));
+
+    std::vector<std::string> sample;
+    sample.reserve(lines);
+    while ( sample.size() < lines )
+        sample.insert(sample.end(), output.begin(),
+            output.begin() + std::min(output.size(), lines - sample.size()));
+    return sample;
+}
+
+/**
+ * \brief Runs \p sample through the regular expressions and the grammar,
+ *  each one starting from the raw UTF-8 line
+ */
+static void compare(const std::string& name, const std::vector<std::string>& sample, unsigned repeat)
+{
+    double regex = best_of(repeat, [&sample]() {
+        RegexLogParser parser;
+        parser.record = false;
+        for ( const auto& line : sample )
+            parser.parse(QString::fromUtf8(line.data(), line.size()));
+    });
+
+    double grammar = best_of(repeat, [&sample]() {
+        xonotic::LogParser parser;
+        for ( const auto& line : sample )
+            parser.parse(line);
+    });
+
+    report(name + ", regex (before)", sample.size(), regex, "lines");
+    report(name + ", grammar (after)", sample.size(), grammar, "lines");
+}
+
+struct LogParserOptions
+{
+    std::size_t lines = 1000000;
+    std::size_t players = 32;
+    unsigned    repeat = 5;
+};
+
+static void usage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+        "  --lines N        Lines in each sample (1000000)\n"
+        "  --players N      Players listed by status (32)\n"
+        "  --repeat N       Runs, the fastest is reported (5)\n";
+}
+
+static bool parse_options(int argc, char** argv, LogParserOptions& options)
+{
+    for ( int i = 1; i < argc; i++ )
+    {
+        std::string option = argv[i];
+        if ( i + 1 >= argc || option.compare(0, 2, "--") != 0 )
+            return false;
+        std::size_t value = std::strtoul(argv[++i], nullptr, 10);
+
+        if ( option == "--lines" )
+            options.lines = value;
+        else if ( option == "--players" )
+            options.players = value;
+        else if ( option == "--repeat" )
+            options.repeat = value;
+        else
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    LogParserOptions options;
+    if ( !parse_options(argc, argv, options) )
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    compare("log lines", log_lines(options.lines), options.repeat);
+    compare("status and cvarlist", status_lines(options.lines, options.players), options.repeat);
+    return 0;
+}
@@ -0,0 +1,187 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+#include "benchmark.hpp"
+#include "network/loopback_transport.hpp"
+#include "xonotic/darkplaces.hpp"
+#include "xonotic/fake_server.hpp"
+
+/**
+ * \brief Log datagrams carrying \p lines generated log lines
+ *
+ * The text is cut every \p payload bytes regardless of line boundaries,
+ * as the server does, so lines span datagrams.
+ */
+static std::vector<std::string> log_datagrams(std::size_t lines, std::size_t payload)
+{
+    std::string text;
+    for ( std::size_t i = 0; i < lines; i++ )
+        text += xonotic::fake_log_line(i) + '\n';
+
+    std::vector<std::string> datagrams;
+    for ( std::size_t pos = 0; pos < text.size(); pos += payload )
+        datagrams.push_back("\xff\xff\xff\xffn" + text.substr(pos, payload));
+    return datagrams;
+}
+
+/**
+ * \brief Line splitting as Darkplaces::read() used to do it, for comparison
+ *
+ * Copies the datagram out of the receive buffer, drops the header with
+ * another copy and splits the joined text with an istringstream.
+ */
+class CopyingSplitter
+{
+public:
+    std::size_t lines = 0;
+
+    void read(const std::string& receive_buffer)
+    {
+        std::string datagram = receive_buffer.substr(0, receive_buffer.size());
+        std::istringstream socket_stream(line_buffer + datagram.substr(5));
+        line_buffer.clear();
+
+        std::string line;
+        while ( socket_stream )
+        {
+            std::getline(socket_stream, line);
+            if ( socket_stream.eof() )
+            {
+                if ( !line.empty() )
+                    line_buffer = line;
+                break;
+            }
+            lines++;
+        }
+    }
+
+private:
+    std::string line_buffer;
+};
+
+/**
+ * \brief Connection counting the log lines it receives
+ */
+class LineCounter : public xonotic::Darkplaces
+{
+public:
+    using Darkplaces::Darkplaces;
+
+    std::size_t lines = 0;
+
+protected:
+    void on_receive_log(StringView, network::WallTime) override
+    {
+        lines++;
+    }
+};
+
+struct LogSplitOptions
+{
+    std::size_t lines = 1000000;
+    std::size_t payload = 1400;
+    std::size_t batch = 32;
+    unsigned    repeat = 5;
+};
+
+static void usage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+        "  --lines N        Log lines in the sample (1000000)\n"
+        "  --payload N      Log bytes per datagram (1400)\n"
+        "  --batch N        Datagrams received in one go (32)\n"
+        "  --repeat N       Runs, the fastest is reported (5)\n";
+}
+
+static bool parse_options(int argc, char** argv, LogSplitOptions& options)
+{
+    for ( int i = 1; i < argc; i++ )
+    {
+        std::string option = argv[i];
+        if ( i + 1 >= argc || option.compare(0, 2, "--") != 0 )
+            return false;
+        std::size_t value = std::strtoul(argv[++i], nullptr, 10);
+
+        if ( option == "--lines" )
+            options.lines = value;
+        else if ( option == "--payload" )
+            options.payload = std::max<std::size_t>(1, value);
+        else if ( option == "--batch" )
+            options.batch = std::max<std::size_t>(1, value);
+        else if ( option == "--repeat" )
+            options.repeat = value;
+        else
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    LogSplitOptions options;
+    if ( !parse_options(argc, argv, options) )
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    std::size_t batch = options.batch;
+    unsigned repeat = options.repeat;
+
+    auto datagrams = log_datagrams(options.lines, options.payload);
+    std::cout << datagrams.size() << " datagrams, " << options.lines << " lines\n";
+
+    std::size_t copied_lines = 0;
+    double copied = best_of(repeat, [&]() {
+        CopyingSplitter splitter;
+        for ( const auto& datagram : datagrams )
+            splitter.read(datagram);
+        copied_lines = splitter.lines;
+    });
+
+    // Goes through the transport like datagrams from the network,
+    // deliver() copies each one as the receive buffer would
+    std::size_t viewed_lines = 0;
+    double viewed = best_of(repeat, [&]() {
+        auto loopback = new network::LoopbackTransport;
+        LineCounter connection({network::Server("loopback", 26000), "", xonotic::ConnectionDetails::NO},
+                               std::unique_ptr<network::Transport>(loopback));
+        connection.set_receive_batch_size(batch);
+        connection.connect();
+        for ( std::size_t i = 0; i < datagrams.size(); i++ )
+        {
+            loopback->deliver(datagrams[i]);
+            if ( i % batch == batch - 1 )
+                loopback->pump();
+        }
+        loopback->pump();
+        viewed_lines = connection.lines;
+    });
+
+    report("istringstream (before)", copied_lines, copied, "lines");
+    report("in-place views (after)", viewed_lines, viewed, "lines");
+    return copied_lines == viewed_lines ? 0 : 1;
+}
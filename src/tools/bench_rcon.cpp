@@ -0,0 +1,203 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include "benchmark.hpp"
+#include "udp_fake_server.hpp"
+#include "xonotic/darkplaces.hpp"
+
+struct RconBenchOptions
+{
+    std::size_t commands = 200;
+    int         latency = 5;            ///< Milliseconds the server holds each reply
+    uint16_t    port = 27400;
+    xonotic::ChallengePolicy policy;
+};
+
+/**
+ * \brief Connection counting its finished tracked commands
+ */
+class CommandCounter : public xonotic::Darkplaces
+{
+public:
+    using Darkplaces::Darkplaces;
+
+    /**
+     * \brief Waits until the connection has been established
+     */
+    bool wait_connected(std::chrono::seconds timeout)
+    {
+        Lock lock(mutex);
+        return condition.wait_for(lock, timeout, [this]{ return is_connected; });
+    }
+
+    /**
+     * \brief Waits until \p count commands have finished
+     * \returns The number of commands which have been completed
+     */
+    std::size_t wait_finished(std::size_t count, std::chrono::seconds timeout)
+    {
+        Lock lock(mutex);
+        condition.wait_for(lock, timeout, [this, count]{ return completed + failed >= count; });
+        return completed;
+    }
+
+protected:
+    void on_connect() override
+    {
+        Lock lock(mutex);
+        is_connected = true;
+        condition.notify_all();
+    }
+
+    void on_command_complete(const xonotic::CommandResult& result) override
+    {
+        Lock lock(mutex);
+        (result.completed ? completed : failed)++;
+        condition.notify_all();
+    }
+
+private:
+    using Lock = std::unique_lock<std::mutex>;
+
+    std::mutex              mutex;
+    std::condition_variable condition;
+    bool                    is_connected = false;
+    std::size_t             completed = 0;
+    std::size_t             failed = 0;
+};
+
+/**
+ * \brief Sends a burst of tracked commands to a fake server with \p rcon_secure
+ *  and reports how fast they complete
+ */
+static void run(const std::string& label, int rcon_secure, const RconBenchOptions& options)
+{
+    FakeServerOptions server_options;
+    server_options.port = options.port;
+    server_options.password = "password";
+    server_options.secure = rcon_secure;
+    server_options.cvars = 0;
+    server_options.log_rate = 0;
+    server_options.latency = options.latency;
+    server_options.report = 0;
+
+    boost::asio::io_service service;
+    UdpFakeServer server(service, server_options);
+    std::thread server_thread([&service]{ service.run(); });
+
+    auto secure = xonotic::ConnectionDetails::Secure(rcon_secure);
+    CommandCounter connection({network::Server("127.0.0.1", options.port), "password", secure});
+    connection.set_challenge_policy(options.policy);
+    connection.set_send_rate(0, 0);
+    connection.connect();
+
+    if ( connection.wait_connected(std::chrono::seconds(5)) )
+    {
+        std::size_t completed = 0;
+        double seconds = best_of(1, [&]() {
+            for ( std::size_t i = 0; i < options.commands; i++ )
+                connection.rcon_command_tracked("echo " + std::to_string(i));
+            completed = connection.wait_finished(options.commands, std::chrono::seconds(120));
+        });
+        report(label, completed, seconds, "commands");
+        if ( completed < options.commands )
+            std::cout << "  " << options.commands - completed << " commands failed\n";
+    }
+    else
+    {
+        std::cout << label << ": could not connect\n";
+    }
+
+    connection.disconnect();
+    service.stop();
+    server_thread.join();
+}
+
+static void usage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+        "  --commands N     Commands sent in a burst for each mode (200)\n"
+        "  --latency N      Milliseconds the server holds each reply (5)\n"
+        "  --port N         UDP port of the fake server (27400)\n"
+        "  --pipeline N     Challenges requested at the same time\n"
+        "  --prefetch N     Challenges requested in advance\n"
+        "  --timeout N      Milliseconds to wait for a challenge\n";
+}
+
+static bool parse_options(int argc, char** argv, RconBenchOptions& options)
+{
+    for ( int i = 1; i < argc; i++ )
+    {
+        std::string option = argv[i];
+        if ( i + 1 >= argc || option.compare(0, 2, "--") != 0 )
+            return false;
+        const char* value = argv[++i];
+
+        if ( option == "--commands" )
+            options.commands = std::strtoul(value, nullptr, 10);
+        else if ( option == "--latency" )
+            options.latency = std::atoi(value);
+        else if ( option == "--port" )
+            options.port = std::atoi(value);
+        else if ( option == "--pipeline" )
+            options.policy.pipeline = std::strtoul(value, nullptr, 10);
+        else if ( option == "--prefetch" )
+            options.policy.prefetch = std::strtoul(value, nullptr, 10);
+        else if ( option == "--timeout" )
+            options.policy.timeout = std::chrono::milliseconds(std::atoi(value));
+        else
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    RconBenchOptions options;
+    if ( !parse_options(argc, argv, options) )
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::cout << options.commands << " commands, " << options.latency << " ms server latency, "
+              << options.policy.pipeline << " challenges in flight, "
+              << options.policy.prefetch << " prefetched\n";
+    try
+    {
+        run("rcon", 0, options);
+        run("srcon TIME", 1, options);
+        run("srcon CHALLENGE", 2, options);
+    }
+    catch ( const std::exception& error )
+    {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
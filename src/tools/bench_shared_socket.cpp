@@ -0,0 +1,255 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "benchmark.hpp"
+#include "network/shared_socket.hpp"
+#include "xonotic/fake_server.hpp"
+#include "xonotic/log_grammar.hpp"
+
+struct SharedSocketBenchOptions
+{
+    std::size_t servers = 32;           ///< Sockets sending log datagrams
+    std::size_t senders = 2;            ///< Threads sending for them
+    std::size_t max_workers = std::max(1u, std::thread::hardware_concurrency());
+    double      duration = 3;           ///< Seconds each configuration is measured
+    uint16_t    port = 27300;
+};
+
+/**
+ * \brief Datagrams received for one server
+ */
+struct ServerCounter
+{
+    std::atomic<uint64_t> datagrams{0};
+    std::atomic<uint64_t> lines{0};
+};
+
+/**
+ * \brief Splits a log datagram and runs the log grammars on its lines,
+ *  the work the connection does before queueing them
+ */
+static uint64_t parse_datagram(StringView datagram)
+{
+    using namespace xonotic::log_grammar;
+    uint64_t lines = 0;
+    const char* begin = datagram.data() + std::min<std::size_t>(5, datagram.size());
+    const char* end = datagram.data() + datagram.size();
+    while ( begin < end )
+    {
+        auto newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+        if ( !newline )
+            newline = end;
+        std::size_t size = newline - begin;
+        CvarLine cvar;
+        Span host;
+        if ( !skip_default(begin, size) &&
+             !match_cvar(begin, size, cvar) )
+            match_status_begin(begin, size, host);
+        lines++;
+        begin = newline + 1;
+    }
+    return lines;
+}
+
+/**
+ * \brief Log datagrams made of whole generated lines
+ */
+static std::vector<std::string> log_datagrams(std::size_t count)
+{
+    std::vector<std::string> datagrams;
+    uint64_t line = 0;
+    for ( std::size_t i = 0; i < count; i++ )
+    {
+        std::string datagram = "\xff\xff\xff\xffn";
+        while ( true )
+        {
+            std::string text = xonotic::fake_log_line(line) + '\n';
+            if ( datagram.size() + text.size() > 1400 )
+                break;
+            datagram += text;
+            line++;
+        }
+        datagrams.push_back(datagram);
+    }
+    return datagrams;
+}
+
+/**
+ * \brief Floods a SharedSocket with \p workers from all the servers
+ *  and reports how many datagrams it gets through
+ *
+ * The senders run on the same machine, they need cores of their own
+ * for the receivers to scale.
+ */
+static void run(std::size_t workers, const SharedSocketBenchOptions& options,
+                const std::vector<std::string>& datagrams)
+{
+    using udp = boost::asio::ip::udp;
+
+    network::Reactor reactor;
+    network::SharedSocket shared(reactor);
+    shared.set_port(options.port);
+    shared.set_workers(workers);
+    shared.receive_batch_size(32);
+    shared.receive_buffer_size(4 << 20, 4 << 20);
+
+    boost::asio::io_service service;
+    std::vector<std::unique_ptr<udp::socket>> sockets;
+    std::unique_ptr<ServerCounter[]> counters(new ServerCounter[options.servers]);
+    for ( std::size_t i = 0; i < options.servers; i++ )
+    {
+        sockets.emplace_back(new udp::socket(service, udp::endpoint(
+            boost::asio::ip::address_v4::loopback(), 0)));
+        ServerCounter& counter = counters[i];
+        boost::system::error_code error;
+        shared.attach(sockets.back()->local_endpoint(),
+            [&counter](const std::vector<StringView>& received, const std::vector<network::WallTime>&) {
+                for ( const auto& datagram : received )
+                    counter.lines += parse_datagram(datagram);
+                counter.datagrams += received.size();
+            }, error);
+        if ( error )
+        {
+            std::cerr << "Could not open the shared socket: " << error.message() << std::endl;
+            return;
+        }
+    }
+
+    udp::endpoint target(boost::asio::ip::address_v4::loopback(), shared.port());
+    std::atomic<bool> sending{true};
+    std::atomic<uint64_t> sent{0};
+    std::vector<std::thread> senders;
+    for ( std::size_t thread = 0; thread < options.senders; thread++ )
+    {
+        senders.emplace_back([&, thread]() {
+            uint64_t count = 0;
+            for ( std::size_t round = 0; sending; round++ )
+            {
+                for ( std::size_t i = thread; i < sockets.size(); i += options.senders )
+                {
+                    boost::system::error_code error;
+                    sockets[i]->send_to(boost::asio::buffer(datagrams[(round + i) % datagrams.size()]),
+                                        target, 0, error);
+                    if ( !error )
+                        count++;
+                }
+            }
+            sent += count;
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(options.duration));
+    sending = false;
+    for ( auto& sender : senders )
+        sender.join();
+    // Lets the receivers drain what is still queued
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    uint64_t received = 0;
+    uint64_t lines = 0;
+    for ( std::size_t i = 0; i < options.servers; i++ )
+    {
+        received += counters[i].datagrams;
+        lines += counters[i].lines;
+    }
+
+    std::string label = workers ? std::to_string(workers) + " workers" : "reactor";
+    report(label, received, options.duration, "datagrams");
+    std::cout << "  " << uint64_t(lines / options.duration) << " lines/s, sent " << sent
+              << ", kernel drops " << shared.kernel_drops() << ", per socket:";
+    for ( auto count : shared.shard_datagrams() )
+        std::cout << ' ' << count;
+    std::cout << '\n';
+
+    for ( const auto& socket : sockets )
+        shared.detach(socket->local_endpoint());
+}
+
+static void usage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+        "  --servers N      Servers sending log datagrams (32)\n"
+        "  --senders N      Threads sending for them (2)\n"
+        "  --max-workers N  Runs with 1, 2, 4... workers up to N (number of cores)\n"
+        "  --duration N     Seconds each configuration is measured (3)\n"
+        "  --port N         UDP port of the shared socket (27300)\n";
+}
+
+static bool parse_options(int argc, char** argv, SharedSocketBenchOptions& options)
+{
+    for ( int i = 1; i < argc; i++ )
+    {
+        std::string option = argv[i];
+        if ( i + 1 >= argc || option.compare(0, 2, "--") != 0 )
+            return false;
+        const char* value = argv[++i];
+
+        if ( option == "--servers" )
+            options.servers = std::max<std::size_t>(1, std::strtoul(value, nullptr, 10));
+        else if ( option == "--senders" )
+            options.senders = std::max<std::size_t>(1, std::strtoul(value, nullptr, 10));
+        else if ( option == "--max-workers" )
+            options.max_workers = std::strtoul(value, nullptr, 10);
+        else if ( option == "--duration" )
+            options.duration = std::max(0.1, std::atof(value));
+        else if ( option == "--port" )
+            options.port = std::atoi(value);
+        else
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    SharedSocketBenchOptions options;
+    if ( !parse_options(argc, argv, options) )
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    auto datagrams = log_datagrams(64);
+    std::cout << options.servers << " servers, " << options.senders << " sending threads, "
+              << datagrams.front().size() << " byte datagrams\n";
+    try
+    {
+        run(0, options, datagrams);
+#ifdef __linux__
+        for ( std::size_t workers = 1; workers <= options.max_workers; workers *= 2 )
+            run(workers, options, datagrams);
+#endif
+    }
+    catch ( const std::exception& error )
+    {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
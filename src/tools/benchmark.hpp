@@ -0,0 +1,62 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef TOOLS_BENCHMARK_HPP
+#define TOOLS_BENCHMARK_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+/**
+ * \brief Runs \p function \p repeat times
+ * \returns The fastest run, in seconds
+ */
+template<class Function>
+    double best_of(unsigned repeat, const Function& function)
+    {
+        using Clock = std::chrono::steady_clock;
+        double best = 0;
+        for ( unsigned i = 0; i < std::max(repeat, 1u); i++ )
+        {
+            auto start = Clock::now();
+            function();
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            if ( i == 0 || seconds < best )
+                best = seconds;
+        }
+        return best;
+    }
+
+/**
+ * \brief Prints a throughput line, as "label: rate unit/s"
+ */
+inline void report(const std::string& label, double count, double seconds,
+                   const std::string& unit)
+{
+    std::printf("%-32s %14.0f %s/s  (%.0f in %.3f s)\n", (label + ":").c_str(),
+                seconds > 0 ? count / seconds : 0, unit.c_str(), count, seconds);
+}
+
+#endif // TOOLS_BENCHMARK_HPP
@@ -0,0 +1,104 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+#include "udp_fake_server.hpp"
+
+static void usage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+        "  --port N         UDP port to listen on (26000)\n"
+        "  --password TEXT  Rcon password (password)\n"
+        "  --secure N       rcon_secure: 0 any, 1 srcon only, 2 challenge only (0)\n"
+        "  --players N      Number of players listed by status (8)\n"
+        "  --cvars N        Number of generated cvars (1000)\n"
+        "  --log-rate N     Log lines per second sent to log_dest_udp (10)\n"
+        "  --loss N         Percentage of datagrams dropped in each direction (0)\n"
+        "  --latency N      Milliseconds before each reply is sent (0)\n"
+        "  --frame N        Milliseconds between log flushes (10)\n"
+        "  --report N       Seconds between statistics reports, 0 for none (5)\n";
+}
+
+static bool parse_options(int argc, char** argv, FakeServerOptions& options)
+{
+    for ( int i = 1; i < argc; i++ )
+    {
+        std::string option = argv[i];
+        if ( i + 1 >= argc || option.compare(0, 2, "--") != 0 )
+            return false;
+        const char* value = argv[++i];
+
+        if ( option == "--port" )
+            options.port = std::atoi(value);
+        else if ( option == "--password" )
+            options.password = value;
+        else if ( option == "--secure" )
+            options.secure = std::atoi(value);
+        else if ( option == "--players" )
+            options.players = std::strtoul(value, nullptr, 10);
+        else if ( option == "--cvars" )
+            options.cvars = std::strtoul(value, nullptr, 10);
+        else if ( option == "--log-rate" )
+            options.log_rate = std::atof(value);
+        else if ( option == "--loss" )
+            options.loss = std::atof(value) / 100;
+        else if ( option == "--latency" )
+            options.latency = std::atoi(value);
+        else if ( option == "--frame" )
+            options.frame = std::max(1, std::atoi(value));
+        else if ( option == "--report" )
+            options.report = std::atoi(value);
+        else
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    FakeServerOptions options;
+    if ( !parse_options(argc, argv, options) )
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try
+    {
+        boost::asio::io_service service;
+        UdpFakeServer server(service, options);
+        boost::asio::signal_set signals(service, SIGINT, SIGTERM);
+        signals.async_wait([&service](const boost::system::error_code&, int) { service.stop(); });
+        std::cout << "Listening on port " << options.port << std::endl;
+        service.run();
+    }
+    catch ( const std::exception& error )
+    {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
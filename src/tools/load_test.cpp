@@ -0,0 +1,491 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <QDateTime>
+#include <QFile>
+#include <QGuiApplication>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTimer>
+
+#include "network/latency_histogram.hpp"
+#include "network/reactor.hpp"
+#include "network/replay_transport.hpp"
+#include "network/shared_socket.hpp"
+#include "xonotic/color_parser.hpp"
+#include "xonotic/log_parser.hpp"
+#include "xonotic/qdarkplaces.hpp"
+#include "udp_fake_server.hpp"
+
+/**
+ * \brief Command line options
+ */
+struct LoadTestOptions
+{
+    int         servers = 4;
+    double      log_rate = 100;         ///< Log lines per second from each server
+    int         status_interval = 1000; ///< Milliseconds between status requests to each server
+    int         warmup = 3;             ///< Seconds before measuring
+    int         duration = 30;          ///< Seconds measured
+    std::size_t players = 16;
+    uint16_t    port = 27500;           ///< Port of the first server
+    int         threads = 2;            ///< Reactor threads
+    bool        shared = false;         ///< Whether to use the shared socket
+    bool        gui_receive = false;    ///< Whether sockets are read from the event loop
+    std::string output = "load_test.json";
+    std::string replay;                 ///< Capture replayed instead of running servers
+    double      speed = 0;              ///< Replay speed, 0 for as fast as possible
+};
+
+static void usage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+        "  --servers N          Number of fake servers (4)\n"
+        "  --log-rate N         Log lines per second from each server (100)\n"
+        "  --status-interval N  Milliseconds between status 1 requests (1000)\n"
+        "  --warmup N           Seconds before measuring (3)\n"
+        "  --duration N         Seconds measured (30)\n"
+        "  --players N          Players on each server (16)\n"
+        "  --port N             Port of the first server, the others follow (27500)\n"
+        "  --threads N          Network threads (2)\n"
+        "  --shared 0|1         Whether connections share one socket (0)\n"
+        "  --gui-receive 0|1    Whether sockets are read from the event loop instead of network threads (0)\n"
+        "  --output FILE        JSON file the results are written to (load_test.json)\n"
+        "  --replay FILE        Replay a capture on every connection instead of running servers\n"
+        "  --speed N            Replay speed, 0 for as fast as possible (0)\n";
+}
+
+static bool parse_options(int argc, char** argv, LoadTestOptions& options)
+{
+    for ( int i = 1; i < argc; i++ )
+    {
+        std::string option = argv[i];
+        if ( i + 1 >= argc || option.compare(0, 2, "--") != 0 )
+            return false;
+        const char* value = argv[++i];
+
+        if ( option == "--servers" )
+            options.servers = std::max(1, std::atoi(value));
+        else if ( option == "--log-rate" )
+            options.log_rate = std::atof(value);
+        else if ( option == "--status-interval" )
+            options.status_interval = std::max(1, std::atoi(value));
+        else if ( option == "--warmup" )
+            options.warmup = std::max(0, std::atoi(value));
+        else if ( option == "--duration" )
+            options.duration = std::max(1, std::atoi(value));
+        else if ( option == "--players" )
+            options.players = std::strtoul(value, nullptr, 10);
+        else if ( option == "--port" )
+            options.port = std::atoi(value);
+        else if ( option == "--threads" )
+            options.threads = std::max(1, std::atoi(value));
+        else if ( option == "--shared" )
+            options.shared = std::atoi(value);
+        else if ( option == "--gui-receive" )
+            options.gui_receive = std::atoi(value);
+        else if ( option == "--output" )
+            options.output = value;
+        else if ( option == "--replay" )
+            options.replay = value;
+        else if ( option == "--speed" )
+            options.speed = std::atof(value);
+        else
+            return false;
+    }
+    return true;
+}
+
+/**
+ * \brief Starts a fake server process for each connection
+ *
+ * Returns once all of them are listening.
+ * Must be called before any thread is started.
+ * \returns \b false if a server couldn't be started
+ */
+static bool start_servers(const LoadTestOptions& options, std::vector<pid_t>& children)
+{
+    // Each server writes a byte once it's listening
+    int ready[2];
+    if ( pipe(ready) != 0 )
+        return false;
+    // Otherwise the children would print it again
+    std::cout.flush();
+
+    for ( int i = 0; i < options.servers; i++ )
+    {
+        pid_t pid = fork();
+        if ( pid < 0 )
+            break;
+        if ( pid > 0 )
+        {
+            children.push_back(pid);
+            continue;
+        }
+
+        close(ready[0]);
+
+        FakeServerOptions server;
+        server.port = options.port + i;
+        server.players = options.players;
+        server.cvars = 0;
+        server.log_rate = options.log_rate;
+        server.report = 0;
+        try
+        {
+            boost::asio::io_service service;
+            UdpFakeServer fake(service, server);
+            char byte = 1;
+            if ( write(ready[1], &byte, 1) != 1 )
+                _exit(1);
+            close(ready[1]);
+            boost::asio::signal_set termination(service, SIGTERM);
+            termination.async_wait([&service](const boost::system::error_code&, int) { service.stop(); });
+            service.run();
+        }
+        catch ( const std::exception& error )
+        {
+            std::cerr << "Server on port " << server.port << ": " << error.what() << std::endl;
+            _exit(1);
+        }
+        _exit(0);
+    }
+
+    close(ready[1]);
+    std::size_t listening = 0;
+    char byte;
+    while ( listening < children.size() && read(ready[0], &byte, 1) == 1 )
+        listening++;
+    close(ready[0]);
+    return listening == std::size_t(options.servers);
+}
+
+static void stop_servers(const std::vector<pid_t>& children)
+{
+    for ( pid_t child : children )
+        kill(child, SIGTERM);
+    for ( pid_t child : children )
+        waitpid(child, nullptr, 0);
+}
+
+/**
+ * \brief Headless equivalent of ServerWidget
+ *
+ * Parses the log and renders it into a document the same way the console does.
+ */
+class Console
+{
+public:
+    Console(const LoadTestOptions& options, int index)
+        : connection(xonotic::ConnectionDetails(
+            network::Server("127.0.0.1", options.port + index), "password"),
+            8192, transport(options))
+    {
+        QObject::connect(&connection, &xonotic::QDarkplaces::log_available, &context,
+                         [this]() { consume_log(); });
+        QObject::connect(&connection, &xonotic::QDarkplaces::connected, &context,
+                         [this]() { attach_log(); });
+        if ( options.shared )
+            connection.set_shared_socket(&network::SharedSocket::instance());
+        connection.set_read_mode(options.gui_receive ? network::ReadMode::External
+                                                     : network::ReadMode::Reactor);
+        connection.xonotic_connect();
+    }
+
+    ~Console()
+    {
+        if ( connection.xonotic_connected() )
+            connection.rcon_command("qc_cmd_sv removefromlist log_dest_udp "+
+                                    connection.local_endpoint().name());
+        connection.xonotic_disconnect();
+    }
+
+    /**
+     * \brief Sends the status command, as the status poll does
+     */
+    void request_status()
+    {
+        auto issued = network::Clock::now();
+        status_requests++;
+        connection.rcon_command("status 1", [this, issued](const xonotic::CommandResult& result) {
+            if ( !result.completed )
+                return;
+            QStringList lines;
+            for ( const auto& line : result.output )
+            {
+                parser.parse(line);
+                lines.push_back(QString::fromUtf8(line.data(), line.size()));
+            }
+            render(lines);
+            status_latency.record(network::Clock::now() - issued);
+        }, network::SendPriority::Background);
+    }
+
+    /**
+     * \brief Clears the counters, to start measuring
+     */
+    void reset()
+    {
+        log_latency = {};
+        status_latency = {};
+        status_requests = 0;
+        rendered = 0;
+        dropped = connection.dropped_log_lines();
+        kernel_drops = connection.receive_statistics().kernel_drops;
+    }
+
+    network::LatencyHistogram   log_latency;    ///< From datagram arrival to the line being rendered
+    network::LatencyHistogram   status_latency; ///< From the status request to its output being rendered
+    uint64_t                    status_requests = 0;
+    uint64_t                    rendered = 0;   ///< Log lines rendered
+    uint64_t                    dropped = 0;    ///< Log lines dropped by the queue, at reset()
+    uint64_t                    kernel_drops = 0;///< Datagrams dropped by the kernel, at reset()
+    xonotic::QDarkplaces        connection;
+
+private:
+    static std::unique_ptr<network::Transport> transport(const LoadTestOptions& options)
+    {
+        if ( options.replay.empty() )
+            return nullptr;
+        return std::unique_ptr<network::Transport>(
+            new network::ReplayTransport(options.replay, options.speed));
+    }
+
+    void attach_log()
+    {
+        connection.rcon_command("qc_cmd_sv addtolist log_dest_udp "+
+                                connection.local_endpoint().name());
+    }
+
+    void consume_log()
+    {
+        QStringList lines;
+        std::vector<network::WallTime> arrivals;
+        connection.consume_log([this, &lines, &arrivals](const xonotic::LogLine& line) {
+            parser.parse(line.text);
+            lines.push_back(QString::fromUtf8(line.text.data(), line.text.size()));
+            arrivals.push_back(line.arrival);
+        });
+        if ( lines.isEmpty() )
+            return;
+
+        render(lines);
+        rendered += lines.size();
+        auto now = network::WallClock::now();
+        for ( auto arrival : arrivals )
+            log_latency.record(std::max(network::Clock::duration::zero(),
+                std::chrono::duration_cast<network::Clock::duration>(now - arrival)));
+    }
+
+    void render(const QStringList& lines)
+    {
+        QTextCursor cursor(&document);
+        cursor.movePosition(QTextCursor::End);
+        xonotic::ColorParserTextCursor(QColor(192, 192, 192), 80, 255).convert(lines, &cursor);
+    }
+
+    QObject                     context;    ///< Receives the signals from the connection
+    xonotic::LogParser          parser;
+    QTextDocument               document;   ///< Console contents
+};
+
+/**
+ * \brief CPU time used by this process, in seconds
+ */
+static double cpu_time(const rusage& usage, bool user)
+{
+    const timeval& time = user ? usage.ru_utime : usage.ru_stime;
+    return time.tv_sec + time.tv_usec / 1e6;
+}
+
+/**
+ * \brief Resident set size in KiB
+ */
+static long resident_kb()
+{
+    std::ifstream statm("/proc/self/statm");
+    long size = 0, resident = 0;
+    statm >> size >> resident;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static QJsonObject percentiles(const network::LatencyHistogram& histogram)
+{
+    auto micro = [](network::Clock::duration duration) {
+        return double(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+    };
+    QJsonObject object;
+    object["samples"] = double(histogram.count());
+    object["mean"] = micro(histogram.mean());
+    object["p50"] = micro(histogram.percentile(0.5));
+    object["p90"] = micro(histogram.percentile(0.9));
+    object["p99"] = micro(histogram.percentile(0.99));
+    object["max"] = micro(histogram.max());
+    return object;
+}
+
+int main(int argc, char** argv)
+{
+    LoadTestOptions options;
+    if ( !parse_options(argc, argv, options) )
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Forked before Qt and the reactor start their threads
+    std::vector<pid_t> servers;
+    if ( options.replay.empty() && !start_servers(options, servers) )
+    {
+        std::cerr << "Cannot start the servers" << std::endl;
+        stop_servers(servers);
+        return 1;
+    }
+
+    if ( qgetenv("QT_QPA_PLATFORM").isEmpty() )
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QGuiApplication app(argc, argv);
+
+    network::Reactor::instance().set_thread_count(options.threads);
+
+    std::vector<std::unique_ptr<Console>> consoles;
+    for ( int i = 0; i < options.servers; i++ )
+        consoles.emplace_back(new Console(options, i));
+
+    QTimer status_timer;
+    QObject::connect(&status_timer, &QTimer::timeout, [&consoles]() {
+        for ( auto& console : consoles )
+            console->request_status();
+    });
+    if ( options.replay.empty() )
+        status_timer.start(options.status_interval);
+
+    rusage usage_start;
+    network::Clock::time_point start;
+    QTimer::singleShot(options.warmup * 1000, [&]() {
+        for ( auto& console : consoles )
+            console->reset();
+        getrusage(RUSAGE_SELF, &usage_start);
+        start = network::Clock::now();
+    });
+
+    int status = 0;
+    QTimer::singleShot((options.warmup + options.duration) * 1000, [&]() {
+        rusage usage_end;
+        getrusage(RUSAGE_SELF, &usage_end);
+        double seconds = std::chrono::duration<double>(network::Clock::now() - start).count();
+
+        network::LatencyHistogram log_latency;
+        network::LatencyHistogram status_latency;
+        uint64_t rendered = 0, dropped = 0, kernel_drops = 0, status_requests = 0;
+        for ( auto& console : consoles )
+        {
+            log_latency.merge(console->log_latency);
+            status_latency.merge(console->status_latency);
+            rendered += console->rendered;
+            dropped += console->connection.dropped_log_lines() - console->dropped;
+            kernel_drops += console->connection.receive_statistics().kernel_drops - console->kernel_drops;
+            status_requests += console->status_requests;
+        }
+
+        QJsonObject log;
+        if ( options.replay.empty() )
+            log["expected"] = options.servers * options.log_rate * seconds;
+        log["rendered"] = double(rendered);
+        log["lines_per_second"] = rendered / seconds;
+        log["queue_drops"] = double(dropped);
+        log["kernel_drops"] = double(kernel_drops);
+        log["latency_us"] = percentiles(log_latency);
+
+        QJsonObject status_results;
+        status_results["requests"] = double(status_requests);
+        status_results["completed"] = double(status_latency.count());
+        status_results["latency_us"] = percentiles(status_latency);
+
+        double user = cpu_time(usage_end, true) - cpu_time(usage_start, true);
+        double system = cpu_time(usage_end, false) - cpu_time(usage_start, false);
+        QJsonObject cpu;
+        cpu["user_s"] = user;
+        cpu["system_s"] = system;
+        cpu["percent"] = 100 * (user + system) / seconds;
+
+        QJsonObject memory;
+        memory["rss_kb"] = double(resident_kb());
+        memory["peak_rss_kb"] = double(usage_end.ru_maxrss);
+
+        QJsonObject config;
+        config["servers"] = options.servers;
+        config["log_rate"] = options.log_rate;
+        config["status_interval_ms"] = options.status_interval;
+        config["players"] = int(options.players);
+        config["threads"] = options.threads;
+        config["shared_socket"] = options.shared;
+        config["gui_receive"] = options.gui_receive;
+        if ( !options.replay.empty() )
+        {
+            config["replay"] = QString::fromStdString(options.replay);
+            config["speed"] = options.speed;
+        }
+
+        QJsonObject results;
+        results["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+        results["config"] = config;
+        results["seconds"] = seconds;
+        results["log"] = log;
+        results["status"] = status_results;
+        results["cpu"] = cpu;
+        results["memory"] = memory;
+
+        QFile file(QString::fromStdString(options.output));
+        if ( file.open(QFile::WriteOnly) )
+        {
+            file.write(QJsonDocument(results).toJson());
+            std::cout << "Results written to " << options.output << std::endl;
+        }
+        else
+        {
+            std::cerr << "Cannot write " << options.output << std::endl;
+            status = 1;
+        }
+        app.quit();
+    });
+
+    app.exec();
+    consoles.clear();
+    stop_servers(servers);
+    return status;
+}
@@ -0,0 +1,314 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <iostream>
+#include <random>
+
+#include "regex_log_parser.hpp"
+#include "xonotic/fake_server.hpp"
+#include "xonotic/log_grammar.hpp"
+#include "xonotic/log_parser.hpp"
+
+/*
+ * Differential test for log_grammar.hpp and LogParser: every line is matched
+ * both by the grammar and by the regular expressions it replaced, which
+ * must agree on whether the line matches and on every capture.
+ * The same is done on whole streams with LogParser and RegexLogParser.
+ */
+
+using namespace xonotic;
+
+/**
+ * \brief Console output of \p commands on a fake server with \p players players
+ */
+static std::vector<QByteArray> server_output(const std::string& commands, std::size_t players)
+{
+    FakeServer server;
+    server.populate(players, 50, players);
+    server.set_cvar("log_dest_udp", "test");
+
+    QByteArray text;
+    server.on_send = [&text](const std::string&, const std::string& datagram) {
+        text += QByteArray(datagram.data() + 5, datagram.size() - 5);
+    };
+    server.execute(commands);
+    server.flush_log();
+
+    auto lines = text.split('\n');
+    lines.removeLast();
+    return std::vector<QByteArray>(lines.begin(), lines.end());
+}
+
+/**
+ * \brief Lines for the status, cvarlist and cvar queries, mixed with log lines
+ */
+static std::vector<QByteArray> sample_stream()
+{
+    std::vector<QByteArray> stream;
+    uint64_t log_line = 0;
+    for ( std::size_t players : {0, 1, 16} )
+    {
+        for ( const auto& line : server_output("status; cvarlist; cvarlist fake_cvar_1; "
+                "hostname; sv_maxclients; echo done; status", players) )
+        {
+            stream.push_back(line);
+            if ( stream.size() % 7 == 0 )
+            {
+                std::string log = fake_log_line(log_line++);
+                stream.push_back(QByteArray(log.data(), log.size()));
+            }
+        }
+    }
+    return stream;
+}
+
+/**
+ * \brief Hand-written lines for the edge cases of each grammar
+ */
+static std::vector<QByteArray> edge_cases()
+{
+    return {
+        "cvar ^3sv_cheats^7 is \"0\" [\"0\"] allow cheats",
+        "\"g_maplist\" is \"a b\" [\"x\"]",
+        "hostname is \"My Server\" [\"Xonotic\"]  desc",
+        "cvar ^3na\xc3\xafve^7 is \"\xc3\xa9\" [\"\"] \xc3\xbcn\xc3\xaf" "code \xf0\x9f\x98\x80",
+        "x is \"\" [\"\"]",
+        "4 cvar(s)",
+        "host:     My ^1Server",
+        "host:  ",
+        "host:\t\t\n",
+        "host: \n\n",
+        "host:  \t\n",
+        "players:  3 active (16 max)",
+        "players: 3 active (16 max)\n",
+        "players: 12 active (32 max) ",
+        "map:      dance",
+        "version:  Xonotic build",
+        "a: ",
+        "abc:def",
+        "^2IP                                             %pl ping  time   frags  no   name",
+        "^3127.0.0.1:26000                                  0   20  1:02:03    12  #1   ^7Player ^1One",
+        "^7botclient  0 0 0:00 -666 #12 ^7[BOT]x",
+        "^3a b c d e #1 ^7",
+        "^3a b c d e #x ^7n",
+        "^3a b c d e # 1 ^7n",
+        "^3Player^7: hello",
+        ":kill:frag:1:2:type=3:items=4:victimitems=5",
+        "",
+        " ",
+    };
+}
+
+/**
+ * \brief Applies a few random edits to \p line
+ *
+ * Edits are done on the UTF-16 text so multi-byte characters stay whole.
+ */
+static QByteArray mutate(const QByteArray& line, std::mt19937& random)
+{
+    static const QString alphabet = QString::fromUtf8(
+        " \t\n\r\v\f\"^[]()#:%37a0is\xc3\xa9\xc2\xa0\xc2\x85");
+
+    QString text = QString::fromUtf8(line);
+    int edits = random() % 3 + 1;
+    for ( int i = 0; i < edits; i++ )
+    {
+        int pos = random() % (text.size() + 1);
+        QChar ch = alphabet[int(random() % alphabet.size())];
+        switch ( random() % 3 )
+        {
+            case 0:
+                text.insert(pos, ch);
+                break;
+            case 1:
+                text.remove(pos, 1);
+                break;
+            default:
+                if ( pos < text.size() )
+                    text[pos] = ch;
+                break;
+        }
+    }
+    return text.toUtf8();
+}
+
+/**
+ * \brief Escapes line breaks and tabs for the failure messages
+ */
+static std::string printable(QString text)
+{
+    return text.replace('\n', "\\n").replace('\t', "\\t").replace('\r', "\\r").toStdString();
+}
+
+class LogGrammarTest
+{
+public:
+    std::size_t lines = 0;
+    std::size_t emitted = 0;
+    std::size_t failures = 0;
+
+    /**
+     * \brief Checks every grammar on \p line
+     */
+    void check_line(const QByteArray& line)
+    {
+        lines++;
+        const char* data = line.constData();
+        std::size_t size = line.size();
+        auto text = [&line](log_grammar::Span span) {
+            return QString::fromUtf8(line.constData() + span.begin, span.size);
+        };
+
+        log_grammar::CvarLine cvar;
+        bool matched = log_grammar::match_cvar(data, size, cvar);
+        compare("cvar", line, RegexLogParser::regex_cvar(), matched, !matched ? QStringList() :
+            QStringList{text(cvar.name), text(cvar.value), text(cvar.default_value), text(cvar.description)});
+
+        log_grammar::Span host;
+        matched = log_grammar::match_status_begin(data, size, host);
+        compare("status_begin", line, RegexLogParser::regex_status_begin(), matched,
+            !matched ? QStringList() : QStringList{text(host)});
+
+        log_grammar::PlayersLine players;
+        matched = log_grammar::match_players(data, size, players);
+        compare("players", line, RegexLogParser::regex_players(), matched, !matched ? QStringList() :
+            QStringList{text(players.summary), text(players.active)});
+
+        log_grammar::PropertyLine property;
+        matched = log_grammar::match_property(data, size, property);
+        compare("property", line, RegexLogParser::regex_property(), matched, !matched ? QStringList() :
+            QStringList{text(property.name), text(property.value)});
+
+        matched = log_grammar::match_player_header(data, size);
+        compare("player_header", line, RegexLogParser::regex_player_header(), matched, {});
+
+        log_grammar::PlayerLine player;
+        matched = log_grammar::match_player(data, size, player);
+        compare("player", line, RegexLogParser::regex_player(), matched, !matched ? QStringList() :
+            QStringList{text(player.ip), text(player.pl), text(player.ping), text(player.time),
+                        text(player.frags), text(player.no), text(player.name)});
+
+        // Lines skipped in the default state must not match what it looks for
+        QString utf16 = QString::fromUtf8(line);
+        if ( log_grammar::skip_default(data, size) &&
+             ( regex::match(utf16, RegexLogParser::regex_cvar()) ||
+               regex::match(utf16, RegexLogParser::regex_status_begin()) ) )
+            fail("skip_default", line, "skipped a line that matches");
+    }
+
+    /**
+     * \brief Runs LogParser and RegexLogParser on \p stream and compares their signals
+     */
+    void check_stream(const std::vector<QByteArray>& stream)
+    {
+        std::vector<QString> events;
+        LogParser parser;
+        QObject::connect(&parser, &LogParser::cvar, [&events](const Cvar& cvar) {
+            events.push_back(describe(cvar));
+        });
+        QObject::connect(&parser, &LogParser::server_property_changed,
+            [&events](const QString& name, const QString& value) {
+                events.push_back(describe(name, value));
+        });
+        QObject::connect(&parser, &LogParser::players_changed,
+            [&events](const std::vector<Player>& players) {
+                events.push_back(describe(players));
+        });
+        QObject::connect(&parser, &LogParser::cvarlist_begin, [&events]() {
+            events.push_back("cvarlist_begin");
+        });
+        QObject::connect(&parser, &LogParser::cvarlist_end, [&events]() {
+            events.push_back("cvarlist_end");
+        });
+
+        RegexLogParser reference;
+        for ( const auto& line : stream )
+        {
+            parser.parse(StringView(line.constData(), line.size()));
+            reference.parse(QString::fromUtf8(line));
+            if ( events != reference.events )
+            {
+                fail("LogParser", line, "signals differ from the regular expressions");
+                return;
+            }
+        }
+        emitted += events.size();
+    }
+
+private:
+    void compare(const char* grammar, const QByteArray& line, const regex::Regex& regex,
+                 bool matched, const QStringList& captures)
+    {
+        regex::Match match;
+        bool expected = regex::match(QString::fromUtf8(line), regex, match);
+        QStringList expected_captures;
+        if ( expected )
+            for ( int i = 1; i <= regex.captureCount(); i++ )
+                expected_captures << match.captured(i);
+
+        if ( matched != expected )
+            fail(grammar, line, expected ? "should match" : "shouldn't match");
+        else if ( captures != expected_captures )
+            fail(grammar, line, "captured \"" + printable(captures.join("\" \"")) +
+                "\" instead of \"" + printable(expected_captures.join("\" \"")) + '"');
+    }
+
+    void fail(const char* grammar, const QByteArray& line, const std::string& message)
+    {
+        // The first few are enough to see what is wrong
+        if ( failures++ < 20 )
+            std::cerr << grammar << ": \"" << printable(QString::fromUtf8(line)) << "\" "
+                      << message << '\n';
+    }
+};
+
+int main()
+{
+    LogGrammarTest test;
+    std::mt19937 random(24);
+
+    auto stream = sample_stream();
+    auto cases = edge_cases();
+    cases.insert(cases.end(), stream.begin(), stream.end());
+
+    for ( const auto& line : cases )
+        test.check_line(line);
+    for ( int i = 0; i < 100000; i++ )
+        test.check_line(mutate(cases[random() % cases.size()], random));
+    for ( int i = 0; i < 10000; i++ )
+        test.check_line(mutate("", random));
+
+    test.check_stream(stream);
+    for ( int i = 0; i < 50; i++ )
+    {
+        auto mutated = stream;
+        for ( auto& line : mutated )
+            if ( random() % 8 == 0 )
+                line = mutate(line, random);
+        test.check_stream(mutated);
+    }
+
+    std::cout << test.lines << " lines, " << test.emitted << " signals, "
+              << test.failures << " mismatches\n";
+    return test.failures ? 1 : 0;
+}
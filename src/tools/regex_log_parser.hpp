@@ -0,0 +1,245 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef TOOLS_REGEX_LOG_PARSER_HPP
+#define TOOLS_REGEX_LOG_PARSER_HPP
+
+#include <vector>
+
+#include <QStringList>
+
+#include "regex.hpp"
+#include "xonotic/cvar.hpp"
+#include "xonotic/player.hpp"
+
+/**
+ * \brief Text for a cvar signal, used to compare the parsers
+ */
+inline QString describe(const xonotic::Cvar& cvar)
+{
+    return "cvar " + QStringList{cvar.name, cvar.value, cvar.default_value,
+                                 cvar.description}.join('|');
+}
+
+/**
+ * \brief Text for a players_changed signal, used to compare the parsers
+ */
+inline QString describe(const std::vector<xonotic::Player>& players)
+{
+    QStringList rows{"players"};
+    for ( const auto& player : players )
+        rows << QStringList{player.ip, player.pl, player.ping, player.time,
+                            player.frags, player.no, player.name}.join('|');
+    return rows.join('\n');
+}
+
+/**
+ * \brief Text for a server_property_changed signal, used to compare the parsers
+ */
+inline QString describe(const QString& name, const QString& value)
+{
+    return "property " + name + '|' + value;
+}
+
+/**
+ * \brief xonotic::LogParser as it was before log_grammar.hpp
+ *
+ * Matches the same states with the regular expressions the grammar
+ * replaced and records the signals LogParser would emit with describe().
+ * It is the reference for the differential test and the baseline
+ * of the log parser benchmark.
+ */
+class RegexLogParser
+{
+public:
+    static const regex::Regex& regex_cvar()
+    {
+        static regex::Regex regex = regex::optimized(
+            R"regex(^(?:cvar \^3|")?([^"^ ]+)(?:"|\^7)? is "([^"]*)" \["([^"]*)"\]\s*(.*)$)regex");
+        return regex;
+    }
+
+    static const regex::Regex& regex_status_begin()
+    {
+        static regex::Regex regex = regex::optimized("^host:\\s+(.+)$");
+        return regex;
+    }
+
+    static const regex::Regex& regex_players()
+    {
+        static regex::Regex regex = regex::optimized(
+            R"(^players:\s+((\d+) active \(\d+ max\))$)");
+        return regex;
+    }
+
+    static const regex::Regex& regex_property()
+    {
+        static regex::Regex regex = regex::optimized("^([a-z]+):\\s+(.*)$");
+        return regex;
+    }
+
+    static const regex::Regex& regex_player_header()
+    {
+        static regex::Regex regex = regex::optimized(
+            "^\\^[0-9]IP\\s+%pl\\s+ping\\s+time\\s+frags\\s+no\\s+name$");
+        return regex;
+    }
+
+    static const regex::Regex& regex_player()
+    {
+        static regex::Regex regex = regex::optimized(
+            // rowcol IP      %pl     ping    time   frags     no           name
+            R"(^\^[37](\S+)\s+(\S+)\s+(\S+)\s+(\S+)\s+(\S+)\s+#([0-9]+)\s+\^7(.*)$)"
+        );
+        return regex;
+    }
+
+    /**
+     * \brief Whether to fill events, the benchmark only wants the matching
+     */
+    bool record = true;
+
+    /**
+     * \brief Description of each signal emitted so far
+     */
+    std::vector<QString> events;
+
+    void parse(const QString& line)
+    {
+        if ( listening == DEFAULT )
+        {
+            regex::Match match;
+            if ( regex::match(line, regex_cvar(), match) )
+            {
+                if ( !cvarlist && match.capturedLength(4) )
+                {
+                    cvarlist = true;
+                    event("cvarlist_begin");
+                }
+                xonotic::Cvar cvar{match.captured(1), match.captured(2),
+                                   match.captured(3), match.captured(4)};
+                if ( record )
+                    event(describe(cvar));
+                return;
+            }
+            else if ( cvarlist )
+            {
+                cvarlist = false;
+                event("cvarlist_end");
+            }
+
+            if ( regex::match(line, regex_status_begin(), match) )
+            {
+                listening = STATUS;
+                property("host", match.captured(1));
+            }
+        }
+        else if ( listening == STATUS )
+        {
+            parse_status(line);
+        }
+        else if ( listening == STATUS_PLAYERS )
+        {
+            parse_player(line);
+        }
+    }
+
+private:
+    enum {
+        DEFAULT           = 0x00,
+        STATUS            = 0x01,
+        STATUS_PLAYERS    = 0x02|STATUS,
+    } listening = DEFAULT;
+    std::vector<xonotic::Player> players;
+    unsigned players_active = 0;
+    bool cvarlist = false;
+
+    void event(const QString& description)
+    {
+        if ( record )
+            events.push_back(description);
+    }
+
+    void property(const QString& name, const QString& value)
+    {
+        if ( record )
+            events.push_back(describe(name, value));
+    }
+
+    void parse_status(const QString& line)
+    {
+        regex::Match match;
+        if ( regex::match(line, regex_players(), match) )
+        {
+            players_active = match.capturedRef(2).toUInt();
+            players.reserve(players_active);
+            property("players", match.captured(1));
+        }
+        else if ( regex::match(line, regex_property(), match) )
+        {
+            property(match.captured(1), match.captured(2));
+        }
+        else if ( regex::match(line, regex_player_header()) )
+        {
+            players.clear();
+            if ( players_active == 0 )
+            {
+                listening = DEFAULT;
+                if ( record )
+                    event(describe(players));
+            }
+            else
+            {
+                listening = STATUS_PLAYERS;
+            }
+        }
+        else if ( !line.isEmpty() )
+        {
+            listening = DEFAULT;
+        }
+    }
+
+    void parse_player(const QString& line)
+    {
+        regex::Match match;
+        if ( regex::match(line, regex_player(), match) )
+        {
+            players.emplace_back();
+            players.back().ip    = match.captured(1);
+            players.back().pl    = match.captured(2);
+            players.back().ping  = match.captured(3);
+            players.back().time  = match.captured(4);
+            players.back().frags = match.captured(5);
+            players.back().no    = match.captured(6);
+            players.back().name  = match.captured(7);
+            if ( players_active == players.size() )
+            {
+                listening = DEFAULT;
+                if ( record )
+                    event(describe(players));
+            }
+        }
+    }
+};
+
+#endif // TOOLS_REGEX_LOG_PARSER_HPP
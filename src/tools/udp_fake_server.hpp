@@ -0,0 +1,255 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef TOOLS_UDP_FAKE_SERVER_HPP
+#define TOOLS_UDP_FAKE_SERVER_HPP
+
+#include <array>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include "network/time.hpp"
+#include "xonotic/fake_server.hpp"
+
+/**
+ * \brief Settings for UdpFakeServer
+ */
+struct FakeServerOptions
+{
+    uint16_t    port = 26000;
+    std::string password = "password";
+    int         secure = 0;
+    std::size_t players = 8;
+    std::size_t cvars = 1000;
+    double      log_rate = 10;      ///< Log lines per second
+    double      loss = 0;           ///< Probability of dropping a datagram, in each direction
+    int         latency = 0;        ///< Milliseconds datagrams are held before being sent
+    int         frame = 10;         ///< Milliseconds between log flushes
+    int         report = 5;         ///< Seconds between statistics lines, 0 to disable
+};
+
+/**
+ * \brief Stand-in Darkplaces server to run RconGui without Xonotic
+ *
+ * Serves a xonotic::FakeServer on a UDP port, with generated players
+ * and cvars, a steady stream of log lines and simulated packet loss
+ * and latency.
+ */
+class UdpFakeServer
+{
+public:
+    using udp = boost::asio::ip::udp;
+
+    UdpFakeServer(boost::asio::io_service& service, const FakeServerOptions& options)
+        : options(options),
+          service(service),
+          socket(service, udp::v6()),
+          frame_timer(service),
+          report_timer(service),
+          resolver(service),
+          loss(options.loss)
+    {
+        socket.set_option(boost::asio::ip::v6_only(false));
+        socket.bind(udp::endpoint(udp::v6(), options.port));
+
+        server.set_rcon(options.password, options.secure);
+        server.populate(options.players, options.cvars);
+        server.on_send = [this](const std::string& address, const std::string& datagram)
+        {
+            send(address, datagram);
+        };
+
+        start = network::Clock::now();
+        receive();
+        schedule_frame();
+        if ( options.report > 0 )
+            schedule_report();
+    }
+
+private:
+    /**
+     * \brief Formats an endpoint as the clients see it, for log_dest_udp
+     */
+    static std::string address_name(const udp::endpoint& endpoint)
+    {
+        auto address = endpoint.address();
+        if ( address.is_v6() && address.to_v6().is_v4_mapped() )
+            return address.to_v6().to_v4().to_string() + ':' + std::to_string(endpoint.port());
+        if ( address.is_v6() )
+            return '[' + address.to_string() + "]:" + std::to_string(endpoint.port());
+        return address.to_string() + ':' + std::to_string(endpoint.port());
+    }
+
+    /**
+     * \brief Parses "host:port" or "[host]:port", caching the result
+     */
+    bool endpoint(const std::string& address, udp::endpoint& result)
+    {
+        auto cached = endpoints.find(address);
+        if ( cached != endpoints.end() )
+        {
+            result = cached->second;
+            return true;
+        }
+
+        auto colon = address.rfind(':');
+        if ( colon == std::string::npos )
+            return false;
+        std::string host = address.substr(0, colon);
+        if ( host.size() > 1 && host.front() == '[' && host.back() == ']' )
+            host = host.substr(1, host.size() - 2);
+
+        boost::system::error_code error;
+        auto found = resolver.resolve(udp::resolver::query(host, address.substr(colon + 1)), error);
+        if ( error || found == udp::resolver::iterator() )
+            return false;
+
+        result = found->endpoint();
+        if ( result.address().is_v4() )
+            result = udp::endpoint(boost::asio::ip::address_v6::v4_mapped(result.address().to_v4()), result.port());
+        endpoints[address] = result;
+        return true;
+    }
+
+    bool dropped()
+    {
+        return loss > 0 && std::bernoulli_distribution(loss)(random);
+    }
+
+    void receive()
+    {
+        socket.async_receive_from(boost::asio::buffer(buffer), sender,
+            [this](const boost::system::error_code& error, std::size_t size)
+            {
+                // Closed or shutting down
+                if ( error == boost::asio::error::operation_aborted || !socket.is_open() )
+                    return;
+                if ( error )
+                    errors++;
+                else if ( !dropped() )
+                {
+                    server.receive(address_name(sender), StringView(buffer.data(), size));
+                    received++;
+                }
+                receive();
+            });
+    }
+
+    /**
+     * \brief Sends without throwing, an unreachable log_dest_udp entry
+     *  must not stop the server
+     */
+    void send_now(const std::string& data, const udp::endpoint& target)
+    {
+        boost::system::error_code error;
+        socket.send_to(boost::asio::buffer(data), target, 0, error);
+        if ( error )
+            errors++;
+        else
+            sent++;
+    }
+
+    void send(const std::string& address, const std::string& datagram)
+    {
+        udp::endpoint target;
+        if ( dropped() || !endpoint(address, target) )
+            return;
+
+        auto data = std::make_shared<std::string>(datagram);
+        if ( options.latency <= 0 )
+        {
+            send_now(*data, target);
+            return;
+        }
+
+        auto timer = std::make_shared<boost::asio::steady_timer>(service);
+        timer->expires_from_now(std::chrono::milliseconds(options.latency));
+        timer->async_wait([this, timer, data, target](const boost::system::error_code& error)
+        {
+            if ( !error )
+                send_now(*data, target);
+        });
+    }
+
+    void schedule_frame()
+    {
+        frame_timer.expires_from_now(std::chrono::milliseconds(options.frame));
+        frame_timer.async_wait([this](const boost::system::error_code& error)
+        {
+            if ( error )
+                return;
+
+            // Lines due since the start, so rounding doesn't drift the rate
+            double elapsed = std::chrono::duration<double>(network::Clock::now() - start).count();
+            uint64_t due = uint64_t(elapsed * options.log_rate);
+            for ( ; log_lines < due; log_lines++ )
+                server.print(xonotic::fake_log_line(log_lines) + '\n');
+            server.flush_log();
+
+            schedule_frame();
+        });
+    }
+
+    void schedule_report()
+    {
+        report_timer.expires_from_now(std::chrono::seconds(options.report));
+        report_timer.async_wait([this](const boost::system::error_code& error)
+        {
+            if ( error )
+                return;
+            auto stats = server.statistics();
+            std::cout << "received " << received << " sent " << sent
+                      << " errors " << errors
+                      << " commands " << stats.commands
+                      << " rejected " << stats.rejected
+                      << " log lines " << log_lines
+                      << " log_dest_udp \"" << server.cvar("log_dest_udp") << "\"" << std::endl;
+            schedule_report();
+        });
+    }
+
+    FakeServerOptions               options;
+    boost::asio::io_service&        service;
+    xonotic::FakeServer             server;
+    udp::socket                     socket;
+    boost::asio::steady_timer       frame_timer;
+    boost::asio::steady_timer       report_timer;
+    udp::resolver                   resolver;
+    std::map<std::string, udp::endpoint> endpoints; ///< Resolved log_dest_udp entries
+    std::array<char, 65536>         buffer;
+    udp::endpoint                   sender;
+    double                          loss;
+    std::mt19937                    random{std::random_device{}()};
+    network::Clock::time_point      start;
+    uint64_t                        log_lines = 0;
+    uint64_t                        received = 0;
+    uint64_t                        sent = 0;
+    uint64_t                        errors = 0;     ///< Failed sends and receives
+};
+
+#endif // TOOLS_UDP_FAKE_SERVER_HPP
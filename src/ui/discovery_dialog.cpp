@@ -0,0 +1,187 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "discovery_dialog.hpp"
+
+#include <QHeaderView>
+#include <QMessageBox>
+#include <QPushButton>
+
+#include "settings.hpp"
+
+DiscoveryDialog::DiscoveryDialog(QWidget* parent)
+    : QDialog(parent)
+{
+    setupUi(this);
+    qRegisterMetaType<xonotic::DiscoveredServer>();
+
+    input_master->setText(settings().discovery_master);
+    input_addresses->setPlainText(settings().discovery_addresses);
+    input_concurrency->setValue(settings().discovery_concurrency);
+    input_timeout->setValue(settings().discovery_timeout);
+
+    proxy_servers.setSourceModel(&model_servers);
+    proxy_servers.setSortRole(Qt::UserRole);
+    table_servers->setModel(&proxy_servers);
+    table_servers->horizontalHeader()->setSectionResizeMode(DiscoveryModel::Name, QHeaderView::Stretch);
+    table_servers->sortByColumn(DiscoveryModel::Ping, Qt::AscendingOrder);
+
+    auto button_import = new QPushButton(QIcon::fromTheme("document-import"), tr("Import Selected"));
+    button_import->setToolTip(tr("Add the selected servers to the saved servers"));
+    buttonBox->addButton(button_import, QDialogButtonBox::ActionRole);
+    connect(button_import, &QPushButton::clicked, this, &DiscoveryDialog::import_selected);
+
+    connect(this, &DiscoveryDialog::server_found, &model_servers, &DiscoveryModel::add_server);
+    connect(this, &DiscoveryDialog::discovery_finished, this, &DiscoveryDialog::finished);
+    connect(this, &DiscoveryDialog::discovery_error, this, [this](const QString& message){
+        errors.push_back(message);
+    });
+
+    discovery.on_server = [this](const xonotic::DiscoveredServer& server) {
+        emit server_found(server);
+    };
+    discovery.on_finished = [this]{
+        emit discovery_finished();
+    };
+    discovery.on_error = [this](const std::string& message) {
+        emit discovery_error(QString::fromStdString(message));
+    };
+
+    progress_timer.setInterval(100);
+    connect(&progress_timer, &QTimer::timeout, this, &DiscoveryDialog::update_progress);
+}
+
+DiscoveryDialog::~DiscoveryDialog()
+{
+    // Callbacks must not be called once the signals are gone
+    discovery.stop();
+}
+
+void DiscoveryDialog::start()
+{
+    settings().discovery_master = input_master->text();
+    settings().discovery_addresses = input_addresses->toPlainText();
+    settings().discovery_concurrency = input_concurrency->value();
+    settings().discovery_timeout = input_timeout->value();
+
+    discovery.set_concurrency(input_concurrency->value());
+    discovery.set_timeout(std::chrono::milliseconds(input_timeout->value()));
+
+    if ( !discovery.running() )
+    {
+        model_servers.clear();
+        errors.clear();
+    }
+    button_stop->setEnabled(true);
+    progress_timer.start();
+}
+
+void DiscoveryDialog::on_button_master_clicked()
+{
+    auto master = xonotic::expand_address_range(input_master->text().toStdString(), 27950);
+    if ( master.size() != 1 )
+    {
+        QMessageBox::warning(this, tr("Discover Servers"),
+            tr("Invalid master server: %1").arg(input_master->text()));
+        return;
+    }
+
+    start();
+    discovery.query_master(master.front());
+}
+
+void DiscoveryDialog::on_button_addresses_clicked()
+{
+    std::vector<network::Server> servers;
+    for ( const auto& line : input_addresses->toPlainText().split('\n', QString::SkipEmptyParts) )
+    {
+        if ( line.trimmed().isEmpty() )
+            continue;
+        auto range = xonotic::expand_address_range(line.toStdString());
+        if ( range.empty() )
+        {
+            QMessageBox::warning(this, tr("Discover Servers"),
+                tr("Invalid address: %1").arg(line));
+            return;
+        }
+        servers.insert(servers.end(), range.begin(), range.end());
+    }
+
+    if ( servers.empty() )
+        return;
+
+    start();
+    discovery.query(servers);
+}
+
+void DiscoveryDialog::on_button_stop_clicked()
+{
+    discovery.stop();
+    finished();
+}
+
+void DiscoveryDialog::finished()
+{
+    if ( discovery.running() )
+        return;
+    progress_timer.stop();
+    button_stop->setEnabled(false);
+    update_progress();
+}
+
+void DiscoveryDialog::update_progress()
+{
+    auto progress = discovery.progress();
+    label_progress->setText(tr("%1 found, %2 not responding, %3 waiting")
+        .arg(progress.answered)
+        .arg(progress.timed_out)
+        .arg(progress.queued + progress.in_flight));
+    label_progress->setToolTip(errors.join('\n'));
+}
+
+void DiscoveryDialog::import_selected()
+{
+    int imported = 0;
+    for ( const auto& index : table_servers->selectionModel()->selectedRows() )
+    {
+        const auto& server = model_servers.server(proxy_servers.mapToSource(index).row());
+
+        // Existing presets might have a password, they are left untouched
+        bool known = false;
+        for ( const auto& preset : settings().saved_servers )
+            known = known || preset.server == server.address;
+        if ( known )
+            continue;
+
+        QString name = server.name;
+        if ( name.isEmpty() || settings().saved_servers.contains(name) )
+            name = QString::fromStdString(server.address.name());
+        xonotic::ConnectionDetails details(server.address, "",
+            xonotic::ConnectionDetails::NO, name.toStdString());
+        settings().saved_servers.insert(name, details);
+        imported++;
+    }
+
+    if ( imported )
+        emit servers_imported();
+}
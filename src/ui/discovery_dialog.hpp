@@ -0,0 +1,90 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef DISCOVERY_DIALOG_HPP
+#define DISCOVERY_DIALOG_HPP
+
+#include <QSortFilterProxyModel>
+#include <QTimer>
+
+#include "ui_discovery_dialog.h"
+#include "model/discovery_model.hpp"
+
+/**
+ * \brief Finds servers on a master list or on the local network
+ *
+ * Selected servers can be imported in the saved server presets.
+ */
+class DiscoveryDialog : public QDialog, private Ui::DiscoveryDialog
+{
+    Q_OBJECT
+
+public:
+    explicit DiscoveryDialog(QWidget* parent = nullptr);
+    ~DiscoveryDialog();
+
+signals:
+    /**
+     * \brief Emitted (from a network thread) when a server responds
+     */
+    void server_found(const xonotic::DiscoveredServer& server);
+
+    /**
+     * \brief Emitted (from a network thread) when all the queries are done
+     */
+    void discovery_finished();
+
+    /**
+     * \brief Emitted (from a network thread) on network errors
+     */
+    void discovery_error(const QString& message);
+
+    /**
+     * \brief Emitted when servers have been added to the saved presets
+     */
+    void servers_imported();
+
+private slots:
+    void on_button_master_clicked();
+    void on_button_addresses_clicked();
+    void on_button_stop_clicked();
+    void import_selected();
+    void update_progress();
+    void finished();
+
+private:
+    /**
+     * \brief Stores the query options and applies them to \c discovery
+     */
+    void start();
+
+    xonotic::ServerDiscovery discovery;
+    DiscoveryModel          model_servers;
+    QSortFilterProxyModel   proxy_servers;
+    QTimer                  progress_timer;
+    QStringList             errors;
+};
+
+Q_DECLARE_METATYPE(xonotic::DiscoveredServer)
+
+#endif // DISCOVERY_DIALOG_HPP
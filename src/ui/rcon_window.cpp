@@ -24,9 +24,15 @@
 #include "rcon_window.hpp"
 
 #include <QtWidgets/QApplication>
+#include <QFile>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QInputDialog>
 #include <QSettings>
 #include <QToolButton>
 
+#include "discovery_dialog.hpp"
+#include "network/replay_transport.hpp"
 #include "server_setup_dialog.hpp"
 #include "server_widget.hpp"
 #include "settings_dialog.hpp"
@@ -76,7 +82,23 @@ void RconWindow::new_tab()
     auto buttonbox = new QDialogButtonBox(this);
     auto button_connect = new QPushButton(QIcon::fromTheme("network-connect"), tr("Connect"));
     buttonbox->addButton(button_connect,QDialogButtonBox::AcceptRole);
+    auto button_discover = new QPushButton(QIcon::fromTheme("edit-find"), tr("Discover Servers..."));
+    button_discover->setToolTip(tr("Find servers on a master server or on the local network"));
+    buttonbox->addButton(button_discover,QDialogButtonBox::ActionRole);
+    auto button_replay = new QPushButton(QIcon::fromTheme("media-playback-start"), tr("Replay Capture..."));
+    button_replay->setToolTip(tr("Replay the traffic recorded from a server"));
+    buttonbox->addButton(button_replay,QDialogButtonBox::ActionRole);
     layout->addWidget(buttonbox);
+    connect(button_discover, &QPushButton::clicked, [this, createwidget]{
+        DiscoveryDialog dialog(this);
+        connect(&dialog, &DiscoveryDialog::servers_imported,
+                createwidget, &ServerSetupWidget::update_presets);
+        dialog.exec();
+    });
+    connect(button_replay, &QPushButton::clicked, [this, tab]{
+        if ( replay_capture() )
+            tab->deleteLater();
+    });
     connect(button_connect, &QPushButton::clicked, [this, tab, createwidget]{
         create_tab(createwidget->connection_details());
         tab->deleteLater();
@@ -86,10 +108,11 @@ void RconWindow::new_tab()
     tabWidget->setCurrentIndex(tabindex);
 }
 
-void RconWindow::create_tab(const xonotic::ConnectionDetails& xonotic)
+void RconWindow::create_tab(const xonotic::ConnectionDetails& xonotic,
+                            std::unique_ptr<network::Transport> transport)
 {
     QString name = QString::fromStdString(xonotic.name);
-    auto tab = new ServerWidget(std::move(xonotic));
+    auto tab = new ServerWidget(std::move(xonotic), nullptr, std::move(transport));
     int tabindex = tabWidget->addTab(tab, name);
     connect(tab, &ServerWidget::name_changed,[this,tab](const QString& string){
         tabWidget->setTabText(tabWidget->indexOf(tab), string);
@@ -97,3 +120,26 @@ void RconWindow::create_tab(const xonotic::ConnectionDetails& xonotic)
     connect(this, &RconWindow::settings_changed, tab, &ServerWidget::reload_settings);
     tabWidget->setCurrentIndex(tabindex);
 }
+
+bool RconWindow::replay_capture()
+{
+    QString filename = QFileDialog::getOpenFileName(this, tr("Replay Capture"),
+        QString(), tr("Captures (*.rgcap);;All files (*)"));
+    if ( filename.isEmpty() )
+        return false;
+
+    bool ok = false;
+    double speed = QInputDialog::getDouble(this, tr("Replay Capture"),
+        tr("Speed (0 to replay as fast as possible):"), 1, 0, 1000, 2, &ok);
+    if ( !ok )
+        return false;
+
+    QString name = tr("Replay: %1").arg(QFileInfo(filename).fileName());
+    create_tab(
+        xonotic::ConnectionDetails(network::Server("replay", 0), "",
+                                   xonotic::ConnectionDetails::NO, name.toStdString()),
+        std::unique_ptr<network::Transport>(new network::ReplayTransport(
+            QFile::encodeName(filename).toStdString(), speed))
+    );
+    return true;
+}
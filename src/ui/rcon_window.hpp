@@ -24,9 +24,12 @@
 #ifndef RCON_WINDOW_HPP
 #define RCON_WINDOW_HPP
 
+#include <memory>
+
 #include <QMainWindow>
 #include "ui_rcon_window.h"
 #include "xonotic/connection_details.hpp"
+#include "network/transport.hpp"
 
 /**
  * \brief Main window
@@ -51,7 +54,14 @@ public slots:
     void new_tab();
 
 private:
-    void create_tab(const xonotic::ConnectionDetails& xonotic);
+    void create_tab(const xonotic::ConnectionDetails& xonotic,
+                    std::unique_ptr<network::Transport> transport = nullptr);
+
+    /**
+     * \brief Asks for a capture file and opens a tab replaying it
+     * \returns Whether the tab has been created
+     */
+    bool replay_capture();
 };
 
 #endif // RCON_WINDOW_HPP
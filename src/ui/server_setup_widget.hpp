@@ -49,17 +49,17 @@ public:
      */
     void populate(const xonotic::ConnectionDetails& xonotic);
 
+public slots:
+    /**
+     * \brief Loads the saved servers in the preset combo box
+     */
+    void update_presets();
+
 private slots:
     void on_button_save_clicked();
     void on_button_delete_clicked();
     void on_input_preset_currentIndexChanged(const QString& text);
     void update_placeholder();
-
-private:
-    /**
-     * \brief Loads the saved servers in the preset combo box
-     */
-    void update_presets();
 };
 
 #endif // SERVER_SETUP_WIDGET_HPP
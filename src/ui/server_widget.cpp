@@ -26,19 +26,40 @@
 #include <QFileDialog>
 #include <QMenu>
 #include <QMessageBox>
+#include <QDateTime>
 #include <QScrollBar>
+#include <QShowEvent>
 #include <QTextObject>
 #include <QTime>
 #include <QToolButton>
 #include <QWhatsThis>
 
 #include "server_setup_dialog.hpp"
+#include "network/shared_socket.hpp"
 #include "settings.hpp"
 #include "xonotic/color_parser.hpp"
 #include "regex.hpp"
 
-ServerWidget::ServerWidget(xonotic::ConnectionDetails details, QWidget* parent)
-    : QWidget(parent), connection(std::move(details))
+/**
+ * \brief Socket new connections should use, null for a dedicated one
+ */
+static network::SharedSocket* configured_socket()
+{
+    return settings().network_shared_socket ? &network::SharedSocket::instance() : nullptr;
+}
+
+/**
+ * \brief What new connections should wait for datagrams with
+ */
+static network::ReadMode configured_read_mode()
+{
+    return settings().network_gui_receive ? network::ReadMode::External : network::ReadMode::Reactor;
+}
+
+ServerWidget::ServerWidget(xonotic::ConnectionDetails details, QWidget* parent,
+                           std::unique_ptr<network::Transport> transport)
+    : QWidget(parent),
+      connection(std::move(details), settings().network_log_queue, std::move(transport))
 {
     menu_quick_commands = new QMenu(tr("Quick Commands"), this);
     menu_quick_commands->setObjectName("menu_quick_commands");
@@ -46,10 +67,12 @@ ServerWidget::ServerWidget(xonotic::ConnectionDetails details, QWidget* parent)
     setupUi(this);
     button_refresh_status->setShortcut(QKeySequence::Refresh);
     button_refresh_cvars->setShortcut(QKeySequence::Refresh);
+    action_show_timestamps->setChecked(settings().console_timestamps);
+
 
-    delayed_status.setInterval(150); /// \todo read from settings?
-    delayed_status.setSingleShot(true);
-    connect(&delayed_status, &QTimer::timeout, this, &ServerWidget::request_status);
+    statistics_timer.setInterval(1000);
+    connect(&statistics_timer, &QTimer::timeout, this, &ServerWidget::update_statistics);
+    statistics_timer.start();
 
     init_status_table();
 
@@ -173,15 +196,26 @@ void ServerWidget::init_connection()
     connect(&connection, &xonotic::QDarkplaces::connection_error,
             this, &ServerWidget::network_error_status,
             Qt::QueuedConnection);
-    connect(&connection, &xonotic::QDarkplaces::received_log,
-            this, &ServerWidget::xonotic_log,
-            Qt::QueuedConnection);
-    connect(&connection, &xonotic::QDarkplaces::log_end,
-            this, &ServerWidget::xonotic_log_end,
+    connect(&connection, &xonotic::QDarkplaces::connection_status,
+            this, &ServerWidget::set_network_status,
             Qt::QueuedConnection);
+    // Direct when the log is read from the GUI thread
+    connect(&connection, &xonotic::QDarkplaces::log_available,
+            this, &ServerWidget::xonotic_log,
+            Qt::AutoConnection);
     connect(&connection, &xonotic::QDarkplaces::disconnecting,
             this, &ServerWidget::detach_log,
             Qt::QueuedConnection);
+    connect(&connection, &xonotic::QDarkplaces::server_info,
+            this, &ServerWidget::xonotic_server_info,
+            Qt::QueuedConnection);
+    connect(&info_timer, &QTimer::timeout, [this]{
+        if ( connection.xonotic_connected() )
+            connection.request_info();
+    });
+    set_network_status(tr("Connecting..."));
+    connection.set_shared_socket(configured_socket());
+    connection.set_read_mode(configured_read_mode());
     connection.xonotic_connect();
 }
 
@@ -216,6 +250,39 @@ void ServerWidget::xonotic_connected()
     request_status();
 }
 
+void ServerWidget::xonotic_server_info(const xonotic::ServerInfo& info)
+{
+    auto value = [&info](const std::string& key) {
+        return QString::fromStdString(info.value(key));
+    };
+
+    if ( info.values.count("hostname") )
+        model_server.set_server_property("host", value("hostname"));
+    if ( info.values.count("mapname") )
+        model_server.set_server_property("map", value("mapname"));
+    if ( info.values.count("clients") )
+        model_server.set_server_property("players", QString("%1 active (%2 max)")
+            .arg(info.number("clients")).arg(info.number("sv_maxclients")));
+
+    if ( info.has_players )
+    {
+        // statusResponse lacks IP, entity number and connection time,
+        // those are kept from the last rcon status
+        std::vector<xonotic::Player> players;
+        players.reserve(info.players.size());
+        for ( const auto& info_player : info.players )
+        {
+            players.emplace_back();
+            players.back().name = QString::fromStdString(info_player.name);
+            players.back().ping = QString::number(info_player.ping);
+            players.back().frags = QString::number(info_player.score);
+        }
+        model_player.update_players(players);
+    }
+
+    label_refresh_status->setText(QTime::currentTime().toString("hh:mm:ss"));
+}
+
 void ServerWidget::xonotic_clear()
 {
     model_cvar.clear();
@@ -227,6 +294,42 @@ void ServerWidget::xonotic_clear()
 
 void ServerWidget::xonotic_log_end()
 {
+    if ( !isVisible() )
+    {
+        log_held = log_held || log_pending_size;
+        return;
+    }
+
+    render_log_pending();
+}
+
+void ServerWidget::render_log_pending()
+{
+    QStringList log_buffer;
+    bool timestamps = action_show_timestamps->isChecked();
+    for ( std::size_t i = 0; i < log_pending_size; i++ )
+    {
+        const xonotic::LogLine& line = log_pending[i];
+        QString log = QString::fromUtf8(line.text.data(), line.text.size());
+        if ( timestamps )
+        {
+            auto msecs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                line.arrival.time_since_epoch()).count();
+            log = QDateTime::fromMSecsSinceEpoch(msecs).toString("[hh:mm:ss.zzz] ") + log;
+        }
+        log_buffer.push_back(log);
+    }
+
+    auto dropped = connection.dropped_log_lines();
+    if ( dropped != log_dropped )
+    {
+        log_buffer.push_back(tr("[%1 log lines dropped]").arg(dropped - log_dropped));
+        log_dropped = dropped;
+    }
+
+    if ( log_buffer.isEmpty() )
+        return;
+
     auto scrollbar = output_console->verticalScrollBar();
     bool scroll = scrollbar->value() == scrollbar->maximum();
 
@@ -243,20 +346,49 @@ void ServerWidget::xonotic_log_end()
             settings().console_brightness_min,
             settings().console_brightness_max
         ).convert(log_buffer, &cursor);
-        log_buffer.clear();
     }
 
     if ( scroll )
         scrollbar->setValue(scrollbar->maximum());
 
-    log_buffer.clear();
+    // Lines held while hidden would measure how long the tab wasn't shown
+    if ( !log_held )
+    {
+        auto now = network::WallClock::now();
+        for ( std::size_t i = 0; i < log_pending_size; i++ )
+            render_latency.record(std::max(network::Clock::duration::zero(),
+                std::chrono::duration_cast<network::Clock::duration>(now - log_pending[i].arrival)));
+    }
+    log_held = false;
+    log_pending_size = 0;
+}
+
+void ServerWidget::xonotic_log()
+{
+    // The parser works on the bytes as received, lines are converted
+    // to QString only when rendered
+    std::size_t capacity = connection.log_queue_capacity();
+    auto lines = connection.consume_log([this, capacity](const xonotic::LogLine& line) {
+        log_parser.parse(line.text);
+        // Hidden for long, render what has been held so far rather than
+        // holding lines without bounds
+        if ( log_pending_size == capacity )
+            render_log_pending();
+        if ( log_pending_size == log_pending.size() )
+            log_pending.emplace_back();
+        log_pending[log_pending_size++] = line;
+    });
+
+    if ( lines )
+        set_network_status(tr("Connected"));
+
+    xonotic_log_end();
 }
 
-void ServerWidget::xonotic_log(const QString& log)
+void ServerWidget::showEvent(QShowEvent* event)
 {
-    set_network_status(tr("Connected"));
-    log_parser.parse(log);
-    log_buffer.push_back(log);
+    QWidget::showEvent(event);
+    xonotic_log_end();
 }
 
 QString ServerWidget::name() const
@@ -286,6 +418,28 @@ void ServerWidget::reload_settings()
 
     update_player_actions();
 
+    connection.set_receive_batch_size(settings().network_receive_batch);
+    connection.set_receive_buffer_size(settings().network_receive_buffer * 1024,
+                                       settings().network_receive_buffer_max * 1024);
+    connection.set_shared_socket(configured_socket());
+    connection.set_read_mode(configured_read_mode());
+
+    xonotic::ChallengePolicy challenge;
+    challenge.timeout = std::chrono::milliseconds(settings().network_challenge_timeout);
+    challenge.retries = settings().network_challenge_retries;
+    challenge.pipeline = settings().network_challenge_pipeline;
+    challenge.prefetch = settings().network_challenge_prefetch;
+    challenge.lifetime = std::chrono::seconds(settings().network_challenge_lifetime);
+    connection.set_challenge_policy(challenge);
+
+    connection.set_coalesce_window(std::chrono::milliseconds(settings().network_coalesce_window));
+    connection.set_send_rate(settings().network_send_rate, settings().network_send_burst);
+
+    if ( settings().network_info_poll > 0 )
+        info_timer.start(settings().network_info_poll * 1000);
+    else
+        info_timer.stop();
+
     // Console
     if ( settings().get("console/autocomplete", true) )
         input_console->setWordCompleter(&complete_cvar);
@@ -324,11 +478,13 @@ void ServerWidget::on_output_console_customContextMenuRequested(const QPoint &po
     menu->addSeparator();
     menu->addAction(action_save_log);
     menu->addAction(action_clear_log);
+    menu->addAction(action_record_traffic);
 
     menu->addSeparator();
     menu->addAction(action_attach_log);
     menu->addAction(action_detach_log);
     menu->addAction(action_parse_colors);
+    menu->addAction(action_show_timestamps);
 
     menu->exec(output_console->mapToGlobal(pos));
 }
@@ -430,6 +586,41 @@ void ServerWidget::on_action_save_log_triggered()
 
 }
 
+void ServerWidget::on_action_show_timestamps_toggled(bool checked)
+{
+    settings().console_timestamps = checked;
+}
+
+void ServerWidget::on_action_record_traffic_toggled(bool checked)
+{
+    if ( !checked )
+    {
+        connection.stop_capture();
+        return;
+    }
+
+    if ( connection.capturing() )
+        return;
+
+    static QString directory;
+
+    QString filename = QFileDialog::getSaveFileName(this, tr("Record Traffic"),
+        directory, tr("Captures (*.rgcap);;All files (*)"));
+    if ( filename.isEmpty() )
+    {
+        action_record_traffic->setChecked(false);
+        return;
+    }
+    directory = QFileInfo(filename).dir().path();
+
+    if ( !connection.start_capture(QFile::encodeName(filename).toStdString()) )
+    {
+        QMessageBox::warning(this, tr("File Error"),
+            tr("Could not write to \"%1\".").arg(filename));
+        action_record_traffic->setChecked(false);
+    }
+}
+
 void ServerWidget::on_tabWidget_currentChanged(int tab)
 {
     if ( tabWidget->widget(tab) == tab_cvars )
@@ -476,21 +667,97 @@ void ServerWidget::network_error_status(const QString& msg)
 
 void ServerWidget::set_network_status(const QString& msg)
 {
+    network_status = msg;
     label_connection->setText(msg);
     model_server.set_server_property("connection",msg);
 }
 
+void ServerWidget::update_statistics()
+{
+    QStringList lines;
+
+    auto receive = connection.receive_statistics();
+    lines << tr("Datagrams received: %1").arg(receive.datagrams)
+          << tr("Average datagrams per read: %1").arg(receive.average_batch(), 0, 'f', 2)
+          << tr("Log lines dropped: %1").arg(connection.dropped_log_lines());
+    uint64_t kernel_drops = receive.kernel_drops;
+    if ( receive.buffer_size )
+        lines << tr("Receive buffer: %1 KiB").arg(receive.buffer_size / 1024);
+    auto shared = configured_socket();
+    if ( shared )
+    {
+        // Drops on the shared socket can't be told apart by server
+        kernel_drops = shared->kernel_drops();
+        lines << tr("Shared socket: port %1, %2 servers, %3 datagrams from unknown sources")
+            .arg(shared->port()).arg(shared->attached()).arg(shared->unrouted());
+        auto shards = shared->shard_datagrams();
+        if ( shards.size() > 1 )
+        {
+            QStringList counts;
+            for ( auto count : shards )
+                counts << QString::number(count);
+            lines << tr("Datagrams per receive worker: %1").arg(counts.join(", "));
+        }
+    }
+
+    lines << tr("Datagrams dropped by kernel: %1%2").arg(kernel_drops)
+        .arg(shared ? tr(" (all the servers on the shared socket)") : QString());
+
+    auto send = connection.send_statistics();
+    lines << tr("Datagrams sent: %1").arg(send.sent)
+          << tr("Datagrams delayed by the send rate: %1").arg(send.delayed)
+          << tr("Send queue: %1 datagrams").arg(send.queued)
+          << tr("Packets saved by coalescing: %1").arg(connection.coalesced_packets());
+
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    auto msec = [](network::Clock::duration time) {
+        return duration_cast<microseconds>(time).count() / 1000.0;
+    };
+    auto latency = connection.command_latency();
+    if ( latency.count() )
+    {
+        lines << tr("Command round trip: %1 ms median, %2 ms 95th percentile (%3 commands)")
+            .arg(msec(latency.percentile(0.5)), 0, 'f', 1)
+            .arg(msec(latency.percentile(0.95)), 0, 'f', 1)
+            .arg(latency.count());
+    }
+    if ( render_latency.count() )
+    {
+        lines << tr("Log receive to render: %1 ms median, %2 ms 95th percentile (%3 lines)")
+            .arg(msec(render_latency.percentile(0.5)), 0, 'f', 1)
+            .arg(msec(render_latency.percentile(0.95)), 0, 'f', 1)
+            .arg(render_latency.count());
+    }
+
+    label_connection->setToolTip(lines.join('\n'));
+
+    QStringList notes;
+    // Makes it clear why bulk actions take their time
+    if ( send.queued )
+        notes << tr("%1 queued, waiting %2 ms").arg(send.queued)
+            .arg(std::chrono::duration_cast<std::chrono::milliseconds>(send.delay).count());
+    // Makes it clear why log lines are missing
+    if ( kernel_drops )
+        notes << tr("%1 datagrams dropped by kernel").arg(kernel_drops);
+    if ( notes.empty() )
+        label_connection->setText(network_status);
+    else
+        label_connection->setText(tr("%1 (%2)").arg(network_status).arg(notes.join(", ")));
+}
+
 void ServerWidget::request_status()
 {
+    // Polling must not delay commands from the user
     for ( const auto& cmd : settings().cmd_status )
-        rcon_command(cmd);
+        connection.rcon_command(cmd.toStdString(), network::SendPriority::Background);
     label_refresh_status->setText(QTime::currentTime().toString("hh:mm:ss"));
 }
 
 void ServerWidget::request_cvars()
 {
     for ( const auto& cmd : settings().cmd_cvarlist )
-        rcon_command(cmd);
+        connection.rcon_command(cmd.toStdString(), network::SendPriority::Background);
     label_refresh_cvar->setText(QTime::currentTime().toString("hh:mm:ss"));
 }
 
@@ -501,9 +768,12 @@ QAbstractButton* ServerWidget::create_button(const PlayerAction& action,
     button->setIcon(action.icon());
     auto cmd = action.command(player);
     button->setToolTip(action.name().isEmpty() ? cmd : action.name());
+    // Would run with an empty entity number until the next rcon status
+    button->setEnabled(action.available(player));
     connect(button, &QPushButton::clicked, [this, cmd]{
-        run_command(cmd, settings().player_actions_expansion);
-        delayed_status.start();
+        // Refresh as soon as the server has run the action
+        run_command(cmd, settings().player_actions_expansion,
+                    [this](const xonotic::CommandResult&) { request_status(); });
     });
     return button;
 }
@@ -516,7 +786,8 @@ void ServerWidget::ensure_has_cvars()
         request_cvars();
 }
 
-void ServerWidget::run_command(QString cmd, CvarExpansion exp)
+void ServerWidget::run_command(QString cmd, CvarExpansion exp,
+                               xonotic::QDarkplaces::Completion completion)
 {
     if ( cmd.isEmpty() )
         return;
@@ -562,6 +833,9 @@ void ServerWidget::run_command(QString cmd, CvarExpansion exp)
         }
     }
 
-    rcon_command(cmd);
+    if ( completion )
+        connection.rcon_command(cmd.toStdString(), std::move(completion));
+    else
+        rcon_command(cmd);
 }
 
@@ -51,7 +51,11 @@ class ServerWidget : public QWidget, private Ui_ServerWidget
     friend class Ui_ServerWidget;
 
 public:
-    ServerWidget(xonotic::ConnectionDetails xonotic, QWidget* parent = nullptr);
+    /**
+     * \param transport Used instead of a network connection, eg: to replay a capture
+     */
+    ServerWidget(xonotic::ConnectionDetails xonotic, QWidget* parent = nullptr,
+                 std::unique_ptr<network::Transport> transport = nullptr);
 
     ~ServerWidget();
 
@@ -86,6 +90,8 @@ private slots:
     void on_output_console_customContextMenuRequested(const QPoint &pos);
     void on_table_cvars_customContextMenuRequested(const QPoint &pos);
     void on_action_save_log_triggered();
+    void on_action_show_timestamps_toggled(bool checked);
+    void on_action_record_traffic_toggled(bool checked);
     void on_tabWidget_currentChanged(int tab);
     void on_input_cvar_filter_section_currentIndexChanged(int index);
     void on_input_console_lineExecuted(const QString& cmd);
@@ -131,10 +137,24 @@ private slots:
      */
     void update_player_actions();
 
+    /**
+     * \brief Shows the connection counters
+     */
+    void update_statistics();
+
     void xonotic_disconnected();
     void xonotic_connected();
-    void xonotic_log_end();
-    void xonotic_log(const QString& log);
+    /**
+     * \brief Updates the models from a connectionless status query
+     */
+    void xonotic_server_info(const xonotic::ServerInfo& info);
+    /**
+     * \brief Consumes the log lines queued by the connection
+     */
+    void xonotic_log();
+
+protected:
+    void showEvent(QShowEvent* event) override;
 
 private:
     /**
@@ -168,6 +188,19 @@ private:
      */
     void xonotic_clear();
 
+    /**
+     * \brief Renders the log lines in \c log_pending
+     *
+     * Does nothing while the widget is hidden, the lines are rendered
+     * once it's shown again or when log_pending is full.
+     */
+    void xonotic_log_end();
+
+    /**
+     * \brief Renders the log lines in \c log_pending, even if hidden
+     */
+    void render_log_pending();
+
     /**
      * \brief Sets the network status message
      */
@@ -186,15 +219,30 @@ private:
 
     /**
      * \brief Runs a command expanding the cvars
+     * \param completion If set, called with the output of the command
      */
-    void run_command(QString cmd, CvarExpansion exp);
+    void run_command(QString cmd, CvarExpansion exp,
+                     xonotic::QDarkplaces::Completion completion = {});
 
     /// Object handling the DP protocol
     xonotic::QDarkplaces        connection;
     /// Parses the log from the connection to populate the model
     xonotic::LogParser          log_parser;
-    /// Buffer used to cache log received from darkplaces
-    QStringList                 log_buffer;
+    /**
+     * \brief Log lines waiting to be rendered, as received (the strings are reused)
+     *
+     * Holds at most as many lines as the connection log queue,
+     * while hidden they're rendered when it gets full.
+     */
+    std::vector<xonotic::LogLine> log_pending;
+    /// Number of lines in log_pending
+    std::size_t                 log_pending_size = 0;
+    /// Whether log_pending has been held back while the widget was hidden
+    bool                        log_held = false;
+    /// Number of dropped log lines already reported in the console
+    uint64_t                    log_dropped = 0;
+    /// Time from the network receiving log lines to the console showing them
+    network::LatencyHistogram   render_latency;
     /// Server status model
     ServerModel                 model_server;
     /// Server status edit delegate
@@ -213,8 +261,12 @@ private:
     bool                        log_dest_set = false;
     /// Menu shown to trigger quick commands
     QMenu*                      menu_quick_commands = nullptr;
-    /// Timer which requests status after a short while
-    QTimer                      delayed_status;
+    /// Timer which refreshes the connection counters
+    QTimer                      statistics_timer;
+    /// Timer which polls the status without rcon
+    QTimer                      info_timer;
+    /// Text shown on label_connection, without the send queue details
+    QString                     network_status;
 
 };
 
@@ -24,6 +24,9 @@
 
 #include "settings_dialog.hpp"
 #include "settings.hpp"
+#include "network/reactor.hpp"
+#include "network/resolver.hpp"
+#include "network/shared_socket.hpp"
 #include <QFontDialog>
 
 SettingsDialog::SettingsDialog(QWidget* parent):
@@ -46,6 +49,25 @@ void SettingsDialog::init_tab_network()
         table_sv->append(input_sv_new->connection_details());
         input_sv_new->clear();
     });
+    input_net_threads->setValue(settings().network_threads);
+    input_net_batch->setValue(settings().network_receive_batch);
+    input_net_log_queue->setValue(settings().network_log_queue);
+    input_net_dns_cache->setValue(settings().network_dns_cache);
+    input_net_challenge_timeout->setValue(settings().network_challenge_timeout);
+    input_net_challenge_retries->setValue(settings().network_challenge_retries);
+    input_net_challenge_pipeline->setValue(settings().network_challenge_pipeline);
+    input_net_challenge_prefetch->setValue(settings().network_challenge_prefetch);
+    input_net_challenge_lifetime->setValue(settings().network_challenge_lifetime);
+    input_net_coalesce_window->setValue(settings().network_coalesce_window);
+    input_net_send_rate->setValue(settings().network_send_rate);
+    input_net_send_burst->setValue(settings().network_send_burst);
+    input_net_info_poll->setValue(settings().network_info_poll);
+    input_net_shared_socket->setChecked(settings().network_shared_socket);
+    input_net_shared_port->setValue(settings().network_shared_port);
+    input_net_shared_workers->setValue(settings().network_shared_workers);
+    input_net_receive_buffer->setValue(settings().network_receive_buffer);
+    input_net_receive_buffer_max->setValue(settings().network_receive_buffer_max);
+    input_net_gui_receive->setChecked(settings().network_gui_receive);
 }
 
 void SettingsDialog::init_tab_quick_commands()
@@ -157,6 +179,34 @@ void SettingsDialog::accept()
     settings().console_attach_command = input_con_attach->text();
     settings().console_detach_command = input_con_detach->text();
 
+    settings().network_threads = input_net_threads->value();
+    settings().network_receive_batch = input_net_batch->value();
+    settings().network_log_queue = input_net_log_queue->value();
+    settings().network_dns_cache = input_net_dns_cache->value();
+    settings().network_challenge_timeout = input_net_challenge_timeout->value();
+    settings().network_challenge_retries = input_net_challenge_retries->value();
+    settings().network_challenge_pipeline = input_net_challenge_pipeline->value();
+    settings().network_challenge_prefetch = input_net_challenge_prefetch->value();
+    settings().network_challenge_lifetime = input_net_challenge_lifetime->value();
+    settings().network_coalesce_window = input_net_coalesce_window->value();
+    settings().network_send_rate = input_net_send_rate->value();
+    settings().network_send_burst = input_net_send_burst->value();
+    settings().network_info_poll = input_net_info_poll->value();
+    settings().network_shared_socket = input_net_shared_socket->isChecked();
+    settings().network_shared_port = input_net_shared_port->value();
+    settings().network_shared_workers = input_net_shared_workers->value();
+    settings().network_receive_buffer = input_net_receive_buffer->value();
+    settings().network_receive_buffer_max = input_net_receive_buffer_max->value();
+    settings().network_gui_receive = input_net_gui_receive->isChecked();
+    network::Reactor::instance().set_thread_count(settings().network_threads);
+    network::Resolver::instance().set_cache_duration(
+        std::chrono::seconds(settings().network_dns_cache));
+    network::SharedSocket::instance().set_port(settings().network_shared_port);
+    network::SharedSocket::instance().set_workers(settings().network_shared_workers);
+    network::SharedSocket::instance().receive_batch_size(settings().network_receive_batch);
+    network::SharedSocket::instance().receive_buffer_size(
+        settings().network_receive_buffer * 1024, settings().network_receive_buffer_max * 1024);
+
     settings().save();
 
     QDialog::accept();
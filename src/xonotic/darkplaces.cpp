@@ -22,85 +22,131 @@
  *
  */
 #include "darkplaces.hpp"
-#include <QMessageAuthenticationCode>
 
-static std::string hmac_md4(const std::string& input, const std::string& key)
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "network/udp_io.hpp"
+
+namespace xonotic {
+
+/**
+ * \brief Start of the lines echoed around commands from rcon_command_tracked()
+ */
+static const std::string marker_prefix = "rcongui_marker_";
+
+/**
+ * \brief Removes characters which would break the rcon datagram
+ */
+static void sanitize_command(std::string& command)
 {
-    QMessageAuthenticationCode code(QCryptographicHash::Md4);
-    code.setKey(QByteArray(key.data(), key.size()));
-    code.addData(input.data(), input.size());
-    auto output = code.result();
-    return std::string(output.data(), output.size());
+    command.erase(std::remove_if(command.begin(), command.end(),
+        [](char c){return c == '\n' || c == '\0' || c == '\xff';}),
+        command.end());
 }
 
-namespace xonotic {
+/**
+ * \brief Whether \p command can be followed by other commands on the same line
+ *
+ * Darkplaces doesn't split commands on ';' within quotes or after a comment.
+ */
+static bool can_coalesce(const std::string& command)
+{
+    return std::count(command.begin(), command.end(), '"') % 2 == 0 &&
+           command.find("//") == std::string::npos;
+}
 
-Darkplaces::Darkplaces(ConnectionDetails connection_details)
-    : connection_details(std::move(connection_details))
+Darkplaces::Darkplaces(ConnectionDetails connection_details,
+                       std::unique_ptr<network::Transport> transport)
+    : connection_details(std::move(connection_details)),
+      signer(this->connection_details.rcon_password),
+      io(std::move(transport))
 {
-    io.max_datagram_size(1400);
-    io.on_error = [this](const std::string& msg)
+    if ( !io )
+    {
+        auto udp = new network::UdpIo;
+        udp->max_datagram_size(1400);
+        io.reset(udp);
+    }
+    io->receive_batch_size(32);
+    io->on_error = [this](const std::string& msg)
     {
         on_network_error(msg);
     };
-    io.on_async_receive = [this](const std::string& datagram)
+    io->on_status = [this](const std::string& msg)
+    {
+        on_network_status(msg);
+    };
+    io->on_async_receive = [this](const std::vector<StringView>& datagrams,
+                                 const std::vector<network::WallTime>& arrivals)
     {
-        read(datagram);
+        read(datagrams, arrivals);
     };
-    io.on_failure = [this]()
+    io->on_failure = [this]()
     {
         disconnect();
     };
+    io->on_watch = [this](network::Transport::NativeHandle handle)
+    {
+        on_watch_socket(handle);
+    };
+    io->on_unwatch = [this]()
+    {
+        on_unwatch_socket();
+    };
+    io->on_connect = [this]()
+    {
+        request_challenge();
+        on_connect();
+    };
+    challenge_timer.on_timeout = [this]()
+    {
+        challenge_timeout();
+    };
+    pool_timer.on_timeout = [this]()
+    {
+        request_challenge();
+    };
+    coalesce_timer.on_timeout = [this]()
+    {
+        flush_coalesced();
+    };
+    tracking_timer.on_timeout = [this]()
+    {
+        tracking_timeout();
+    };
 }
 
 Darkplaces::~Darkplaces()
 {
     if ( connected() )
-    {
         disconnect();
-    }
     else
-    {
-        // In case the connection failed
-        if ( thread_input.joinable() )
-            thread_input.join();
-    }
+        io->disconnect(); // In case it's still resolving
 }
 
 void Darkplaces::disconnect()
 {
-    if ( io.connected() )
+    if ( io->connected() )
         on_disconnecting();
-    io.disconnect();
-    if ( thread_input.joinable() &&
-            thread_input.get_id() != std::this_thread::get_id() )
-        thread_input.join();
+    // Commands held for coalescing are queued, the transport sends them before closing
+    coalesce_timer.cancel();
+    flush_coalesced();
+    io->disconnect();
     clear();
     on_disconnect();
 }
 
 bool Darkplaces::connect()
 {
-    if ( !io.connected() )
+    if ( !io->connected() && !io->connecting() )
     {
-        if ( io.connect(connection_details.server) )
-        {
-            if ( thread_input.get_id() == std::this_thread::get_id() )
-                return false;
-
-            if ( thread_input.joinable() )
-                thread_input.join();
-
-            thread_input = std::move(std::thread([this]{
-                clear();
-                io.run_input();
-            }));
-
-            on_connect();
-        }
+        clear();
+        io->connect(connection_details.server);
     }
 
-    return io.connected();
+    return io->connected() || io->connecting();
 }
 
 bool Darkplaces::reconnect()
@@ -111,151 +157,656 @@ bool Darkplaces::reconnect()
 
 void Darkplaces::clear()
 {
+    challenge_timer.cancel();
+    pool_timer.cancel();
+    coalesce_timer.cancel();
+    tracking_timer.cancel();
     Lock lock(mutex);
+    coalesce_buffer.clear();
     rcon2_buffer.clear();
+    challenge_pool.clear();
+    prefetch_requests.clear();
+    used_challenge.clear();
+    line_buffer.clear();
+    std::list<TrackedCommand> aborted;
+    aborted.swap(tracked);
+    tracked_count = 0;
+    lock.unlock();
+
+    for ( const auto& command : aborted )
+        on_command_complete(command.result);
 }
 
 bool Darkplaces::connected() const
 {
-    return io.connected();
+    return io->connected();
 }
 
-void Darkplaces::read(const std::string& datagram)
+bool Darkplaces::connecting() const
 {
-    if ( datagram.size() < 5 || datagram.substr(0,4) != "\xff\xff\xff\xff" )
+    return io->connecting();
+}
+
+void Darkplaces::read(const std::vector<StringView>& datagrams,
+                      const std::vector<network::WallTime>& arrivals)
+{
+    if ( capture.is_open() )
+    {
+        for ( std::size_t i = 0; i < datagrams.size(); i++ )
+            capture.write(datagrams[i], arrivals[i]);
+        // Once per batch, captures are for when things go wrong
+        capture.flush();
+    }
+
+    bool log_started = false;
+    for ( std::size_t i = 0; i < datagrams.size(); i++ )
+        read(datagrams[i], arrivals[i], log_started);
+    if ( log_started )
+        on_log_end();
+}
+
+void Darkplaces::read(StringView datagram, network::WallTime arrival, bool& log_started)
+{
+    if ( datagram.size() < 5 || !datagram.starts_with(header) )
     {
-        on_network_error("Invalid datagram: "+datagram);
+        on_network_error("Invalid datagram: "+datagram.str());
         return;
     }
 
     // non-log/rcon output
     if ( datagram[4] != 'n' )
     {
-        auto space = std::find(datagram.begin(), datagram.end(), ' ');
-        std::string command(datagram.begin()+4, space);
-        std::string message;
-        if ( space != datagram.end() )
-            message = std::string(space+1, datagram.end());
+        // Responses to queries put the command on its own line
+        StringView packet = datagram.substr(4);
+        auto separator = std::min(packet.find(' '), packet.find('\n'));
+        StringView command = packet.substr(0, separator);
+        StringView message;
+        if ( separator != StringView::npos )
+            message = packet.substr(separator+1);
 
         if ( command == "challenge" )
-            handle_challenge(message.substr(0,11));
+            handle_challenge(message.substr(0,11).str());
+        else if ( command == "infoResponse" )
+            handle_info(message, false);
+        else if ( command == "statusResponse" )
+            handle_info(message, true);
 
-        on_receive(command, message);
+        on_receive(command.str(), message.str());
         return;
     }
 
-    Lock lock(mutex);
-    std::istringstream socket_stream(line_buffer+datagram.substr(5));
-    line_buffer.clear();
-    lock.unlock();
+    if ( !log_started )
+    {
+        log_started = true;
+        on_log_begin();
+    }
 
-    on_log_begin();
+    // Split the lines in place, only the incomplete tail is copied
+    StringView log = datagram.substr(5);
+    auto newline = log.find('\n');
 
-    // convert the datagram into lines
-    std::string line;
-    while (socket_stream)
+    if ( !line_buffer.empty() )
     {
-        std::getline(socket_stream,line);
-        if (socket_stream.eof())
+        line_buffer.append(log.data(), std::min(newline, log.size()));
+        if ( newline == StringView::npos )
+            return;
+        receive_line(line_buffer, line_arrival);
+        line_buffer.clear();
+        log.remove_prefix(newline+1);
+        newline = log.find('\n');
+    }
+
+    while ( newline != StringView::npos )
+    {
+        receive_line(log.substr(0, newline), arrival);
+        log.remove_prefix(newline+1);
+        newline = log.find('\n');
+    }
+
+    line_buffer.assign(log.data(), log.size());
+    line_arrival = arrival;
+}
+
+void Darkplaces::receive_line(StringView line, network::WallTime arrival)
+{
+    if ( tracked_count.load() == 0 || !track_output(line) )
+        on_receive_log(line, arrival);
+}
+
+bool Darkplaces::track_output(StringView line)
+{
+    Lock lock(mutex);
+    if ( !line.starts_with(marker_prefix) )
+    {
+        // Output belongs to the most recently started command
+        for ( auto it = tracked.rbegin(); it != tracked.rend(); ++it )
         {
-            if (!line.empty())
+            if ( it->begun )
             {
-                lock.lock();
-                line_buffer = line;
-                lock.unlock();
+                it->result.output.push_back(line.str());
+                break;
             }
-            break;
         }
-        on_receive_log(line);
+        return false;
+    }
+
+    // Markers are "<prefix><id>_begin" and "<prefix><id>_end", echo adds a trailing space
+    std::string marker = line.substr(marker_prefix.size()).str();
+    auto separator = marker.find('_');
+    if ( separator == std::string::npos )
+        return false;
+    uint64_t id = std::strtoull(marker.c_str(), nullptr, 10);
+    std::string kind = marker.substr(separator+1);
+    kind.erase(kind.find_last_not_of(' ')+1);
+
+    auto it = std::find_if(tracked.begin(), tracked.end(),
+        [id](const TrackedCommand& command) { return command.result.id == id; });
+    // Markers for commands which have timed out are filtered all the same
+    if ( it == tracked.end() )
+        return true;
+
+    if ( kind == "begin" )
+    {
+        it->begun = true;
+        return true;
     }
 
-    on_log_end();
+    CommandResult result = std::move(it->result);
+    result.latency = network::Clock::now() - it->sent;
+    result.completed = true;
+    latency.record(result.latency);
+    tracked.erase(it);
+    tracked_count = tracked.size();
+    lock.unlock();
+
+    on_command_complete(result);
+    return true;
+}
+
+void Darkplaces::tracking_timeout()
+{
+    Lock lock(mutex);
+    auto now = network::Clock::now();
+    std::vector<CommandResult> expired;
+    network::Time next_timeout = network::Time::max();
+    for ( auto it = tracked.begin(); it != tracked.end(); )
+    {
+        network::Time deadline = it->sent + command_timeout;
+        if ( deadline <= now )
+        {
+            it->result.latency = now - it->sent;
+            expired.push_back(std::move(it->result));
+            it = tracked.erase(it);
+        }
+        else
+        {
+            next_timeout = std::min(next_timeout, deadline);
+            ++it;
+        }
+    }
+    tracked_count = tracked.size();
+    lock.unlock();
+
+    if ( next_timeout != network::Time::max() )
+        tracking_timer.start(next_timeout - now);
+
+    for ( const auto& result : expired )
+        on_command_complete(result);
+}
+
+void Darkplaces::request_info(bool players, network::SendPriority priority)
+{
+    std::string challenge = random_challenge();
+
+    Lock lock(mutex);
+    info_challenge = challenge;
+    info_sent = network::Clock::now();
+    lock.unlock();
+
+    write(info_query(players, challenge), priority);
+}
+
+void Darkplaces::handle_info(StringView message, bool players)
+{
+    ServerInfo info;
+    parse_server_info(message, players, info);
+
+    Lock lock(mutex);
+    // Ignore stale or unsolicited responses
+    if ( info_challenge.empty() || info.value("challenge") != info_challenge )
+        return;
+    info_challenge.clear();
+    info.latency = network::Clock::now() - info_sent;
+    lock.unlock();
+
+    on_server_info(info);
 }
 
 void Darkplaces::handle_challenge(const std::string& challenge)
 {
     Lock lock(mutex);
-    if ( rcon2_buffer.empty() || challenge.empty() ||
+    if ( challenge.empty() ||
         connection_details.rcon_secure != xonotic::ConnectionDetails::CHALLENGE)
         return;
 
-    auto rcon_command = rcon2_buffer.front();
-    if ( !rcon_command.challenged ||
-        rcon_command.timeout < network::Clock::now() )
+    // Challenges aren't tagged, a reply satisfies a prefetch request first
+    if ( !prefetch_requests.empty() )
+        prefetch_requests.pop_front();
+
+    // The server sends the same challenge until it's used, this reply was
+    // sent before the last command arrived and a new request gets a fresh one
+    if ( challenge == used_challenge )
     {
-        rcon2_buffer.front().challenged = false;
         lock.unlock();
         request_challenge();
         return;
     }
 
+    if ( rcon2_buffer.empty() )
+    {
+        // Nothing to sign now, keep it for later
+        challenge_pool.clear();
+        challenge_pool.push_back({challenge,
+            network::Clock::now() + challenge_policy.lifetime});
+        return;
+    }
+
+    // The first command waiting for one gets it
+    std::string command = std::move(rcon2_buffer.front().command);
+    auto priority = rcon2_buffer.front().priority;
     rcon2_buffer.pop_front();
-    bool request_new_challenge = !rcon2_buffer.empty();
+    challenge_pool.clear();
+    used_challenge = challenge;
     lock.unlock();
 
-    std::string challenge_command = challenge+' '+rcon_command.command;
-    std::string key = hmac_md4(challenge_command, connection_details.rcon_password);
-    write("srcon HMAC-MD4 CHALLENGE "+key+' '+challenge_command);
+    send_challenged(challenge, command, priority);
 
-    if ( request_new_challenge )
-        request_challenge();
+    request_challenge();
+}
 
+void Darkplaces::send_challenged(const std::string& challenge, const std::string& command,
+                                 network::SendPriority priority)
+{
+    std::string challenge_command = challenge+' '+command;
+    Lock lock(mutex);
+    std::string key = signer.sign(challenge_command);
+    lock.unlock();
+    write("srcon HMAC-MD4 CHALLENGE "+key+' '+challenge_command, priority);
 }
 
 void Darkplaces::request_challenge()
 {
     Lock lock(mutex);
-    if ( !rcon2_buffer.empty() && !rcon2_buffer.front().challenged )
+    if ( connection_details.rcon_secure != xonotic::ConnectionDetails::CHALLENGE )
+        return;
+
+    auto now = network::Clock::now();
+    while ( !challenge_pool.empty() && challenge_pool.front().expires <= now )
+        challenge_pool.pop_front();
+    while ( !prefetch_requests.empty() && prefetch_requests.front() <= now )
+        prefetch_requests.pop_front();
+
+    // Commands which can be sent right away
+    std::vector<std::string> ready;
+    std::vector<network::SendPriority> ready_priority;
+    while ( !challenge_pool.empty() && !rcon2_buffer.empty() )
+    {
+        used_challenge = challenge_pool.front().challenge;
+        ready.push_back(used_challenge+' '+rcon2_buffer.front().command);
+        ready_priority.push_back(rcon2_buffer.front().priority);
+        challenge_pool.pop_front();
+        rcon2_buffer.pop_front();
+    }
+    std::vector<std::string> keys = signer.sign_batch(ready);
+
+    // Requests made in advance count, their replies go to the waiting commands
+    unsigned in_flight = prefetch_requests.size();
+    unsigned requests = 0;
+    auto request_priority = network::SendPriority::Background;
+    for ( auto& command : rcon2_buffer )
+    {
+        if ( in_flight >= challenge_policy.pipeline )
+            break;
+        if ( !command.challenged )
+        {
+            command.challenged = true;
+            command.attempts++;
+            command.timeout = now + challenge_policy.timeout;
+            requests++;
+            if ( command.priority == network::SendPriority::Interactive )
+                request_priority = network::SendPriority::Interactive;
+        }
+        in_flight++;
+    }
+
+    unsigned prefetch = 0;
+    if ( io->connected() && rcon2_buffer.empty() )
+    {
+        std::size_t available = challenge_pool.size() + prefetch_requests.size();
+        if ( available < challenge_policy.prefetch )
+            prefetch = challenge_policy.prefetch - available;
+        for ( unsigned i = 0; i < prefetch; i++ )
+            prefetch_requests.push_back(now + challenge_policy.timeout);
+    }
+
+    network::Time refill = network::Time::max();
+    if ( !challenge_pool.empty() )
+        refill = challenge_pool.front().expires;
+    if ( !prefetch_requests.empty() )
+        refill = std::min(refill, prefetch_requests.front());
+    auto timeout = challenge_policy.timeout;
+    lock.unlock();
+
+    for ( std::size_t i = 0; i < ready.size(); i++ )
+        write("srcon HMAC-MD4 CHALLENGE "+keys[i]+' '+ready[i], ready_priority[i]);
+
+    for ( unsigned i = 0; i < requests; i++ )
+        write("getchallenge", request_priority);
+    for ( unsigned i = 0; i < prefetch; i++ )
+        write("getchallenge", network::SendPriority::Background);
+
+    if ( requests )
+        challenge_timer.start_before(timeout);
+    if ( refill != network::Time::max() )
+        pool_timer.start_before(refill - now);
+}
+
+void Darkplaces::challenge_timeout()
+{
+    Lock lock(mutex);
+    auto now = network::Clock::now();
+    std::vector<std::string> expired;
+    bool pending = false;
+    network::Time next_timeout = network::Time::max();
+    for ( auto it = rcon2_buffer.begin(); it != rcon2_buffer.end(); )
     {
-        rcon2_buffer.front().challenged = true;
-        /// \todo timeout from settings
-        rcon2_buffer.front().timeout = network::Clock::now() + std::chrono::seconds(5);
-        write("getchallenge");
+        if ( !it->challenged )
+        {
+            ++it;
+        }
+        else if ( it->timeout > now )
+        {
+            pending = true;
+            next_timeout = std::min(next_timeout, it->timeout);
+            ++it;
+        }
+        else if ( it->attempts > challenge_policy.retries )
+        {
+            expired.push_back(std::move(it->command));
+            it = rcon2_buffer.erase(it);
+        }
+        else
+        {
+            it->challenged = false;
+            ++it;
+        }
     }
+    lock.unlock();
+
+    for ( const auto& command : expired )
+        on_network_error("No challenge received for: "+command);
+
+    if ( pending )
+        challenge_timer.start(next_timeout - now);
+    request_challenge();
 }
 
 void Darkplaces::set_details(const ConnectionDetails& details)
 {
     bool should_reconnect = details.server != connection_details.server;
+    if ( details.rcon_password != connection_details.rcon_password )
+    {
+        Lock lock(mutex);
+        signer.set_key(details.rcon_password);
+    }
     connection_details = details;
     if ( should_reconnect )
         reconnect();
 }
 
-void Darkplaces::rcon_command(std::string command)
+void Darkplaces::rcon_command(std::string command, network::SendPriority priority)
 {
-    command.erase(std::remove_if(command.begin(), command.end(),
-        [](char c){return c == '\n' || c == '\0' || c == '\xff';}),
-        command.end());
+    sanitize_command(command);
+    queue_rcon(std::move(command), priority);
+}
+
+uint64_t Darkplaces::rcon_command_tracked(std::string command, network::SendPriority priority)
+{
+    sanitize_command(command);
 
+    Lock lock(mutex);
+    uint64_t id = ++next_command_id;
+    TrackedCommand tracked_command;
+    tracked_command.result.id = id;
+    tracked_command.result.command = command;
+    tracked_command.sent = network::Clock::now();
+    tracked.push_back(std::move(tracked_command));
+    tracked_count = tracked.size();
+    auto timeout = command_timeout;
+    lock.unlock();
+
+    std::string marker = "echo "+marker_prefix+std::to_string(id);
+    if ( can_coalesce(command) )
+    {
+        queue_rcon(marker+"_begin;"+command+';'+marker+"_end", priority);
+    }
+    else
+    {
+        // The end marker would be swallowed by an open quote or a comment
+        queue_rcon(marker+"_begin", priority);
+        queue_rcon(std::move(command), priority);
+        queue_rcon(marker+"_end", priority);
+    }
+
+    tracking_timer.start_before(timeout);
+    return id;
+}
+
+void Darkplaces::queue_rcon(std::string command, network::SendPriority priority)
+{
+    Lock lock(mutex);
+    if ( coalesce_window > network::Clock::duration::zero() )
+    {
+        coalesce_buffer.emplace_back(std::move(command), priority);
+        auto window = coalesce_window;
+        lock.unlock();
+        // The window starts with the first command held
+        coalesce_timer.start_before(window);
+        return;
+    }
+    lock.unlock();
+
+    send_rcon(std::move(command), priority);
+}
+
+void Darkplaces::send_rcon(std::string command, network::SendPriority priority)
+{
     if ( connection_details.rcon_secure == xonotic::ConnectionDetails::NO )
     {
-        write("rcon "+connection_details.rcon_password+' '+command);
+        write("rcon "+connection_details.rcon_password+' '+command, priority);
     }
     else if ( connection_details.rcon_secure == xonotic::ConnectionDetails::TIME )
     {
         auto message = std::to_string(std::time(nullptr))+".000000 "+command;
-        write("srcon HMAC-MD4 TIME "+
-            hmac_md4(message, connection_details.rcon_password)
-            +' '+message);
+        Lock lock(mutex);
+        std::string key = signer.sign(message);
+        lock.unlock();
+        write("srcon HMAC-MD4 TIME "+key+' '+message, priority);
     }
     else if ( connection_details.rcon_secure == xonotic::ConnectionDetails::CHALLENGE )
     {
         Lock lock(mutex);
-        rcon2_buffer.push_back(command);
+        // Interactive commands go ahead of background ones
+        auto position = rcon2_buffer.end();
+        if ( priority == network::SendPriority::Interactive )
+            position = std::find_if(rcon2_buffer.begin(), rcon2_buffer.end(),
+                [](const Rcon2Command& queued) {
+                    return queued.priority == network::SendPriority::Background;
+                });
+        rcon2_buffer.insert(position, Rcon2Command(std::move(command), priority));
         lock.unlock();
         request_challenge();
     }
 }
 
-void Darkplaces::write(std::string line)
+void Darkplaces::write(std::string line, network::SendPriority priority)
 {
-    io.write(header+line);
+    io->write(header+line, priority);
 }
 
 network::Server Darkplaces::local_endpoint() const
 {
-    return io.local_endpoint();
+    return io->local_endpoint();
+}
+
+void Darkplaces::set_challenge_policy(const ChallengePolicy& policy)
+{
+    Lock lock(mutex);
+    challenge_policy = policy;
+    challenge_policy.pipeline = std::max(challenge_policy.pipeline, 1u);
+    // A second challenge from the same server would be stale as soon as one is used
+    challenge_policy.prefetch = std::min(challenge_policy.prefetch, 1u);
+}
+
+void Darkplaces::set_receive_batch_size(std::size_t size)
+{
+    io->receive_batch_size(size);
+}
+
+void Darkplaces::set_receive_buffer_size(std::size_t initial, std::size_t maximum)
+{
+    io->receive_buffer_size(initial, maximum);
+}
+
+void Darkplaces::set_shared_socket(network::SharedSocket* socket)
+{
+    io->shared_socket(socket);
+}
+
+void Darkplaces::set_read_mode(network::ReadMode mode)
+{
+    io->read_mode(mode);
+}
+
+void Darkplaces::read_available()
+{
+    io->read_available();
+}
+
+network::ReceiveStatistics Darkplaces::receive_statistics() const
+{
+    return io->receive_statistics();
+}
+
+void Darkplaces::set_send_rate(double rate, double burst)
+{
+    io->send_rate(rate, burst);
+}
+
+network::SendStatistics Darkplaces::send_statistics() const
+{
+    return io->send_statistics();
+}
+
+void Darkplaces::set_coalesce_window(network::Clock::duration window)
+{
+    Lock lock(mutex);
+    coalesce_window = window;
+    lock.unlock();
+
+    if ( window <= network::Clock::duration::zero() )
+    {
+        coalesce_timer.cancel();
+        flush_coalesced();
+    }
+}
+
+uint64_t Darkplaces::coalesced_packets() const
+{
+    return packets_saved;
+}
+
+network::LatencyHistogram Darkplaces::command_latency() const
+{
+    Lock lock(mutex);
+    return latency;
+}
+
+bool Darkplaces::start_capture(const std::string& path)
+{
+    return capture.open(path);
+}
+
+void Darkplaces::stop_capture()
+{
+    capture.close();
+}
+
+bool Darkplaces::capturing() const
+{
+    return capture.is_open();
+}
+
+void Darkplaces::flush_coalesced()
+{
+    Lock lock(mutex);
+    std::vector<std::pair<std::string, network::SendPriority>> commands;
+    commands.swap(coalesce_buffer);
+    lock.unlock();
+
+    if ( commands.empty() )
+        return;
+
+    std::size_t max_size = io->max_datagram_size();
+    std::size_t overhead = rcon_overhead();
+    max_size = max_size > overhead ? max_size - overhead : 0;
+
+    std::string datagram;
+    // A datagram with any interactive command is interactive
+    auto priority = network::SendPriority::Background;
+    bool open = false;      // Whether more commands can be appended to datagram
+    uint64_t datagrams = 0;
+    for ( auto& command : commands )
+    {
+        if ( open && datagram.size() + 1 + command.first.size() <= max_size )
+        {
+            datagram += ';';
+            datagram += command.first;
+            if ( command.second == network::SendPriority::Interactive )
+                priority = command.second;
+        }
+        else
+        {
+            if ( datagrams > 0 )
+                send_rcon(std::move(datagram), priority);
+            datagram = std::move(command.first);
+            priority = command.second;
+            datagrams++;
+        }
+        open = can_coalesce(datagram);
+    }
+    send_rcon(std::move(datagram), priority);
+
+    packets_saved += commands.size() - datagrams;
+}
+
+std::size_t Darkplaces::rcon_overhead() const
+{
+    // Timestamps and challenges vary in length, these are upper bounds
+    const std::size_t max_time = 32;
+    const std::size_t max_challenge = 64;
+    const std::size_t signature = Md4::digest_size + 1;
+
+    switch ( connection_details.rcon_secure )
+    {
+        case xonotic::ConnectionDetails::NO:
+            return header.size() + std::strlen("rcon ") + connection_details.rcon_password.size() + 1;
+        case xonotic::ConnectionDetails::TIME:
+            return header.size() + std::strlen("srcon HMAC-MD4 TIME ") + signature + max_time + 1;
+        case xonotic::ConnectionDetails::CHALLENGE:
+        default:
+            return header.size() + std::strlen("srcon HMAC-MD4 CHALLENGE ") + signature + max_challenge + 1;
+    }
 }
 
 } // namespace xonotic
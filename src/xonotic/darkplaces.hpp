@@ -24,23 +24,82 @@
 #ifndef DARKPLACES_HPP
 #define DARKPLACES_HPP
 
-#include <thread>
+#include <atomic>
+#include <deque>
 #include <mutex>
 #include <list>
+#include <memory>
+#include <vector>
 
 #include "connection_details.hpp"
-#include "network/udp_io.hpp"
+#include "hmac_md4.hpp"
+#include "server_info.hpp"
+#include "network/capture.hpp"
+#include "network/latency_histogram.hpp"
+#include "network/transport.hpp"
+#include "network/timer.hpp"
 #include "network/time.hpp"
 
 namespace xonotic {
 
+/**
+ * \brief How challenges for rcon_secure 2 are requested
+ */
+struct ChallengePolicy
+{
+    /// Time to wait for a challenge before requesting it again
+    network::Clock::duration    timeout = std::chrono::seconds(5);
+    /// Number of times a challenge is requested again before giving up on a command
+    unsigned                    retries = 2;
+    /**
+     * \brief Maximum number of challenges requested at the same time
+     *
+     * Darkplaces keeps one challenge per address and ignores getchallenge
+     * repeated within half a second, so more than one request in flight
+     * only helps with servers which don't.
+     */
+    unsigned                    pipeline = 1;
+    /**
+     * \brief Whether a challenge is kept ready to sign a command without waiting (0 or 1)
+     *
+     * Darkplaces has a single challenge per address, once a command uses
+     * it any other challenge received before is stale.
+     */
+    unsigned                    prefetch = 1;
+    /**
+     * \brief Time after which a prefetched challenge is discarded
+     *
+     * Darkplaces forgets a challenge when other clients need its slot,
+     * commands signed with it are dropped without a reply.
+     */
+    network::Clock::duration    lifetime = std::chrono::seconds(5);
+};
+
+/**
+ * \brief Output of a command run with Darkplaces::rcon_command_tracked()
+ */
+struct CommandResult
+{
+    uint64_t                    id = 0;         ///< Value returned by rcon_command_tracked()
+    std::string                 command;        ///< Command as passed to rcon_command_tracked()
+    std::vector<std::string>    output;         ///< Log lines printed while the command was running
+    network::Clock::duration    latency{0};     ///< Time from the call until the end of the output was received
+    bool                        completed = false; ///< Whether the end of the output was received
+};
+
 class Darkplaces
 {
 private:
     using Lock = std::unique_lock<std::mutex>;
 
 public:
-    explicit Darkplaces(xonotic::ConnectionDetails details);
+    /**
+     * \brief Creates a connection to the server in \p details
+     * \param transport Carries the datagrams to and from the server,
+     *                  if null a network::UdpIo is used
+     */
+    explicit Darkplaces(xonotic::ConnectionDetails details,
+                        std::unique_ptr<network::Transport> transport = nullptr);
 
     virtual ~Darkplaces();
 
@@ -49,6 +108,10 @@ public:
      */
     bool connected() const;
 
+    /**
+     * \brief Whether a connection is being established
+     */
+    bool connecting() const;
 
     /**
      * \brief Returns darkplaces connection details
@@ -62,17 +125,47 @@ public:
 
     /**
      * \brief Runs a rcon command
+     * \param priority Background commands are sent after any interactive one
+     */
+    void rcon_command(std::string command,
+                      network::SendPriority priority = network::SendPriority::Interactive);
+
+    /**
+     * \brief Runs a rcon command and collects its output
+     *
+     * The command is surrounded by echoes of marker lines, which are
+     * not passed to on_receive_log(). Once the closing marker is received,
+     * or the command times out or the connection is closed,
+     * on_command_complete() is called with the lines in between.
+     * \returns The identifier of the command in on_command_complete()
+     */
+    uint64_t rcon_command_tracked(std::string command,
+        network::SendPriority priority = network::SendPriority::Interactive);
+
+    /**
+     * \brief Queries the server status without using rcon
+     *
+     * Sends a connectionless getstatus (or getinfo) query,
+     * on_server_info() is called with the response.
+     * \param players Whether to request the player list
      */
-    void rcon_command(std::string command);
+    void request_info(bool players = true,
+        network::SendPriority priority = network::SendPriority::Background);
 
     /**
      * \brief Writes a raw command to the darkplaces server
+     *
+     * The command is queued and sent asynchronously.
      */
-    void write(std::string line);
+    void write(std::string line,
+               network::SendPriority priority = network::SendPriority::Interactive);
 
     /**
      * \brief Open the connection to the darkplaces server
-     * \returns Whether the connection has been successful
+     *
+     * The server host name is resolved asynchronously,
+     * on_connect() is called once the connection is established.
+     * \returns Whether the connection has been successful or is in progress
      */
     bool connect();
 
@@ -91,9 +184,101 @@ public:
      */
     network::Server local_endpoint() const;
 
+    /**
+     * \brief Sets how challenges for rcon_secure 2 are requested
+     */
+    void set_challenge_policy(const ChallengePolicy& policy);
+
+    /**
+     * \brief Sets the maximum number of datagrams handled per network wakeup
+     */
+    void set_receive_batch_size(std::size_t size);
+
+    /**
+     * \brief Sets the receive buffer size and the limit it grows to
+     *
+     * Takes effect the next time the connection is established.
+     * \see network::Transport::receive_buffer_size()
+     */
+    void set_receive_buffer_size(std::size_t initial, std::size_t maximum);
+
+    /**
+     * \brief Uses \p socket instead of a dedicated socket, null to disable
+     *
+     * Takes effect the next time the connection is established.
+     */
+    void set_shared_socket(network::SharedSocket* socket);
+
+    /**
+     * \brief Selects what waits for datagrams from the server
+     *
+     * With network::ReadMode::External on_watch_socket() and
+     * on_unwatch_socket() must be implemented.
+     * Takes effect the next time the connection is established.
+     */
+    void set_read_mode(network::ReadMode mode);
+
+    /**
+     * \brief Counters for the datagrams received from the server
+     */
+    network::ReceiveStatistics receive_statistics() const;
+
+    /**
+     * \brief Limits the rate datagrams are sent to the server at
+     *
+     * Darkplaces drops rcon packets arriving too fast,
+     * datagrams exceeding the rate are queued instead.
+     * \param rate  Datagrams per second, 0 to send as fast as possible
+     * \param burst Number of datagrams which can be sent at once
+     */
+    void set_send_rate(double rate, double burst);
+
+    /**
+     * \brief Counters for the datagrams sent to the server
+     */
+    network::SendStatistics send_statistics() const;
+
+    /**
+     * \brief Sets for how long rcon commands are held to be sent together
+     *
+     * Commands issued within the window are joined with ';' into as few
+     * datagrams as the maximum datagram size allows, a single command is
+     * never split. A zero window sends every command right away.
+     */
+    void set_coalesce_window(network::Clock::duration window);
+
+    /**
+     * \brief Number of datagrams saved by joining commands
+     */
+    uint64_t coalesced_packets() const;
+
+    /**
+     * \brief Round trip times of the commands run with rcon_command_tracked()
+     */
+    network::LatencyHistogram command_latency() const;
+
+    /**
+     * \brief Starts writing every received datagram to a capture file
+     *
+     * The capture can be replayed with network::ReplayTransport.
+     * \returns \b false if \p path can't be written
+     */
+    bool start_capture(const std::string& path);
+
+    /**
+     * \brief Finishes the capture started by start_capture()
+     */
+    void stop_capture();
+
+    /**
+     * \brief Whether received datagrams are being captured
+     */
+    bool capturing() const;
+
 protected:
     /**
      * \brief Called after a successful connection
+     * \note Might be called from the network thread
      */
     virtual void on_connect() {}
 
@@ -109,7 +294,7 @@ protected:
     virtual void on_disconnecting() {}
 
     /**
-     * \brief Called when received a datagram containing some log
+     * \brief Called when received a batch of datagrams containing some log
      *
      * will follow several calls to on_receive_log() (one per log line)
      * and on_log_end()
@@ -117,7 +302,7 @@ protected:
     virtual void on_log_begin() {}
 
     /**
-     * \brief Called when received a datagram containing some log
+     * \brief Called when received a batch of datagrams containing some log
      *
      * After on_log_begin() and on_receive_log()
      */
@@ -125,8 +310,13 @@ protected:
 
     /**
      * \brief Called after receiving a log line
+     *
+     * \p line refers to the network buffer and is only valid for the
+     * duration of the call.
+     * \p arrival is the time the datagram with the start of the line
+     * has been received (see network::Transport::on_async_receive).
      */
-    virtual void on_receive_log(const std::string& line) {}
+    virtual void on_receive_log(StringView line, network::WallTime arrival) {}
 
     /**
      * \brief Called after receiving a message other than log
@@ -138,6 +328,44 @@ protected:
      */
     virtual void on_network_error(const std::string& msg) {}
 
+    /**
+     * \brief Called with a message from the transport which isn't an error
+     */
+    virtual void on_network_status(const std::string& msg) {}
+
+    /**
+     * \brief Called when a command from rcon_command_tracked() has completed
+     * \note Might be called from the network thread
+     */
+    virtual void on_command_complete(const CommandResult& result) {}
+
+    /**
+     * \brief Called on a response to request_info()
+     * \note Called from the network thread
+     */
+    virtual void on_server_info(const ServerInfo& info) {}
+
+    /**
+     * \brief Called with network::ReadMode::External once the socket is open
+     *
+     * read_available() must be called whenever \p handle is readable.
+     * \note Might be called from a resolver thread
+     */
+    virtual void on_watch_socket(network::Transport::NativeHandle handle) {}
+
+    /**
+     * \brief Called with network::ReadMode::External before the socket is closed
+     */
+    virtual void on_unwatch_socket() {}
+
+    /**
+     * \brief Handles the datagrams waiting on the socket
+     *
+     * Only with network::ReadMode::External, the other callbacks are
+     * invoked from the calling thread.
+     */
+    void read_available();
+
 private:
     /**
      * \brief Clear connection data
@@ -145,9 +373,18 @@ private:
     void clear();
 
     /**
-     * \brief Handles a Xonotic datagram
+     * \brief Handles a batch of Xonotic datagrams
      */
-    void read(const std::string& datagram);
+    void read(const std::vector<StringView>& datagrams,
+              const std::vector<network::WallTime>& arrivals);
+
+    /**
+     * \brief Handles a single Xonotic datagram
+     * \param arrival     Time the datagram has been received
+     * \param log_started Whether on_log_begin() has been called for the
+     *                    current batch, updated if the datagram contains log
+     */
+    void read(StringView datagram, network::WallTime arrival, bool& log_started);
 
     /**
      * \brief Handles a challenge recived from the server to be used in rcon_secure 2
@@ -155,29 +392,128 @@ private:
     void handle_challenge(const std::string& challenge);
 
     /**
-     * \brief Asks the server for a challenge to be used in rcon_secure 2
+     * \brief Asks the server for challenges to be used in rcon_secure 2
+     *
+     * Sends queued commands with prefetched challenges, keeps up to
+     * ChallengePolicy::pipeline requests in flight for the remaining ones
+     * and refills the prefetched challenges.
      */
     void request_challenge();
 
+    /**
+     * \brief Sends a command signed with the given challenge
+     */
+    void send_challenged(const std::string& challenge, const std::string& command,
+                         network::SendPriority priority);
+
+    /**
+     * \brief Retries or discards commands whose challenge didn't arrive in time
+     */
+    void challenge_timeout();
+
+    /**
+     * \brief Sends a rcon command in its own datagram
+     */
+    void send_rcon(std::string command, network::SendPriority priority);
+
+    /**
+     * \brief Sends the commands held by the coalescing window
+     */
+    void flush_coalesced();
+
+    /**
+     * \brief Upper bound of the bytes in a rcon datagram besides the command
+     */
+    std::size_t rcon_overhead() const;
+
+    /**
+     * \brief Sends a sanitized rcon command, holding it in the coalescing window if enabled
+     */
+    void queue_rcon(std::string command, network::SendPriority priority);
+
+    /**
+     * \brief Passes a log line to on_receive_log() unless it's a command marker
+     */
+    void receive_line(StringView line, network::WallTime arrival);
+
+    /**
+     * \brief Assigns \p line to the tracked commands
+     * \returns Whether the line is a command marker
+     */
+    bool track_output(StringView line);
+
+    /**
+     * \brief Completes the tracked commands which have been waiting for too long
+     */
+    void tracking_timeout();
+
+    /**
+     * \brief Handles infoResponse and statusResponse
+     */
+    void handle_info(StringView message, bool players);
+
+    /**
+     * \brief A command run with rcon_command_tracked()
+     */
+    struct TrackedCommand
+    {
+        CommandResult   result;
+        network::Time   sent;
+        bool            begun = false;  ///< Whether the opening marker has been received
+    };
+
     /**
      * \brief A command to be used with rcon_secure >= 2
      */
     struct Rcon2Command
     {
         std::string     command;        ///< Raw command string
+        network::SendPriority priority;
         bool            challenged;     ///< Whether a challenge has been sent
+        unsigned        attempts;       ///< Number of challenges requested
         network::Time   timeout;        ///< Challenge timeout
-        Rcon2Command(std::string command)
-            : command(std::move(command)), challenged(false) {}
+        Rcon2Command(std::string command, network::SendPriority priority)
+            : command(std::move(command)), priority(priority),
+              challenged(false), attempts(0) {}
     };
 
-    std::mutex                  mutex;
+    mutable std::mutex          mutex;
     std::string                 header{"\xff\xff\xff\xff"};     ///< Connection message header
-    std::string                 line_buffer;                    ///< Buffer for overflowing messages from Xonotic
+    std::string                 line_buffer;                    ///< Buffer for overflowing messages from Xonotic (only used by read())
+    network::WallTime           line_arrival;                   ///< Time the start of \c line_buffer has been received
     xonotic::ConnectionDetails  connection_details;
-    network::UdpIo              io;
-    std::thread                 thread_input;
+    HmacMd4Signer               signer;                         ///< Signs secure rcon commands with the rcon password
+    std::unique_ptr<network::Transport> io;
+    network::CaptureWriter      capture;                        ///< Records the received datagrams when open
+    /**
+     * \brief Challenge received in advance
+     */
+    struct PooledChallenge
+    {
+        std::string     challenge;
+        network::Time   expires;
+    };
+
     std::list<Rcon2Command>     rcon2_buffer;                   ///< Buffer for rcon_secure 2 messages to be challenged
+    ChallengePolicy             challenge_policy;
+    network::Timer              challenge_timer;                ///< Expires on the earliest challenge timeout
+    std::deque<PooledChallenge> challenge_pool;                 ///< Challenge ready to be used, if any
+    std::string                 used_challenge;                 ///< Challenge of the last command sent
+    std::deque<network::Time>   prefetch_requests;              ///< Timeouts of the requests to refill \c challenge_pool
+    network::Timer              pool_timer;                     ///< Expires when \c challenge_pool needs a refill
+    network::Clock::duration    coalesce_window{0};             ///< Time commands are held to be joined
+    std::vector<std::pair<std::string, network::SendPriority>>
+                                coalesce_buffer;                ///< Commands waiting for the coalescing window
+    network::Timer              coalesce_timer;                 ///< Expires at the end of the coalescing window
+    std::atomic<uint64_t>       packets_saved{0};               ///< Datagrams saved by joining commands
+    std::list<TrackedCommand>   tracked;                        ///< Commands waiting for their output, oldest first
+    std::atomic<std::size_t>    tracked_count{0};               ///< Size of \c tracked, read without locking
+    uint64_t                    next_command_id = 0;
+    network::Clock::duration    command_timeout = std::chrono::seconds(10); ///< Time after which a tracked command is given up
+    network::Timer              tracking_timer;                 ///< Expires on the earliest tracked command timeout
+    network::LatencyHistogram   latency;                        ///< Round trip times of tracked commands
+    std::string                 info_challenge;                 ///< Token expected in the response to request_info()
+    network::Time               info_sent;                      ///< When the last request_info() query was sent
 };
 
 } // namespace xonotic
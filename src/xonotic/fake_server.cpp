@@ -0,0 +1,516 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "fake_server.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <random>
+
+#include "server_info.hpp"
+
+namespace xonotic {
+
+/**
+ * \brief Number of challenges the server remembers, as in Darkplaces
+ */
+static const std::size_t max_challenges = 128;
+
+/**
+ * \brief Time in which getchallenge from the same address is ignored,
+ *  as net_challengefloodblockingtimeout
+ */
+static const std::chrono::milliseconds challenge_flood_window(500);
+
+/**
+ * \brief Seconds a srcon TIME request can be off, as rcon_secure_maxdiff
+ */
+static const double max_time_difference = 300;
+
+std::string fake_log_line(uint64_t index)
+{
+    std::string player = "^3Player " + std::to_string(index % 32) + "^7";
+    std::string victim = "^1Player " + std::to_string((index + 7) % 32) + "^7";
+    switch ( index % 4 )
+    {
+        case 0:
+            return player + ": message " + std::to_string(index);
+        case 1:
+            return victim + " was blasted by " + player + "'s Vortex";
+        case 2:
+            return ":kill:frag:" + std::to_string(index % 32 + 1) + ':' +
+                std::to_string((index + 7) % 32 + 1) + ":type=" + std::to_string(index);
+        default:
+            return player + " ^7has picked up the ^1Mega Health (" + std::to_string(index) + ')';
+    }
+}
+
+std::vector<std::string> tokenize_command(const std::string& command)
+{
+    std::vector<std::string> args;
+    std::string::size_type pos = 0;
+    while ( true )
+    {
+        while ( pos < command.size() && std::isspace((unsigned char)command[pos]) )
+            pos++;
+        if ( pos >= command.size() )
+            break;
+
+        if ( command[pos] == '"' )
+        {
+            auto end = command.find('"', pos+1);
+            args.push_back(command.substr(pos+1, end == std::string::npos ? end : end-pos-1));
+            pos = end == std::string::npos ? end : end+1;
+        }
+        else
+        {
+            auto end = pos;
+            while ( end < command.size() && !std::isspace((unsigned char)command[end]) )
+                end++;
+            args.push_back(command.substr(pos, end-pos));
+            pos = end;
+        }
+    }
+    return args;
+}
+
+std::vector<std::string> split_commands(const std::string& input)
+{
+    std::vector<std::string> commands;
+    std::string current;
+    bool quoted = false;
+    for ( std::string::size_type i = 0; i < input.size(); i++ )
+    {
+        char c = input[i];
+        if ( c == '"' )
+        {
+            quoted = !quoted;
+        }
+        else if ( !quoted && c == '/' && i+1 < input.size() && input[i+1] == '/' )
+        {
+            i = input.find('\n', i);
+            if ( i == std::string::npos )
+                break;
+            c = '\n';
+        }
+
+        if ( c == '\n' || (!quoted && c == ';') )
+        {
+            commands.push_back(std::move(current));
+            current.clear();
+            quoted = false;
+        }
+        else
+        {
+            current += c;
+        }
+    }
+    commands.push_back(std::move(current));
+    return commands;
+}
+
+FakeServer::FakeServer(const std::string& rcon_password)
+{
+    set_rcon(rcon_password, 0);
+    set_cvar("hostname", "Fake Xonotic Server", "server message to show in server browser");
+    set_cvar("sv_maxclients", "16", "maximum number of clients");
+    set_cvar("log_dest_udp", "", "UDP address to log messages to");
+
+    script("echo", [this](const std::vector<std::string>& args) {
+        for ( const auto& arg : args )
+            print(arg+' ');
+        print("\n");
+    });
+    script("set", [this](const std::vector<std::string>& args) {
+        if ( args.size() < 2 )
+            print("set <variable> <value> [numberofvalues]\n");
+        else
+            set_cvar(args[0], args[1], args.size() > 2 ? args[2] : "");
+    });
+    script("status", [this](const std::vector<std::string>&) {
+        status();
+    });
+    script("cvarlist", [this](const std::vector<std::string>& args) {
+        cvarlist(args);
+    });
+    script("qc_cmd_sv", [this](const std::vector<std::string>& args) {
+        if ( args.size() == 3 && args[0] == "addtolist" )
+            edit_list(args, true);
+        else if ( args.size() == 3 && args[0] == "removefromlist" )
+            edit_list(args, false);
+        else
+            print("Unknown server command \""+(args.empty() ? "" : args[0])+"\"\n");
+    });
+}
+
+void FakeServer::set_rcon(const std::string& password, int secure)
+{
+    rcon_password = password;
+    rcon_secure = secure;
+    signer.set_key(password);
+}
+
+void FakeServer::script(const std::string& name, Handler handler)
+{
+    commands[name] = std::move(handler);
+}
+
+void FakeServer::set_cvar(const std::string& name, const std::string& value,
+                          const std::string& description)
+{
+    auto it = cvars.find(name);
+    if ( it == cvars.end() )
+        cvars[name] = {value, value, description.empty() ? "custom cvar" : description};
+    else
+        it->second.value = value;
+}
+
+std::string FakeServer::cvar(const std::string& name) const
+{
+    auto it = cvars.find(name);
+    return it == cvars.end() ? std::string() : it->second.value;
+}
+
+void FakeServer::populate(std::size_t player_count, std::size_t cvar_count, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> ping(10, 250);
+    std::uniform_int_distribution<int> frags(-5, 60);
+    std::uniform_int_distribution<int> minutes(0, 59);
+    std::uniform_int_distribution<int> octet(1, 254);
+
+    players.clear();
+    for ( std::size_t i = 0; i < player_count; i++ )
+    {
+        FakePlayer player;
+        player.ip = "10.0." + std::to_string(octet(random)) + '.' +
+            std::to_string(octet(random)) + ":26000";
+        player.ping = ping(random);
+        player.frags = frags(random);
+        int played = minutes(random);
+        player.time = (played < 10 ? "0:0" : "0:") + std::to_string(played) + ":00";
+        player.entity = i + 1;
+        player.name = '^' + std::to_string(i % 10) + "Player " + std::to_string(i);
+        player.team = i % 2 + 1;
+        players.push_back(player);
+    }
+    set_cvar("sv_maxclients", std::to_string(std::max<std::size_t>(player_count, 16)));
+
+    for ( std::size_t i = 0; i < cvar_count; i++ )
+        set_cvar("fake_cvar_" + std::to_string(i), std::to_string(random() % 1000),
+                 "generated cvar number " + std::to_string(i));
+}
+
+void FakeServer::receive(const std::string& address, StringView datagram)
+{
+    stats.received++;
+    if ( !datagram.starts_with(header) )
+        return;
+    StringView request = datagram.substr(header.size());
+
+    if ( request == "getchallenge" )
+    {
+        send_challenge(address);
+    }
+    else if ( request.starts_with("getinfo") )
+    {
+        send_info(address, false, request.substr(std::min<std::size_t>(8, request.size())));
+    }
+    else if ( request.starts_with("getstatus") )
+    {
+        send_info(address, true, request.substr(std::min<std::size_t>(10, request.size())));
+    }
+    else if ( request.starts_with("rcon ") || request.starts_with("srcon ") )
+    {
+        std::string command;
+        if ( !authenticate(address, request, command) )
+        {
+            stats.rejected++;
+            print("server denied rcon access to "+address+"\n");
+            return;
+        }
+
+        redirect = address;
+        execute(command);
+        flush_output(false);
+        redirect.clear();
+    }
+}
+
+void FakeServer::send_challenge(const std::string& address)
+{
+    auto now = network::Clock::now();
+    auto it = std::find_if(challenges.begin(), challenges.end(),
+        [&address](const Challenge& challenge) { return challenge.address == address; });
+
+    if ( it == challenges.end() )
+    {
+        if ( challenges.size() >= max_challenges )
+            challenges.pop_front();
+        challenges.push_back({address, random_challenge(11), now});
+        it = challenges.end() - 1;
+    }
+    else if ( now - it->sent < challenge_flood_window )
+    {
+        return;
+    }
+    else
+    {
+        // Requested again, the same challenge is sent
+        it->sent = now;
+    }
+
+    send(address, header+"challenge "+it->challenge);
+}
+
+bool FakeServer::authenticate(const std::string& address, StringView request, std::string& command)
+{
+    if ( request.starts_with("rcon ") )
+    {
+        if ( rcon_secure > 0 )
+            return false;
+        request.remove_prefix(5);
+        auto space = request.find(' ');
+        if ( space == StringView::npos || request.substr(0, space) != rcon_password )
+            return false;
+        command = request.substr(space+1).str();
+        return true;
+    }
+
+    bool time = request.starts_with("srcon HMAC-MD4 TIME ");
+    bool challenge = request.starts_with("srcon HMAC-MD4 CHALLENGE ");
+    if ( (!time && !challenge) || (time && rcon_secure > 1) )
+        return false;
+    request.remove_prefix(time ? 20 : 25);
+
+    // Binary digest, a space and the signed message
+    if ( request.size() < Md4::digest_size + 1 || request[Md4::digest_size] != ' ' )
+        return false;
+    StringView key = request.substr(0, Md4::digest_size);
+    StringView message = request.substr(Md4::digest_size + 1);
+    if ( key != StringView(signer.sign(message.data(), message.size())) )
+        return false;
+
+    auto space = message.find(' ');
+    if ( space == StringView::npos )
+        return false;
+    std::string token = message.substr(0, space).str();
+    if ( time )
+    {
+        if ( std::abs(std::atof(token.c_str()) - std::time(nullptr)) > max_time_difference )
+            return false;
+    }
+    else
+    {
+        auto it = std::find_if(challenges.begin(), challenges.end(),
+            [&address, &token](const Challenge& challenge) {
+                return challenge.address == address && challenge.challenge == token;
+            });
+        if ( it == challenges.end() )
+            return false;
+        challenges.erase(it);
+    }
+
+    command = message.substr(space+1).str();
+    return true;
+}
+
+void FakeServer::execute(const std::string& input)
+{
+    for ( const auto& command : split_commands(input) )
+    {
+        auto args = tokenize_command(command);
+        if ( args.empty() )
+            continue;
+        stats.commands++;
+        run_command(args);
+    }
+}
+
+void FakeServer::run_command(const std::vector<std::string>& args)
+{
+    const std::string& name = args[0];
+    std::vector<std::string> params(args.begin()+1, args.end());
+
+    auto command = commands.find(name);
+    if ( command != commands.end() )
+    {
+        command->second(params);
+        return;
+    }
+
+    auto cvar = cvars.find(name);
+    if ( cvar != cvars.end() )
+    {
+        if ( params.empty() )
+            print('"'+name+"\" is \""+cvar->second.value+"\" [\""+cvar->second.default_value+"\"]\n");
+        else
+            cvar->second.value = params[0];
+        return;
+    }
+
+    print("Unknown command \""+name+"\"\n");
+}
+
+void FakeServer::print(const std::string& text)
+{
+    bool log = redirect.empty();
+    if ( log && cvar("log_dest_udp").empty() )
+        return;
+
+    std::string& buffer = log ? log_buffer : redirect_buffer;
+    // Darkplaces fills the datagram without caring for line breaks
+    std::string::size_type max_text = max_datagram_size - header.size() - 1;
+    for ( std::string::size_type pos = 0; pos < text.size(); )
+    {
+        auto count = std::min(text.size() - pos, max_text - buffer.size());
+        buffer.append(text, pos, count);
+        pos += count;
+        if ( buffer.size() >= max_text )
+            flush_output(log);
+    }
+}
+
+void FakeServer::flush_log()
+{
+    flush_output(true);
+}
+
+void FakeServer::flush_output(bool log)
+{
+    std::string& buffer = log ? log_buffer : redirect_buffer;
+    if ( buffer.empty() )
+        return;
+
+    std::string datagram = header + 'n' + buffer;
+    buffer.clear();
+    if ( log )
+    {
+        for ( const auto& address : tokenize_command(cvar("log_dest_udp")) )
+            send(address, datagram);
+    }
+    else
+    {
+        send(redirect, datagram);
+    }
+}
+
+void FakeServer::send(const std::string& address, const std::string& datagram)
+{
+    stats.sent++;
+    if ( on_send )
+        on_send(address, datagram);
+}
+
+void FakeServer::send_info(const std::string& address, bool with_players, StringView challenge)
+{
+    std::string info = "\\gamename\\Xonotic\\modname\\data\\gameversion\\0"
+        "\\sv_maxclients\\" + cvar("sv_maxclients") +
+        "\\clients\\" + std::to_string(players.size()) +
+        "\\bots\\0\\mapname\\" + map +
+        "\\hostname\\" + cvar("hostname") +
+        "\\protocol\\3";
+    if ( !challenge.empty() )
+        info += "\\challenge\\" + challenge.str();
+
+    if ( !with_players )
+    {
+        send(address, header+"infoResponse\n"+info);
+        return;
+    }
+
+    std::string response = header+"statusResponse\n"+info+"\n";
+    for ( const auto& player : players )
+    {
+        response += std::to_string(player.frags) + ' ' + std::to_string(player.ping) +
+            " \"" + player.name + '"';
+        if ( player.team >= 0 )
+            response += ' ' + std::to_string(player.team);
+        response += '\n';
+    }
+    send(address, response);
+}
+
+void FakeServer::status()
+{
+    print("host:     "+cvar("hostname")+"\n"
+          "version:  Xonotic build fake\n"
+          "protocol: 3504 (DP7)\n"
+          "map:      "+map+"\n"
+          "timing:   0.0% CPU, 0.00% lost, offset avg 0.0ms, max 0.0ms, sdev 0.0ms\n"
+          "players:  "+std::to_string(players.size())+" active ("+cvar("sv_maxclients")+" max)\n"
+          "\n"
+          "^2IP                                             %pl ping  time   frags  no   name\n");
+
+    char line[128];
+    for ( std::size_t i = 0; i < players.size(); i++ )
+    {
+        const FakePlayer& player = players[i];
+        std::snprintf(line, sizeof(line), "^%c%-47s %2d %4d %8s %4d  #%-3d ^7",
+            i % 2 ? '7' : '3', player.ip.c_str(), player.packet_loss, player.ping,
+            player.time.c_str(), player.frags, player.entity);
+        print(line+player.name+"\n");
+    }
+}
+
+void FakeServer::cvarlist(const std::vector<std::string>& args)
+{
+    std::string prefix = args.empty() ? "" : args[0];
+    std::size_t count = 0;
+    for ( auto it = cvars.lower_bound(prefix);
+          it != cvars.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it )
+    {
+        print(it->first+" is \""+it->second.value+"\" [\""+it->second.default_value+"\"] "
+            +it->second.description+"\n");
+        count++;
+    }
+
+    std::string summary = std::to_string(count)+" cvar(s)";
+    if ( !prefix.empty() )
+        summary += " beginning with \""+prefix+"\"";
+    print(summary+"\n");
+}
+
+void FakeServer::edit_list(const std::vector<std::string>& args, bool add)
+{
+    const std::string& name = args[1];
+    const std::string& item = args[2];
+    auto items = tokenize_command(cvar(name));
+    auto it = std::find(items.begin(), items.end(), item);
+    if ( add && it == items.end() )
+        items.push_back(item);
+    else if ( !add && it != items.end() )
+        items.erase(it);
+
+    std::string value;
+    for ( const auto& i : items )
+        value += (value.empty() ? "" : " ") + i;
+    set_cvar(name, value);
+}
+
+} // namespace xonotic
@@ -0,0 +1,247 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef XONOTIC_FAKE_SERVER_HPP
+#define XONOTIC_FAKE_SERVER_HPP
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "hmac_md4.hpp"
+#include "string_view.hpp"
+#include "network/time.hpp"
+
+namespace xonotic {
+
+/**
+ * \brief Player listed by the status command of a FakeServer
+ */
+struct FakePlayer
+{
+    std::string ip = "127.0.0.1:26001";
+    int         packet_loss = 0;
+    int         ping = 0;
+    std::string time = "0:00:00";
+    int         frags = 0;
+    int         entity = 1;     ///< Number shown after '#'
+    std::string name;           ///< Name with color codes
+    int         team = -1;      ///< Team number, -1 if not in a team
+};
+
+/**
+ * \brief Counters for a FakeServer
+ */
+struct FakeServerStatistics
+{
+    uint64_t received = 0;  ///< Datagrams received
+    uint64_t sent = 0;      ///< Datagrams sent
+    uint64_t commands = 0;  ///< Console commands executed
+    uint64_t rejected = 0;  ///< Rcon requests with wrong credentials
+};
+
+/**
+ * \brief In-process stand-in for a Darkplaces server
+ *
+ * Answers the connectionless requests used by Darkplaces (the client):
+ * rcon, srcon with HMAC-MD4 TIME and CHALLENGE, getchallenge, getinfo and getstatus.
+ * Console output of a rcon request is sent back to the requester,
+ * anything else printed goes to the addresses in log_dest_udp.
+ * Built-in commands are echo, set, status, cvarlist, qc_cmd_sv addtolist
+ * and removefromlist and cvar queries, others can be scripted.
+ *
+ * It doesn't do any networking, datagrams are passed to receive()
+ * and sent with on_send. It is not thread safe.
+ *
+ * Challenges work as in Darkplaces: each address has a single challenge,
+ * repeated getchallenge requests within half a second are ignored and
+ * a challenge can be used only once.
+ */
+class FakeServer
+{
+public:
+    /**
+     * \brief Command implementation, receives the arguments after the command name
+     */
+    using Handler = std::function<void(const std::vector<std::string>& args)>;
+
+    /**
+     * \brief Called to send \p datagram (including the header) to \p address
+     */
+    std::function<void(const std::string& address, const std::string& datagram)> on_send;
+
+    explicit FakeServer(const std::string& rcon_password = {});
+
+    /**
+     * \brief Handles a datagram from \p address
+     *
+     * The output of rcon commands is sent before returning,
+     * log output is held until flush_log().
+     */
+    void receive(const std::string& address, StringView datagram);
+
+    /**
+     * \brief Runs \p commands as if typed in the server console
+     */
+    void execute(const std::string& commands);
+
+    /**
+     * \brief Prints to the console
+     *
+     * While running a rcon request the text goes to the requester,
+     * otherwise to log_dest_udp.
+     */
+    void print(const std::string& text);
+
+    /**
+     * \brief Sends the log output printed so far
+     *
+     * Darkplaces does this once per frame.
+     */
+    void flush_log();
+
+    /**
+     * \brief Defines or replaces the command \p name
+     */
+    void script(const std::string& name, Handler handler);
+
+    /**
+     * \brief Sets a cvar, creating it with \p value as default if needed
+     */
+    void set_cvar(const std::string& name, const std::string& value,
+                  const std::string& description = {});
+
+    /**
+     * \brief Returns the value of a cvar, empty if it doesn't exist
+     */
+    std::string cvar(const std::string& name) const;
+
+    /**
+     * \brief Sets the password and the value of rcon_secure
+     *
+     * rcon_secure 0 accepts any authentication, 1 requires srcon
+     * and 2 requires srcon with a challenge.
+     */
+    void set_rcon(const std::string& password, int secure);
+
+    /**
+     * \brief Players listed by status and getstatus
+     */
+    std::vector<FakePlayer> players;
+
+    /**
+     * \brief Map shown by status and getinfo
+     */
+    std::string map = "fakemap";
+
+    /**
+     * \brief Replaces the players with \p players generated ones
+     *  and adds \p cvars generated cvars
+     * \param seed Seed for the random values, the same seed gives the same server
+     */
+    void populate(std::size_t players, std::size_t cvars, unsigned seed = 0);
+
+    FakeServerStatistics statistics() const { return stats; }
+
+private:
+    struct Cvar
+    {
+        std::string value;
+        std::string default_value;
+        std::string description;
+    };
+
+    /**
+     * \brief Challenge given to an address
+     */
+    struct Challenge
+    {
+        std::string     address;
+        std::string     challenge;
+        network::Time   sent;       ///< Last time it has been requested
+    };
+
+    /**
+     * \brief Answers getchallenge from \p address
+     */
+    void send_challenge(const std::string& address);
+
+    /**
+     * \brief Authenticates a rcon or srcon request
+     * \param address   Address of the requester
+     * \param request   Datagram contents after the header
+     * \param command   Output, commands to run
+     */
+    bool authenticate(const std::string& address, StringView request, std::string& command);
+
+    /**
+     * \brief Runs a single command, already split from the others
+     */
+    void run_command(const std::vector<std::string>& args);
+
+    /**
+     * \brief Sends the output buffered for the rcon requester or log_dest_udp
+     */
+    void flush_output(bool log);
+
+    void send(const std::string& address, const std::string& datagram);
+    void send_info(const std::string& address, bool players, StringView challenge);
+    void status();
+    void cvarlist(const std::vector<std::string>& args);
+    void edit_list(const std::vector<std::string>& args, bool add);
+
+    std::string                         header{"\xff\xff\xff\xff"};
+    std::string::size_type              max_datagram_size = 1400;
+    HmacMd4Signer                       signer;
+    std::string                         rcon_password;
+    int                                 rcon_secure = 0;
+    std::deque<Challenge>               challenges;     ///< Challenges sent and not used yet, oldest first
+    std::map<std::string, Cvar>         cvars;
+    std::map<std::string, Handler>      commands;
+    std::string                         redirect;       ///< Address of the current rcon requester
+    std::string                         redirect_buffer;///< Output for the rcon requester
+    std::string                         log_buffer;     ///< Output for log_dest_udp
+    FakeServerStatistics                stats;
+};
+
+/**
+ * \brief Builds a synthetic log line, cycling through chat, frags and events
+ * \param index Sequence number, included in the line
+ */
+std::string fake_log_line(uint64_t index);
+
+/**
+ * \brief Splits a command line into the arguments, removing quotes
+ */
+std::vector<std::string> tokenize_command(const std::string& command);
+
+/**
+ * \brief Splits console input on ';' and newlines outside quotes, dropping comments
+ */
+std::vector<std::string> split_commands(const std::string& input);
+
+} // namespace xonotic
+#endif // XONOTIC_FAKE_SERVER_HPP
@@ -0,0 +1,186 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "hmac_md4.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace xonotic {
+
+static inline uint32_t rotate_left(uint32_t x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+static inline uint32_t md4_f(uint32_t x, uint32_t y, uint32_t z)
+{
+    return (x & y) | (~x & z);
+}
+
+static inline uint32_t md4_g(uint32_t x, uint32_t y, uint32_t z)
+{
+    return (x & y) | (x & z) | (y & z);
+}
+
+static inline uint32_t md4_h(uint32_t x, uint32_t y, uint32_t z)
+{
+    return x ^ y ^ z;
+}
+
+Md4::Md4()
+    : state{0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476}
+{}
+
+void Md4::transform(const unsigned char* block)
+{
+    uint32_t x[16];
+    for ( int i = 0; i < 16; i++ )
+        x[i] = uint32_t(block[i*4]) | uint32_t(block[i*4+1]) << 8 |
+               uint32_t(block[i*4+2]) << 16 | uint32_t(block[i*4+3]) << 24;
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+
+    static const int round1_shift[4] = {3, 7, 11, 19};
+    for ( int i = 0; i < 16; i++ )
+    {
+        uint32_t t = rotate_left(a + md4_f(b, c, d) + x[i], round1_shift[i % 4]);
+        a = d; d = c; c = b; b = t;
+    }
+
+    static const int round2_index[16] = {0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15};
+    static const int round2_shift[4] = {3, 5, 9, 13};
+    for ( int i = 0; i < 16; i++ )
+    {
+        uint32_t t = rotate_left(a + md4_g(b, c, d) + x[round2_index[i]] + 0x5a827999,
+                                 round2_shift[i % 4]);
+        a = d; d = c; c = b; b = t;
+    }
+
+    static const int round3_index[16] = {0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15};
+    static const int round3_shift[4] = {3, 9, 11, 15};
+    for ( int i = 0; i < 16; i++ )
+    {
+        uint32_t t = rotate_left(a + md4_h(b, c, d) + x[round3_index[i]] + 0x6ed9eba1,
+                                 round3_shift[i % 4]);
+        a = d; d = c; c = b; b = t;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
+
+void Md4::add_data(const char* data, std::size_t size)
+{
+    auto input = reinterpret_cast<const unsigned char*>(data);
+    std::size_t buffered = length % block_size;
+    length += size;
+
+    if ( buffered )
+    {
+        std::size_t fill = std::min(size, block_size - buffered);
+        std::memcpy(buffer + buffered, input, fill);
+        input += fill;
+        size -= fill;
+        if ( buffered + fill < block_size )
+            return;
+        transform(buffer);
+    }
+
+    for ( ; size >= block_size; input += block_size, size -= block_size )
+        transform(input);
+
+    std::memcpy(buffer, input, size);
+}
+
+std::string Md4::result() const
+{
+    Md4 final_state = *this;
+
+    unsigned char padding[block_size * 2] = {0x80};
+    std::size_t buffered = length % block_size;
+    std::size_t pad_size = (buffered < 56 ? 56 : 120) - buffered;
+    uint64_t bits = length * 8;
+    final_state.add_data(reinterpret_cast<const char*>(padding), pad_size);
+
+    unsigned char bit_length[8];
+    for ( int i = 0; i < 8; i++ )
+        bit_length[i] = (bits >> (i * 8)) & 0xff;
+    final_state.add_data(reinterpret_cast<const char*>(bit_length), 8);
+
+    std::string digest(digest_size, '\0');
+    for ( int i = 0; i < 16; i++ )
+        digest[i] = char((final_state.state[i / 4] >> ((i % 4) * 8)) & 0xff);
+    return digest;
+}
+
+void HmacMd4Signer::set_key(const std::string& key)
+{
+    unsigned char padded[Md4::block_size] = {0};
+    if ( key.size() > Md4::block_size )
+    {
+        Md4 key_hash;
+        key_hash.add_data(key);
+        std::string digest = key_hash.result();
+        std::memcpy(padded, digest.data(), digest.size());
+    }
+    else
+    {
+        std::memcpy(padded, key.data(), key.size());
+    }
+
+    char inner_pad[Md4::block_size];
+    char outer_pad[Md4::block_size];
+    for ( std::size_t i = 0; i < Md4::block_size; i++ )
+    {
+        inner_pad[i] = char(padded[i] ^ 0x36);
+        outer_pad[i] = char(padded[i] ^ 0x5c);
+    }
+
+    inner = Md4();
+    inner.add_data(inner_pad, Md4::block_size);
+    outer = Md4();
+    outer.add_data(outer_pad, Md4::block_size);
+}
+
+std::string HmacMd4Signer::sign(const char* message, std::size_t size) const
+{
+    Md4 inner_hash = inner;
+    inner_hash.add_data(message, size);
+    Md4 outer_hash = outer;
+    outer_hash.add_data(inner_hash.result());
+    return outer_hash.result();
+}
+
+std::vector<std::string> HmacMd4Signer::sign_batch(const std::vector<std::string>& messages) const
+{
+    std::vector<std::string> digests;
+    digests.reserve(messages.size());
+    for ( const auto& message : messages )
+        digests.push_back(sign(message));
+    return digests;
+}
+
+} // namespace xonotic
@@ -0,0 +1,110 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef XONOTIC_HMAC_MD4_HPP
+#define XONOTIC_HMAC_MD4_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace xonotic {
+
+/**
+ * \brief Incremental MD4 hash (RFC 1320)
+ *
+ * The state can be copied, so a common prefix only needs to be hashed once.
+ */
+class Md4
+{
+public:
+    static const std::size_t block_size = 64;
+    static const std::size_t digest_size = 16;
+
+    Md4();
+
+    /**
+     * \brief Appends data to the hashed message
+     */
+    void add_data(const char* data, std::size_t size);
+
+    void add_data(const std::string& data)
+    {
+        add_data(data.data(), data.size());
+    }
+
+    /**
+     * \brief Returns the binary digest of the data added so far
+     */
+    std::string result() const;
+
+private:
+    void transform(const unsigned char* block);
+
+    uint32_t        state[4];
+    uint64_t        length = 0;         ///< Bytes added so far
+    unsigned char   buffer[block_size]; ///< Incomplete block
+};
+
+/**
+ * \brief Signs messages with HMAC-MD4 as used by rcon_secure
+ *
+ * The hash states after the inner and outer padded key are computed
+ * once per key and reused for every message.
+ */
+class HmacMd4Signer
+{
+public:
+    explicit HmacMd4Signer(const std::string& key = {})
+    {
+        set_key(key);
+    }
+
+    /**
+     * \brief Sets the key and precomputes the padded key states
+     */
+    void set_key(const std::string& key);
+
+    /**
+     * \brief Returns the binary digest for \p message
+     */
+    std::string sign(const std::string& message) const
+    {
+        return sign(message.data(), message.size());
+    }
+
+    std::string sign(const char* message, std::size_t size) const;
+
+    /**
+     * \brief Signs several messages in one go
+     * \returns The digests in the same order as \p messages
+     */
+    std::vector<std::string> sign_batch(const std::vector<std::string>& messages) const;
+
+private:
+    Md4 inner;  ///< State after hashing the key xor ipad
+    Md4 outer;  ///< State after hashing the key xor opad
+};
+
+} // namespace xonotic
+#endif // XONOTIC_HMAC_MD4_HPP
@@ -0,0 +1,332 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef XONOTIC_LOG_GRAMMAR_HPP
+#define XONOTIC_LOG_GRAMMAR_HPP
+
+#include <cstddef>
+
+namespace xonotic {
+
+/**
+ * \brief Matchers for the log lines understood by LogParser
+ *
+ * Each matcher accepts exactly what the regular expression in its
+ * description accepts and reports the same captures, as offsets into
+ * the line. They work on any character type comparable to ASCII
+ * (char for UTF-8, char16_t for UTF-16), \\s and \\d only match ASCII.
+ */
+namespace log_grammar {
+
+/**
+ * \brief Part of a line, as offset and length
+ */
+struct Span
+{
+    std::size_t begin = 0;
+    std::size_t size = 0;
+};
+
+/**
+ * \brief Captures of a cvar description line
+ */
+struct CvarLine
+{
+    Span name;
+    Span value;
+    Span default_value;
+    Span description;
+};
+
+/**
+ * \brief Captures of the "players:" line of status
+ */
+struct PlayersLine
+{
+    Span summary;   ///< "N active (M max)"
+    Span active;    ///< "N"
+};
+
+/**
+ * \brief Captures of a "name: value" line of status
+ */
+struct PropertyLine
+{
+    Span name;
+    Span value;
+};
+
+/**
+ * \brief Captures of a player row of status
+ */
+struct PlayerLine
+{
+    Span ip;
+    Span pl;
+    Span ping;
+    Span time;
+    Span frags;
+    Span no;
+    Span name;
+};
+
+/**
+ * \brief Reads a line left to right, without backtracking
+ */
+template<class Char>
+    class Cursor
+    {
+    public:
+        Cursor(const Char* data, std::size_t size) : data(data), size(size) {}
+
+        bool at_end() const { return pos >= size; }
+
+        /**
+         * \brief Whether the next character is \p c
+         */
+        bool next_is(char c) const
+        {
+            return pos < size && data[pos] == Char(c);
+        }
+
+        /**
+         * \brief Consumes \p text if the line continues with it
+         */
+        bool literal(const char* text)
+        {
+            std::size_t end = pos;
+            for ( ; *text; ++text, ++end )
+                if ( end >= size || data[end] != Char(*text) )
+                    return false;
+            pos = end;
+            return true;
+        }
+
+        /**
+         * \brief Consumes characters as long as \p predicate holds
+         */
+        template<class Predicate>
+            Span take_while(const Predicate& predicate)
+            {
+                Span span;
+                span.begin = pos;
+                while ( pos < size && predicate(data[pos]) )
+                    pos++;
+                span.size = pos - span.begin;
+                return span;
+            }
+
+        /**
+         * \brief Consumes whitespace (\\s*)
+         * \returns The number of consumed characters
+         */
+        std::size_t skip_space()
+        {
+            return take_while(is_space).size;
+        }
+
+        /**
+         * \brief Consumes the rest of the line (.*$)
+         *
+         * As in regular expressions, '.' doesn't match a line feed
+         * and '$' matches before a final line feed.
+         */
+        bool rest_of_line(Span& span)
+        {
+            span = take_while([](Char c) { return c != Char('\n'); });
+            return pos == size || (pos + 1 == size);
+        }
+
+        /**
+         * \brief Whether the line ends here ($)
+         */
+        bool line_end() const
+        {
+            return pos == size || (pos + 1 == size && data[pos] == Char('\n'));
+        }
+
+        static bool is_space(Char c)
+        {
+            return c == Char(' ') || (c >= Char('\t') && c <= Char('\r'));
+        }
+
+        static bool is_digit(Char c)
+        {
+            return c >= Char('0') && c <= Char('9');
+        }
+
+        const Char*     data;
+        std::size_t     size;
+        std::size_t     pos = 0;
+    };
+
+/**
+ * \brief Cheap check on the first character for lines which can't be
+ *  a cvar or the start of status
+ *
+ * Most log lines are chat messages and notifications beginning with a
+ * color code, which none of the default grammars accept.
+ */
+template<class Char>
+    bool skip_default(const Char* line, std::size_t size)
+    {
+        return size == 0 || line[0] == Char('^') || line[0] == Char(' ');
+    }
+
+/**
+ * \brief Matches
+ * <tt>^(?:cvar \\^3|")?([^"^ ]+)(?:"|\\^7)? is "([^"]*)" \\["([^"]*)"\\]\\s*(.*)$</tt>
+ */
+template<class Char>
+    bool match_cvar(const Char* line, std::size_t size, CvarLine& cvar)
+    {
+        Cursor<Char> cursor(line, size);
+        if ( !cursor.literal("cvar ^3") )
+            cursor.literal("\"");
+
+        cvar.name = cursor.take_while([](Char c) {
+            return c != Char('"') && c != Char('^') && c != Char(' ');
+        });
+        if ( !cvar.name.size )
+            return false;
+        if ( !cursor.literal("\"") )
+            cursor.literal("^7");
+
+        auto unquoted = [](Char c) { return c != Char('"'); };
+        if ( !cursor.literal(" is \"") )
+            return false;
+        cvar.value = cursor.take_while(unquoted);
+        if ( !cursor.literal("\" [\"") )
+            return false;
+        cvar.default_value = cursor.take_while(unquoted);
+        if ( !cursor.literal("\"]") )
+            return false;
+        cursor.skip_space();
+        return cursor.rest_of_line(cvar.description);
+    }
+
+/**
+ * \brief Matches <tt>^host:\\s+(.+)$</tt>
+ */
+template<class Char>
+    bool match_status_begin(const Char* line, std::size_t size, Span& host)
+    {
+        Cursor<Char> cursor(line, size);
+        if ( !cursor.literal("host:") )
+            return false;
+        std::size_t spaces_begin = cursor.pos;
+        if ( !cursor.skip_space() || !cursor.rest_of_line(host) )
+            return false;
+        if ( host.size )
+            return true;
+
+        // Only whitespace: (.+) takes back the last character before $
+        std::size_t end = size;
+        if ( line[end - 1] == Char('\n') )
+            end--;
+        if ( end < spaces_begin + 2 || line[end - 1] == Char('\n') )
+            return false;
+        host.begin = end - 1;
+        host.size = 1;
+        return true;
+    }
+
+/**
+ * \brief Matches <tt>^players:\\s+((\\d+) active \\(\\d+ max\\))$</tt>
+ */
+template<class Char>
+    bool match_players(const Char* line, std::size_t size, PlayersLine& players)
+    {
+        Cursor<Char> cursor(line, size);
+        if ( !cursor.literal("players:") || !cursor.skip_space() )
+            return false;
+        players.summary.begin = cursor.pos;
+        players.active = cursor.take_while(Cursor<Char>::is_digit);
+        if ( !players.active.size || !cursor.literal(" active (") ||
+             !cursor.take_while(Cursor<Char>::is_digit).size || !cursor.literal(" max)") )
+            return false;
+        players.summary.size = cursor.pos - players.summary.begin;
+        return cursor.line_end();
+    }
+
+/**
+ * \brief Matches <tt>^([a-z]+):\\s+(.*)$</tt>
+ */
+template<class Char>
+    bool match_property(const Char* line, std::size_t size, PropertyLine& property)
+    {
+        Cursor<Char> cursor(line, size);
+        property.name = cursor.take_while([](Char c) { return c >= Char('a') && c <= Char('z'); });
+        if ( !property.name.size || !cursor.literal(":") || !cursor.skip_space() )
+            return false;
+        return cursor.rest_of_line(property.value);
+    }
+
+/**
+ * \brief Matches <tt>^\\^[0-9]IP\\s+%pl\\s+ping\\s+time\\s+frags\\s+no\\s+name$</tt>
+ */
+template<class Char>
+    bool match_player_header(const Char* line, std::size_t size)
+    {
+        Cursor<Char> cursor(line, size);
+        if ( !cursor.literal("^") || !cursor.take_while(Cursor<Char>::is_digit).size )
+            return false;
+        // [0-9] is a single digit
+        if ( cursor.pos != 2 || !cursor.literal("IP") )
+            return false;
+        for ( const char* column : {"%pl", "ping", "time", "frags", "no", "name"} )
+            if ( !cursor.skip_space() || !cursor.literal(column) )
+                return false;
+        return cursor.line_end();
+    }
+
+/**
+ * \brief Matches
+ * <tt>^\\^[37](\\S+)\\s+(\\S+)\\s+(\\S+)\\s+(\\S+)\\s+(\\S+)\\s+#([0-9]+)\\s+\\^7(.*)$</tt>
+ */
+template<class Char>
+    bool match_player(const Char* line, std::size_t size, PlayerLine& player)
+    {
+        Cursor<Char> cursor(line, size);
+        if ( !cursor.literal("^3") && !cursor.literal("^7") )
+            return false;
+
+        auto token = [](Char c) { return !Cursor<Char>::is_space(c); };
+        for ( Span* field : {&player.ip, &player.pl, &player.ping, &player.time, &player.frags} )
+        {
+            *field = cursor.take_while(token);
+            if ( !field->size || !cursor.skip_space() )
+                return false;
+        }
+
+        if ( !cursor.literal("#") )
+            return false;
+        player.no = cursor.take_while(Cursor<Char>::is_digit);
+        if ( !player.no.size || !cursor.skip_space() || !cursor.literal("^7") )
+            return false;
+        return cursor.rest_of_line(player.name);
+    }
+
+} // namespace log_grammar
+} // namespace xonotic
+#endif // XONOTIC_LOG_GRAMMAR_HPP
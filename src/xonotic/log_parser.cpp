@@ -23,30 +23,45 @@
  */
 #include "log_parser.hpp"
 
-#include "regex.hpp"
+#include <QByteArray>
+
+#include "log_grammar.hpp"
 
 namespace xonotic {
 
-void LogParser::parse(const QString& line)
+namespace {
+
+QString captured(StringView line, log_grammar::Span span)
+{
+    return QString::fromUtf8(line.data() + span.begin, span.size);
+}
+
+} // namespace
+
+void LogParser::parse(StringView line)
 {
     if ( listening == DEFAULT )
     {
-        static regex::Regex regex_status_begin = regex::optimized("^host:\\s+(.+)$");
-        static regex::Regex regex_cvar = regex::optimized(
-            R"regex(^(?:cvar \^3|")?([^"^ ]+)(?:"|\^7)? is "([^"]*)" \["([^"]*)"\]\s*(.*)$)regex");
-        static regex::Regex regex_cvarlist_end = regex::optimized(
-            R"regex(^\d+ cvar(?:\(s\))|(?: beginning with .*)$)regex");
+        const char* data = line.data();
+        std::size_t size = line.size();
+        // Most lines are chat and events, which can't match anything here
+        bool skip = log_grammar::skip_default(data, size);
 
-        regex::Match match;
-        if ( regex::match(line, regex_cvar, match) )
+        log_grammar::CvarLine cvar_line;
+        if ( !skip && log_grammar::match_cvar(data, size, cvar_line) )
         {
             // only cvarlist and apropos show the description
-            if ( !cvarlist && match.capturedLength(4) )
+            if ( !cvarlist && cvar_line.description.size )
             {
                 cvarlist = true;
                 emit cvarlist_begin();
             }
-            emit cvar({match.captured(1), match.captured(2), match.captured(3), match.captured(4)});
+            emit cvar({
+                captured(line, cvar_line.name),
+                captured(line, cvar_line.value),
+                captured(line, cvar_line.default_value),
+                captured(line, cvar_line.description)
+            });
             return;
         }
         else if ( cvarlist )
@@ -55,10 +70,11 @@ void LogParser::parse(const QString& line)
             emit cvarlist_end();
         }
 
-        if ( regex::match(line, regex_status_begin, match) )
+        log_grammar::Span host;
+        if ( !skip && log_grammar::match_status_begin(data, size, host) )
         {
             listening = STATUS;
-            emit server_property_changed("host", match.captured(1));
+            emit server_property_changed("host", captured(line, host));
         }
 
     }
@@ -72,26 +88,25 @@ void LogParser::parse(const QString& line)
     }
 }
 
-void LogParser::parse_status(const QString& line)
+void LogParser::parse_status(StringView line)
 {
-    static regex::Regex regex_players = regex::optimized(
-        R"(^players:\s+((\d+) active \(\d+ max\))$)");
-    static regex::Regex regex_property = regex::optimized("^([a-z]+):\\s+(.*)$");
-    static regex::Regex regex_player_header = regex::optimized(
-        "^\\^[0-9]IP\\s+%pl\\s+ping\\s+time\\s+frags\\s+no\\s+name$");
+    const char* data = line.data();
+    std::size_t size = line.size();
 
-    regex::Match match;
-    if ( regex::match(line, regex_players, match) )
+    log_grammar::PlayersLine players_line;
+    log_grammar::PropertyLine property;
+    if ( log_grammar::match_players(data, size, players_line) )
     {
-        players_active = match.capturedRef(2).toUInt();
+        players_active = QByteArray::fromRawData(data + players_line.active.begin,
+                                                 players_line.active.size).toUInt();
         players_.reserve(players_active);
-        server_property_changed("players", match.captured(1));
+        server_property_changed("players", captured(line, players_line.summary));
     }
-    else if ( regex::match(line, regex_property, match) )
+    else if ( log_grammar::match_property(data, size, property) )
     {
-        server_property_changed(match.captured(1), match.captured(2));
+        server_property_changed(captured(line, property.name), captured(line, property.value));
     }
-    else if ( regex::match(line, regex_player_header) )
+    else if ( log_grammar::match_player_header(data, size) )
     {
         players_.clear();
         if ( players_active == 0 )
@@ -104,30 +119,25 @@ void LogParser::parse_status(const QString& line)
             listening = STATUS_PLAYERS;
         }
     }
-    else if ( !line.isEmpty() )
+    else if ( !line.empty() )
     {
         listening = DEFAULT;
     }
 }
 
-void LogParser::parse_player(const QString& line)
+void LogParser::parse_player(StringView line)
 {
-    static regex::Regex regex_player = regex::optimized(
-        // rowcol IP      %pl     ping    time   frags     no           name
-        R"(^\^[37](\S+)\s+(\S+)\s+(\S+)\s+(\S+)\s+(\S+)\s+#([0-9]+)\s+\^7(.*)$)"
-    );
-
-    regex::Match match;
-    if ( regex::match(line, regex_player, match) )
+    log_grammar::PlayerLine player;
+    if ( log_grammar::match_player(line.data(), line.size(), player) )
     {
         players_.emplace_back();
-        players_.back().ip    = match.captured(1);
-        players_.back().pl    = match.captured(2);
-        players_.back().ping  = match.captured(3);
-        players_.back().time  = match.captured(4);
-        players_.back().frags = match.captured(5);
-        players_.back().no    = match.captured(6);
-        players_.back().name  = match.captured(7);
+        players_.back().ip    = captured(line, player.ip);
+        players_.back().pl    = captured(line, player.pl);
+        players_.back().ping  = captured(line, player.ping);
+        players_.back().time  = captured(line, player.time);
+        players_.back().frags = captured(line, player.frags);
+        players_.back().no    = captured(line, player.no);
+        players_.back().name  = captured(line, player.name);
         if ( players_active == players_.size() )
         {
             listening = DEFAULT;
@@ -29,6 +29,7 @@
 
 #include "cvar.hpp"
 #include "player.hpp"
+#include "string_view.hpp"
 
 namespace xonotic {
 
@@ -42,8 +43,10 @@ class LogParser : public QObject
 public:
     /**
      * \brief Parse a xonotic log line
+     * \param line UTF-8 text of the line, only the matched fields are
+     *             converted to QString
      */
-    void parse(const QString& line);
+    void parse(StringView line);
 
     /**
      * \brief Returns the vector of parsed players
@@ -88,12 +91,12 @@ private:
     /**
      * \brief Parses a player line
      */
-    void parse_player(const QString& line);
+    void parse_player(StringView line);
 
     /**
      * \brief Parses a server status line
      */
-    void parse_status(const QString& line);
+    void parse_status(StringView line);
 };
 
 } // namespace xonotic
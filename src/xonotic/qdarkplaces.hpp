@@ -24,20 +24,117 @@
 #ifndef QDARKPLACES_HPP
 #define QDARKPLACES_HPP
 
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
 #include <QObject>
+#include <QSocketNotifier>
+#include <QThread>
 #include "darkplaces.hpp"
+#include "functional.hpp"
+#include "ring_buffer.hpp"
 
 namespace xonotic {
 
+/**
+ * \brief Log line waiting to be consumed
+ */
+struct LogLine
+{
+    std::string         text;
+    network::WallTime   arrival;    ///< Time the line has been received
+};
+
 class QDarkplaces : public QObject, public Darkplaces
 {
     Q_OBJECT
 public:
     explicit QDarkplaces(xonotic::ConnectionDetails details, QObject* parent = nullptr)
-        : QObject(parent), Darkplaces(std::move(details)) {}
+        : QDarkplaces(std::move(details), 8192, nullptr, parent) {}
+
+    /**
+     * \param details          Connection details
+     * \param log_queue_size   Maximum number of log lines waiting to be consumed
+     * \param transport        Transport used instead of network::UdpIo, if not null
+     * \param parent           Parent object
+     */
+    QDarkplaces(xonotic::ConnectionDetails details,
+                std::size_t log_queue_size,
+                std::unique_ptr<network::Transport> transport,
+                QObject* parent = nullptr)
+        : QObject(parent), Darkplaces(std::move(details), std::move(transport)),
+          log_queue(log_queue_size) {}
+
+    /**
+     * \brief Stops the network I/O before the members it writes to are destroyed
+     *
+     * ~Darkplaces() would disconnect only after the log queue and the
+     * completions are gone, while a network thread may still be using them.
+     * The owner is being destroyed as well, so no signal is emitted.
+     */
+    ~QDarkplaces()
+    {
+        blockSignals(true);
+        Darkplaces::disconnect();
+    }
 
     bool xonotic_connected() { return Darkplaces::connected(); }
 
+    /**
+     * \brief Called with the output of a command
+     */
+    using Completion = std::function<void(const CommandResult& result)>;
+
+    using Darkplaces::rcon_command;
+
+    /**
+     * \brief Runs a rcon command and calls \p completion with its output
+     *
+     * \p completion is invoked from the thread of this object.
+     * \see Darkplaces::rcon_command_tracked()
+     */
+    void rcon_command(std::string command, Completion completion,
+        network::SendPriority priority = network::SendPriority::Interactive)
+    {
+        std::lock_guard<std::mutex> lock(completion_mutex);
+        uint64_t id = rcon_command_tracked(std::move(command), priority);
+        completions[id] = std::move(completion);
+    }
+
+    /**
+     * \brief Calls \p functor on every log line received since the last call
+     *
+     * Must be called from the thread receiving log_available(),
+     * the argument is a <tt>const LogLine&</tt> only valid during the call.
+     * \returns The number of consumed lines
+     */
+    template<class Functor>
+        std::size_t consume_log(const Functor& functor)
+        {
+            // Cleared first so lines pushed from now on trigger a new signal
+            drain_scheduled.store(false);
+            std::size_t count = 0;
+            while ( LogLine* line = log_queue.front() )
+            {
+                functor(static_cast<const LogLine&>(*line));
+                log_queue.pop();
+                count++;
+            }
+            return count;
+        }
+
+    /**
+     * \brief Number of log lines discarded because the consumer was too slow
+     */
+    uint64_t dropped_log_lines() const { return dropped_lines; }
+
+    /**
+     * \brief Maximum number of log lines waiting to be consumed
+     */
+    std::size_t log_queue_capacity() const { return log_queue.capacity(); }
+
 public slots:
     bool xonotic_connect() { return Darkplaces::connect(); }
     void xonotic_disconnect() { return Darkplaces::disconnect(); }
@@ -45,7 +142,7 @@ public slots:
 
 signals:
     /**
-     * \brief Emitted on a successful connection (from the main thread)
+     * \brief Emitted on a successful connection (from the main thread or the resolver thread)
      */
     void connected();
 
@@ -62,29 +159,27 @@ signals:
 
 
     /**
-     * \brief Emitted when received a datagram containing some log
+     * \brief Emitted when there are log lines to be consumed (from the network
+     * thread, or from the thread of this object with network::ReadMode::External)
      *
-     * Will follow several calls to on_receive_log() (one per log line)
-     * and on_log_end()
+     * It isn't emitted again until consume_log() has been called.
      */
-    void log_begin();
+    void log_available();
 
     /**
-     * \brief Emitted when received a datagram containing some log
-     *
-     * After on_log_begin() and on_receive_log()
+     * \brief Emitted on a connection error (from the network thread)
      */
-    void log_end();
+    void connection_error(const QString& message);
 
     /**
-     * \brief Emitted on a log line (from the network thread)
+     * \brief Emitted with a status message from the transport (from the network thread)
      */
-    void received_log(const QString& line);
+    void connection_status(const QString& message);
 
     /**
-     * \brief Emitted on a connection error (from the network thread)
+     * \brief Emitted on a response to request_info() (from the network thread)
      */
-    void connection_error(const QString& message);
+    void server_info(const xonotic::ServerInfo& info);
 
 protected:
     void on_connect() override { emit connected(); }
@@ -92,12 +187,25 @@ protected:
     void on_disconnect() override { emit disconnecting(); }
     void on_disconnecting() override { emit disconnected(); }
 
-    void on_log_begin() override { emit log_begin(); }
-    void on_log_end() override { emit log_end(); }
+    void on_log_end() override
+    {
+        if ( log_queue.size() && !drain_scheduled.exchange(true) )
+            emit log_available();
+    }
 
-    void on_receive_log(const std::string& line) override
+    void on_receive_log(StringView line, network::WallTime arrival) override
     {
-        emit received_log(QString::fromStdString(line));
+        if ( LogLine* slot = log_queue.reserve() )
+        {
+            slot->text.assign(line.data(), line.size());
+            slot->arrival = arrival;
+            log_queue.commit();
+        }
+        else
+        {
+            // The consumer is lagging behind, discard rather than queue without bounds
+            dropped_lines++;
+        }
     }
 
     // on_receive
@@ -107,10 +215,96 @@ protected:
         emit connection_error(QString::fromStdString(msg));
     }
 
+    void on_network_status(const std::string& msg) override
+    {
+        emit connection_status(QString::fromStdString(msg));
+    }
+
+    void on_server_info(const ServerInfo& info) override
+    {
+        emit server_info(info);
+    }
+
+    void on_watch_socket(network::Transport::NativeHandle handle) override
+    {
+        // The notifier must be created in the thread of this object
+        watched_socket = handle;
+        QMetaObject::invokeMethod(this, "update_notifier", Qt::QueuedConnection);
+    }
+
+    void on_unwatch_socket() override
+    {
+        watched_socket = -1;
+        if ( QThread::currentThread() == thread() )
+            notifier.reset();
+        else
+            QMetaObject::invokeMethod(this, "update_notifier", Qt::QueuedConnection);
+    }
+
+    void on_command_complete(const CommandResult& result) override
+    {
+        std::lock_guard<std::mutex> lock(completion_mutex);
+        auto it = completions.find(result.id);
+        if ( it == completions.end() )
+            return;
+        finished.emplace_back(std::move(it->second), result);
+        completions.erase(it);
+        QMetaObject::invokeMethod(this, "dispatch_completions", Qt::QueuedConnection);
+    }
+
+private slots:
+    /**
+     * \brief Invokes the completions of the finished commands
+     */
+    void dispatch_completions()
+    {
+        std::unique_lock<std::mutex> lock(completion_mutex);
+        std::deque<std::pair<Completion, CommandResult>> ready;
+        ready.swap(finished);
+        lock.unlock();
+
+        for ( const auto& command : ready )
+            callback(command.first, command.second);
+    }
+
+    /**
+     * \brief Watches \c watched_socket with \c notifier
+     */
+    void update_notifier()
+    {
+        notifier.reset();
+        qintptr handle = watched_socket;
+        if ( handle == -1 )
+            return;
+        notifier.reset(new QSocketNotifier(handle, QSocketNotifier::Read));
+        // activated() is overloaded in recent versions of Qt
+        connect(notifier.get(), SIGNAL(activated(int)), this, SLOT(read_notified()));
+    }
+
+    /**
+     * \brief Reads the datagrams from the socket from the GUI thread
+     */
+    void read_notified()
+    {
+        Darkplaces::read_available();
+    }
+
 private:
     using Darkplaces::connect;
     using Darkplaces::disconnect;
+
+    SpscRingBuffer<LogLine>     log_queue;              ///< Lines from the network thread
+    std::atomic<bool>           drain_scheduled{false}; ///< Whether log_available() is pending
+    std::atomic<uint64_t>       dropped_lines{0};       ///< Lines discarded on a full queue
+    std::mutex                  completion_mutex;
+    std::unordered_map<uint64_t, Completion> completions;   ///< Completions of the running commands
+    std::deque<std::pair<Completion, CommandResult>> finished; ///< Completions to be dispatched
+    std::atomic<qintptr>        watched_socket{-1};     ///< Socket to read with ReadMode::External, -1 if none
+    std::unique_ptr<QSocketNotifier> notifier;          ///< Notifies when \c watched_socket is readable
 };
 
 } // namespace xonotic
+
+Q_DECLARE_METATYPE(xonotic::ServerInfo)
+
 #endif // QDARKPLACES_HPP
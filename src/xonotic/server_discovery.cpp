@@ -0,0 +1,527 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "server_discovery.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+namespace xonotic {
+
+/**
+ * \brief Connectionless packet header
+ */
+static const std::string header = "\xff\xff\xff\xff";
+
+/**
+ * \brief Maximum number of servers expand_address_range() generates
+ */
+static const std::size_t max_range_size = 65536;
+
+ServerDiscovery::ServerDiscovery(network::Reactor& reactor, network::Resolver& resolver)
+    : reactor(reactor),
+      resolver(resolver),
+      socket(reactor.io_service()),
+      buffer(4096),
+      timer(reactor)
+{
+    timer.on_timeout = [this]{ pump(); };
+}
+
+ServerDiscovery::~ServerDiscovery()
+{
+    stop();
+}
+
+void ServerDiscovery::set_concurrency(std::size_t max_in_flight)
+{
+    Lock lock(mutex);
+    this->max_in_flight = std::max<std::size_t>(max_in_flight, 1);
+    lock.unlock();
+    timer.start_before(network::Clock::duration::zero());
+}
+
+void ServerDiscovery::set_timeout(network::Clock::duration timeout)
+{
+    Lock lock(mutex);
+    this->timeout = timeout;
+}
+
+void ServerDiscovery::query(const std::vector<network::Server>& servers)
+{
+    std::vector<network::Server> lookups;
+    Lock lock(mutex);
+    begin();
+    for ( const auto& server : servers )
+        if ( !enqueue_literal(server, {}) )
+            lookups.push_back(server);
+    lock.unlock();
+
+    for ( const auto& server : lookups )
+        resolve(server, {});
+    timer.start_before(network::Clock::duration::zero());
+}
+
+void ServerDiscovery::query_master(const network::Server& master,
+                                   const std::string& game, int protocol)
+{
+    std::string filter = game + ' ' + std::to_string(protocol) + " empty full";
+    Lock lock(mutex);
+    begin();
+    bool literal = enqueue_literal(master, filter);
+    lock.unlock();
+
+    if ( !literal )
+        resolve(master, filter);
+    timer.start_before(network::Clock::duration::zero());
+}
+
+void ServerDiscovery::stop()
+{
+    std::shared_ptr<Lookup> pending;
+    Lock lock(mutex);
+    pending.swap(lookup);
+    lock.unlock();
+    if ( pending )
+    {
+        std::lock_guard<std::recursive_mutex> guard(pending->mutex);
+        pending->discovery = nullptr;
+    }
+
+    lock.lock();
+    queue.clear();
+    in_flight.clear();
+    deadlines.clear();
+    seen.clear();
+    resolving = 0;
+    active = false;
+    if ( socket.is_open() )
+    {
+        boost::system::error_code ec;
+        socket.close(ec);
+        if ( handler_thread != std::this_thread::get_id() )
+            read_done.wait(lock, [this]{ return !reading; });
+    }
+    lock.unlock();
+
+    timer.cancel();
+}
+
+bool ServerDiscovery::running() const
+{
+    Lock lock(mutex);
+    return active;
+}
+
+DiscoveryProgress ServerDiscovery::progress() const
+{
+    Lock lock(mutex);
+    DiscoveryProgress progress = counters;
+    progress.queued = queue.size();
+    progress.in_flight = in_flight.size();
+    return progress;
+}
+
+void ServerDiscovery::begin()
+{
+    if ( !active )
+    {
+        counters = DiscoveryProgress();
+        seen.clear();
+    }
+    active = true;
+}
+
+void ServerDiscovery::resolve(const network::Server& address, const std::string& filter)
+{
+    Lock lock(mutex);
+    if ( !lookup )
+        lookup = std::make_shared<Lookup>(this);
+    auto pending = lookup;
+    resolving++;
+    lock.unlock();
+
+    resolver.resolve(address,
+        [pending, address, filter](const boost::system::error_code& error,
+                                   const network::Resolver::Endpoint& endpoint)
+        {
+            std::lock_guard<std::recursive_mutex> guard(pending->mutex);
+            if ( pending->discovery )
+                pending->discovery->on_resolved(error, endpoint, address, filter);
+        });
+}
+
+void ServerDiscovery::on_resolved(const boost::system::error_code& error,
+                                  const Endpoint& endpoint,
+                                  const network::Server& address,
+                                  const std::string& filter)
+{
+    Lock lock(mutex);
+    if ( resolving > 0 )
+        resolving--;
+    if ( !error )
+        enqueue(endpoint, address, filter);
+    else if ( filter.empty() )
+        counters.timed_out++;
+    lock.unlock();
+
+    if ( error )
+        callback(on_error, address.name() + ": " + error.message());
+    timer.start_before(network::Clock::duration::zero());
+}
+
+bool ServerDiscovery::enqueue_literal(const network::Server& address, const std::string& filter)
+{
+    boost::system::error_code error;
+    auto ip = boost::asio::ip::address::from_string(address.host, error);
+    if ( error )
+        return false;
+    enqueue(Endpoint(ip, address.port), address, filter);
+    return true;
+}
+
+void ServerDiscovery::enqueue(const Endpoint& endpoint, const network::Server& address,
+                              const std::string& filter)
+{
+    Query query;
+    query.endpoint = network::unmap_v4(endpoint);
+    if ( !seen.insert(query.endpoint).second )
+        return;
+    query.address = address;
+    query.filter = filter;
+    if ( filter.empty() )
+        query.challenge = random_challenge();
+    queue.push_back(std::move(query));
+}
+
+bool ServerDiscovery::open(boost::system::error_code& error)
+{
+    if ( socket.is_open() )
+        return true;
+
+    // A dual stack socket reaches both IPv4 and IPv6 servers
+    socket.open(boost::asio::ip::udp::v6(), error);
+    if ( !error )
+        socket.set_option(boost::asio::ip::v6_only(false), error);
+    ipv6 = !error;
+    if ( error )
+    {
+        boost::system::error_code ignored;
+        socket.close(ignored);
+        error.clear();
+        socket.open(boost::asio::ip::udp::v4(), error);
+        if ( error )
+            return false;
+    }
+
+    reactor.start();
+    schedule_read();
+    return true;
+}
+
+void ServerDiscovery::pump()
+{
+    std::vector<std::string> errors;
+    Lock lock(mutex);
+    auto now = network::Clock::now();
+
+    while ( !deadlines.empty() && deadlines.front().second <= now )
+    {
+        auto it = in_flight.find(deadlines.front().first);
+        if ( it != in_flight.end() && it->second.deadline == deadlines.front().second )
+        {
+            if ( it->second.filter.empty() )
+                counters.timed_out++;
+            in_flight.erase(it);
+        }
+        deadlines.pop_front();
+    }
+
+    while ( !queue.empty() && in_flight.size() < max_in_flight )
+    {
+        boost::system::error_code error;
+        if ( !open(error) )
+        {
+            errors.push_back(error.message());
+            counters.timed_out += queue.size();
+            queue.clear();
+            break;
+        }
+
+        Query query = std::move(queue.front());
+        queue.pop_front();
+
+        std::string datagram = header;
+        if ( !query.filter.empty() )
+            datagram += (ipv6 ? "getserversExt " : "getservers ") + query.filter;
+        else
+            datagram += info_query(false, query.challenge);
+
+        socket.send_to(boost::asio::buffer(datagram), ipv6 ? network::map_to_v6(query.endpoint) : query.endpoint, 0, error);
+        if ( error )
+        {
+            errors.push_back(query.address.name() + ": " + error.message());
+            if ( query.filter.empty() )
+                counters.timed_out++;
+            continue;
+        }
+
+        query.sent = now;
+        query.deadline = now + timeout;
+        deadlines.emplace_back(query.endpoint, query.deadline);
+        Endpoint endpoint = query.endpoint;
+        in_flight[endpoint] = std::move(query);
+    }
+
+    bool finished = active && queue.empty() && in_flight.empty() && resolving == 0;
+    if ( finished )
+    {
+        active = false;
+        deadlines.clear();
+    }
+    auto next = deadlines.empty() ? network::Time::max() : deadlines.front().second;
+    lock.unlock();
+
+    for ( const auto& error : errors )
+        callback(on_error, error);
+
+    if ( next != network::Time::max() )
+        timer.start(next - now);
+    else if ( finished )
+        callback(on_finished);
+}
+
+void ServerDiscovery::schedule_read()
+{
+    reading = true;
+    socket.async_receive_from(boost::asio::buffer(buffer), sender,
+        [this](const boost::system::error_code& error, std::size_t size)
+        { on_read(error, size); });
+}
+
+void ServerDiscovery::on_read(const boost::system::error_code& error, std::size_t size)
+{
+    std::vector<DiscoveredServer> found;
+    bool progress = false;
+
+    Lock lock(mutex);
+    handler_thread = std::this_thread::get_id();
+    if ( !error )
+        progress = handle_datagram(StringView(buffer.data(), size), found);
+    lock.unlock();
+
+    if ( error && error != boost::asio::error::operation_aborted )
+        callback(on_error, error.message());
+
+    for ( const auto& server : found )
+        callback(on_server, server);
+
+    if ( progress )
+        timer.start_before(network::Clock::duration::zero());
+
+    lock.lock();
+    handler_thread = std::thread::id();
+    if ( !error && socket.is_open() )
+    {
+        schedule_read();
+        return;
+    }
+    reading = false;
+    lock.unlock();
+    read_done.notify_all();
+}
+
+bool ServerDiscovery::handle_datagram(StringView datagram, std::vector<DiscoveredServer>& found)
+{
+    if ( !datagram.starts_with(header) )
+        return false;
+    datagram.remove_prefix(header.size());
+
+    auto it = in_flight.find(network::unmap_v4(sender));
+    if ( it == in_flight.end() )
+        return false;
+    Query& query = it->second;
+
+    if ( !query.filter.empty() )
+    {
+        static const StringView extended = "getserversExtResponse";
+        static const StringView plain = "getserversResponse";
+        if ( datagram.starts_with(extended) )
+            datagram.remove_prefix(extended.size());
+        else if ( datagram.starts_with(plain) )
+            datagram.remove_prefix(plain.size());
+        else
+            return false;
+
+        if ( handle_server_list(datagram) )
+            in_flight.erase(it);
+        return true;
+    }
+
+    static const StringView response = "infoResponse\n";
+    if ( !datagram.starts_with(response) )
+        return false;
+
+    DiscoveredServer server;
+    parse_server_info(datagram.substr(response.size()), false, server.info);
+    // Ignore spoofed and stale responses
+    if ( server.info.value("challenge") != query.challenge )
+        return false;
+
+    server.address = query.address;
+    server.rtt = server.info.latency = network::Clock::now() - query.sent;
+    found.push_back(std::move(server));
+    counters.answered++;
+    in_flight.erase(it);
+    return true;
+}
+
+bool ServerDiscovery::handle_server_list(StringView list)
+{
+    static const StringView end_of_list("\\EOT\0\0\0", 7);
+
+    while ( !list.empty() )
+    {
+        if ( list.starts_with(end_of_list) )
+            return true;
+
+        auto port = [&list](std::size_t offset) {
+            return uint16_t((uint8_t(list[offset]) << 8) | uint8_t(list[offset+1]));
+        };
+
+        Endpoint endpoint;
+        if ( list.front() == '\\' && list.size() >= 7 )
+        {
+            boost::asio::ip::address_v4::bytes_type bytes;
+            std::copy(list.begin() + 1, list.begin() + 5, bytes.begin());
+            endpoint = Endpoint(boost::asio::ip::address_v4(bytes), port(5));
+            list.remove_prefix(7);
+        }
+        else if ( list.front() == '/' && list.size() >= 19 )
+        {
+            boost::asio::ip::address_v6::bytes_type bytes;
+            std::copy(list.begin() + 1, list.begin() + 17, bytes.begin());
+            endpoint = Endpoint(boost::asio::ip::address_v6(bytes), port(17));
+            list.remove_prefix(19);
+        }
+        else
+        {
+            break;
+        }
+
+        if ( endpoint.port() != 0 && !endpoint.address().is_unspecified() )
+            enqueue(endpoint, network::Server(endpoint.address().to_string(), endpoint.port()));
+    }
+    return false;
+}
+
+/**
+ * \brief Parses "number" or "first-last"
+ */
+static bool parse_range(const std::string& text, unsigned max, unsigned& first, unsigned& last)
+{
+    auto dash = text.find('-');
+    std::string first_text = text.substr(0, dash);
+    std::string last_text = dash == std::string::npos ? first_text : text.substr(dash+1);
+
+    auto is_number = [](const std::string& number) {
+        return !number.empty() && number.size() <= 5 &&
+            std::all_of(number.begin(), number.end(), [](char c){ return std::isdigit(uint8_t(c)); });
+    };
+    if ( !is_number(first_text) || !is_number(last_text) )
+        return false;
+
+    first = std::stoul(first_text);
+    last = std::stoul(last_text);
+    return first <= last && last <= max;
+}
+
+std::vector<network::Server> expand_address_range(const std::string& spec,
+                                                  uint16_t default_port)
+{
+    auto begin = spec.find_first_not_of(" \t");
+    if ( begin == std::string::npos )
+        return {};
+    std::string host = spec.substr(begin, spec.find_last_not_of(" \t") - begin + 1);
+    std::string ports;
+
+    if ( host.front() == '[' )
+    {
+        auto close = host.find(']');
+        if ( close == std::string::npos )
+            return {};
+        std::string rest = host.substr(close+1);
+        host = host.substr(1, close-1);
+        if ( !rest.empty() )
+        {
+            if ( rest.front() != ':' )
+                return {};
+            ports = rest.substr(1);
+        }
+    }
+    else if ( std::count(host.begin(), host.end(), ':') == 1 )
+    {
+        auto colon = host.find(':');
+        ports = host.substr(colon+1);
+        host = host.substr(0, colon);
+    }
+
+    unsigned port_first = default_port, port_last = default_port;
+    if ( !ports.empty() && !parse_range(ports, 65535, port_first, port_last) )
+        return {};
+    if ( host.empty() || port_first == 0 )
+        return {};
+
+    // Ranges are only allowed in the last octet of IPv4 addresses,
+    // anything else with a dash is a host name
+    std::string prefix = host;
+    unsigned host_first = 0, host_last = 0;
+    bool host_range = false;
+    auto dot = host.rfind('.');
+    if ( dot != std::string::npos && host.find('-', dot) != std::string::npos &&
+         std::count(host.begin(), host.begin() + dot, '.') == 2 &&
+         std::all_of(host.begin(), host.begin() + dot,
+                     [](char c){ return c == '.' || std::isdigit(uint8_t(c)); }) )
+    {
+        if ( !parse_range(host.substr(dot+1), 255, host_first, host_last) )
+            return {};
+        prefix = host.substr(0, dot+1);
+        host_range = true;
+    }
+
+    std::size_t count = std::size_t(port_last - port_first + 1) * (host_last - host_first + 1);
+    if ( count > max_range_size )
+        return {};
+
+    std::vector<network::Server> servers;
+    servers.reserve(count);
+    for ( unsigned address = host_first; address <= host_last; address++ )
+    {
+        std::string name = host_range ? prefix + std::to_string(address) : host;
+        for ( unsigned port = port_first; port <= port_last; port++ )
+            servers.emplace_back(name, port);
+    }
+    return servers;
+}
+
+} // namespace xonotic
@@ -0,0 +1,262 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef XONOTIC_SERVER_DISCOVERY_HPP
+#define XONOTIC_SERVER_DISCOVERY_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "network/endpoint.hpp"
+#include "network/reactor.hpp"
+#include "network/resolver.hpp"
+#include "network/server.hpp"
+#include "network/timer.hpp"
+#include "server_info.hpp"
+
+namespace xonotic {
+
+/**
+ * \brief Server which has answered a discovery query
+ */
+struct DiscoveredServer
+{
+    network::Server             address;
+    ServerInfo                  info;
+    network::Clock::duration    rtt{0};     ///< Round trip time of the getinfo query
+};
+
+/**
+ * \brief Discovery progress counters
+ */
+struct DiscoveryProgress
+{
+    std::size_t queued = 0;     ///< Servers waiting to be queried
+    std::size_t in_flight = 0;  ///< Queries waiting for a response
+    std::size_t answered = 0;   ///< Servers which have responded
+    std::size_t timed_out = 0;  ///< Servers which haven't responded in time
+};
+
+/**
+ * \brief Finds servers by sending getinfo queries from a single socket
+ *
+ * Servers can be given explicitly or obtained from a master server.
+ * Only a limited number of queries is in flight at any time, the others
+ * wait in a queue. Callbacks are invoked from the reactor threads.
+ */
+class ServerDiscovery
+{
+public:
+    /**
+     * \brief Called when a server responds
+     */
+    std::function<void(const DiscoveredServer& server)> on_server;
+    /**
+     * \brief Called when there is nothing left to query
+     */
+    std::function<void()> on_finished;
+    /**
+     * \brief Called on network errors
+     */
+    std::function<void(const std::string& message)> on_error;
+
+    explicit ServerDiscovery(network::Reactor& reactor = network::Reactor::instance(),
+                             network::Resolver& resolver = network::Resolver::instance());
+
+    ServerDiscovery(const ServerDiscovery&) = delete;
+    ServerDiscovery& operator=(const ServerDiscovery&) = delete;
+
+    ~ServerDiscovery();
+
+    /**
+     * \brief Sets the maximum number of queries waiting for a response
+     */
+    void set_concurrency(std::size_t max_in_flight);
+
+    /**
+     * \brief Sets for how long to wait for a response
+     */
+    void set_timeout(network::Clock::duration timeout);
+
+    /**
+     * \brief Queues getinfo queries to \p servers
+     */
+    void query(const std::vector<network::Server>& servers);
+
+    /**
+     * \brief Asks a master server for its server list and queries all of them
+     * \param master    Master server address
+     * \param game      Game name as registered on the master
+     * \param protocol  Network protocol version
+     */
+    void query_master(const network::Server& master,
+                      const std::string& game = "Xonotic", int protocol = 3);
+
+    /**
+     * \brief Cancels all pending queries and closes the socket
+     */
+    void stop();
+
+    /**
+     * \brief Whether there are queries queued or in flight
+     */
+    bool running() const;
+
+    DiscoveryProgress progress() const;
+
+private:
+    using Lock = std::unique_lock<std::mutex>;
+    using Endpoint = boost::asio::ip::udp::endpoint;
+
+    /**
+     * \brief Query waiting to be sent or for a response
+     */
+    struct Query
+    {
+        Endpoint        endpoint;
+        network::Server address;        ///< Address as passed to query()
+        std::string     filter;         ///< getservers arguments, empty for getinfo queries
+        std::string     challenge;      ///< Token the server has to send back
+        network::Time   sent;
+        network::Time   deadline;
+    };
+
+    /**
+     * \brief Links host name lookups to the object which requested them
+     */
+    struct Lookup
+    {
+        explicit Lookup(ServerDiscovery* discovery) : discovery(discovery) {}
+        std::recursive_mutex    mutex;      ///< Held while handling the result
+        ServerDiscovery*        discovery;  ///< Null if the lookups have been cancelled
+    };
+
+    /**
+     * \brief Resolves \p address and queues it
+     */
+    void resolve(const network::Server& address, const std::string& filter);
+
+    /**
+     * \brief Called by the resolver for addresses passed to resolve()
+     */
+    void on_resolved(const boost::system::error_code& error, const Endpoint& endpoint,
+                     const network::Server& address, const std::string& filter);
+
+    /**
+     * \brief Adds \p address to the queue, using its host as IP literal if possible
+     * \returns \b false if \p address needs to be resolved
+     * \pre \c mutex is locked
+     */
+    bool enqueue_literal(const network::Server& address, const std::string& filter);
+
+    /**
+     * \brief Adds an endpoint to the queue, unless it has already been queried
+     * \param filter   getservers arguments for master servers, empty for game servers
+     * \pre \c mutex is locked
+     */
+    void enqueue(const Endpoint& endpoint, const network::Server& address,
+                 const std::string& filter = {});
+
+    /**
+     * \brief Resets the counters if the previous run has finished
+     * \pre \c mutex is locked
+     */
+    void begin();
+
+    /**
+     * \brief Opens the socket if needed
+     * \pre \c mutex is locked
+     */
+    bool open(boost::system::error_code& error);
+
+    /**
+     * \brief Sends queued queries, expires old ones and schedules the next run
+     */
+    void pump();
+
+    /**
+     * \brief Schedules an asynchronous read
+     * \pre \c mutex is locked
+     */
+    void schedule_read();
+
+    void on_read(const boost::system::error_code& error, std::size_t size);
+
+    /**
+     * \brief Handles a response from \c sender
+     * \pre \c mutex is locked
+     * \returns \b true if it has completed a query
+     */
+    bool handle_datagram(StringView datagram, std::vector<DiscoveredServer>& found);
+
+    /**
+     * \brief Queues the servers listed in a getservers response
+     * \pre \c mutex is locked
+     * \returns \b true if this was the last datagram of the list
+     */
+    bool handle_server_list(StringView list);
+
+    network::Reactor&                   reactor;
+    network::Resolver&                  resolver;
+    boost::asio::ip::udp::socket        socket;
+    bool                                ipv6 = false;       ///< Whether \c socket is dual stack
+    Endpoint                            sender;             ///< Source of the datagram being read
+    std::vector<char>                   buffer;             ///< Receive buffer
+    std::shared_ptr<Lookup>             lookup;             ///< Pending host name lookups
+    std::size_t                         resolving = 0;      ///< Number of pending host name lookups
+    std::deque<Query>                   queue;              ///< Queries waiting to be sent
+    std::unordered_map<Endpoint, Query, network::EndpointHash> in_flight; ///< Queries waiting for a response
+    std::deque<std::pair<Endpoint, network::Time>> deadlines;    ///< In flight queries in send order
+    std::unordered_set<Endpoint, network::EndpointHash> seen;  ///< Endpoints already queued
+    std::size_t                         max_in_flight = 64;
+    network::Clock::duration            timeout = std::chrono::seconds(2);
+    DiscoveryProgress                   counters;
+    bool                                active = false;     ///< Whether on_finished is due
+    network::Timer                      timer;              ///< Runs pump()
+    mutable std::mutex                  mutex;              ///< Guards everything above
+    std::condition_variable             read_done;          ///< Notified when \c reading is cleared
+    bool                                reading = false;    ///< Whether a read handler is pending
+    std::thread::id                     handler_thread;     ///< Thread running the read handler
+};
+
+/**
+ * \brief Expands an address range into servers
+ *
+ * Accepts "host", "host:port", and ranges in the last octet of an IPv4
+ * address and in the port: "192.168.1.1-254:26000-26010".
+ * \returns An empty vector if \p spec isn't valid
+ */
+std::vector<network::Server> expand_address_range(const std::string& spec,
+                                                  uint16_t default_port = 26000);
+
+} // namespace xonotic
+#endif // XONOTIC_SERVER_DISCOVERY_HPP
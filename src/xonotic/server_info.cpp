@@ -0,0 +1,164 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "server_info.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <random>
+
+namespace xonotic {
+
+/**
+ * \brief Reads an integer from the start of \p line and removes it
+ * \returns \b false if there is no number or it doesn't fit in an int
+ */
+static bool take_number(StringView& line, int& number)
+{
+    while ( !line.empty() && line.front() == ' ' )
+        line.remove_prefix(1);
+
+    bool negative = !line.empty() && line.front() == '-';
+    if ( negative )
+        line.remove_prefix(1);
+
+    if ( line.empty() || line.front() < '0' || line.front() > '9' )
+        return false;
+
+    // Replies can be garbled or hostile, stop as soon as it's out of range
+    int64_t limit = negative ? -int64_t(std::numeric_limits<int>::min())
+                             : std::numeric_limits<int>::max();
+    int64_t value = 0;
+    while ( !line.empty() && line.front() >= '0' && line.front() <= '9' )
+    {
+        value = value * 10 + (line.front() - '0');
+        if ( value > limit )
+            return false;
+        line.remove_prefix(1);
+    }
+    number = int(negative ? -value : value);
+    return true;
+}
+
+int ServerInfo::number(const std::string& key, int fallback) const
+{
+    auto it = values.find(key);
+    if ( it == values.end() )
+        return fallback;
+    StringView value = it->second;
+    int result;
+    return take_number(value, result) ? result : fallback;
+}
+
+std::string random_challenge(std::size_t length)
+{
+    static const char characters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    static std::mt19937 random{std::random_device{}()};
+    static std::mutex random_mutex;
+
+    std::string challenge(length, ' ');
+    std::lock_guard<std::mutex> random_lock(random_mutex);
+    std::uniform_int_distribution<std::size_t> pick(0, sizeof(characters) - 2);
+    for ( auto& c : challenge )
+        c = characters[pick(random)];
+    return challenge;
+}
+
+void parse_info_string(StringView info, std::map<std::string, std::string>& values)
+{
+    if ( !info.empty() && info.front() == '\\' )
+        info.remove_prefix(1);
+
+    while ( !info.empty() )
+    {
+        auto key_end = info.find('\\');
+        if ( key_end == StringView::npos )
+            break;
+        StringView key = info.substr(0, key_end);
+        info.remove_prefix(key_end+1);
+
+        auto value_end = info.find('\\');
+        StringView value = info.substr(0, value_end);
+        values[key.str()] = value.str();
+        if ( value_end == StringView::npos )
+            break;
+        info.remove_prefix(value_end+1);
+    }
+}
+
+/**
+ * \brief Parses a statusResponse player line: <score> <ping> "<name>" [<team>]
+ */
+static bool parse_player(StringView line, InfoPlayer& player)
+{
+    if ( !take_number(line, player.score) || !take_number(line, player.ping) )
+        return false;
+
+    auto open = line.find('"');
+    if ( open == StringView::npos )
+        return false;
+    line.remove_prefix(open+1);
+
+    // The name may contain quotes, the last one closes it
+    StringView::size_type close = StringView::npos;
+    for ( StringView::size_type i = line.size(); i > 0; i-- )
+    {
+        if ( line[i-1] == '"' )
+        {
+            close = i-1;
+            break;
+        }
+    }
+    if ( close == StringView::npos )
+        return false;
+
+    player.name = line.substr(0, close).str();
+    line.remove_prefix(close+1);
+    if ( !take_number(line, player.team) )
+        player.team = -1;
+    return true;
+}
+
+void parse_server_info(StringView message, bool players, ServerInfo& info)
+{
+    info.has_players = players;
+    auto newline = message.find('\n');
+    parse_info_string(message.substr(0, newline), info.values);
+    if ( !players || newline == StringView::npos )
+        return;
+
+    message.remove_prefix(newline+1);
+    while ( !message.empty() )
+    {
+        newline = message.find('\n');
+        InfoPlayer player;
+        if ( parse_player(message.substr(0, newline), player) )
+            info.players.push_back(std::move(player));
+        if ( newline == StringView::npos )
+            break;
+        message.remove_prefix(newline+1);
+    }
+}
+
+} // namespace xonotic
@@ -0,0 +1,103 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \section License
+ *
+ * Copyright (C) 2015 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef XONOTIC_SERVER_INFO_HPP
+#define XONOTIC_SERVER_INFO_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "string_view.hpp"
+#include "network/time.hpp"
+
+namespace xonotic {
+
+/**
+ * \brief Player as listed by statusResponse
+ */
+struct InfoPlayer
+{
+    int         score = 0;
+    int         ping = 0;
+    std::string name;       ///< Name with color codes
+    int         team = -1;  ///< Team number, -1 if not reported
+};
+
+/**
+ * \brief Server details from a connectionless getinfo or getstatus query
+ */
+struct ServerInfo
+{
+    std::map<std::string, std::string>  values;             ///< Info string keys and values
+    std::vector<InfoPlayer>             players;            ///< Only filled by statusResponse
+    bool                                has_players = false;///< Whether this is a statusResponse
+    network::Clock::duration            latency{0};         ///< Time between query and response
+
+    /**
+     * \brief Returns the value for \p key, or \p fallback if missing
+     */
+    std::string value(const std::string& key, const std::string& fallback = {}) const
+    {
+        auto it = values.find(key);
+        return it == values.end() ? fallback : it->second;
+    }
+
+    /**
+     * \brief Returns the value for \p key as a number
+     *
+     * Returns \p fallback if it's missing, not a number or doesn't fit in an int.
+     */
+    int number(const std::string& key, int fallback = 0) const;
+};
+
+/**
+ * \brief Builds a getinfo or getstatus query (without the datagram header)
+ * \param players   Whether to ask for the player list (getstatus)
+ * \param challenge Token the server sends back in the response
+ */
+inline std::string info_query(bool players, const std::string& challenge)
+{
+    return (players ? "getstatus " : "getinfo ") + challenge;
+}
+
+/**
+ * \brief Generates a random alphanumeric token for connectionless queries
+ */
+std::string random_challenge(std::size_t length = 12);
+
+/**
+ * \brief Parses a "\key\value\key\value" info string
+ */
+void parse_info_string(StringView info, std::map<std::string, std::string>& values);
+
+/**
+ * \brief Parses the body of an infoResponse or statusResponse
+ * \param message   Datagram contents after the response name and its newline
+ * \param players   Whether it's a statusResponse
+ * \param info      Output
+ */
+void parse_server_info(StringView message, bool players, ServerInfo& info);
+
+} // namespace xonotic
+#endif // XONOTIC_SERVER_INFO_HPP